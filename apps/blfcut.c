@@ -0,0 +1,703 @@
+/*  blfcut -- cut, filter and merge BLF files
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/*
+ * usage:
+ *
+ * blfcut -o bus1.blf --keep-bus 1 --from 600 --to 1200 log.blf
+ * blfcut -o part.blf --split-size 100 log.blf     > part_000.blf ...
+ * blfcut -o all.blf log1.blf log2.blf
+ *
+ * Inputs are merged in time order, their time stamps taken relative to
+ * the earliest start of measurement, and read up to the first container
+ * that starts after --to. A container of which all objects are kept, in
+ * order, is copied as it is; other objects are packed into new
+ * containers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+#include <zlib.h>
+
+#include "blfapi.h"
+#include "blfsource.h"
+#include "blfwriter.h"
+
+#define MAX_FILTER 64
+#define ID_MASK 0x1FFFFFFFu
+
+typedef struct {
+  const char *name;
+  FILE *fp;
+  BlfSource *src;
+  LOGG_t logg;
+  int64_t offset;           /* ns added to time stamps */
+
+  /* the current container */
+  VBLObjectHeaderBaseLOGG log;
+  unsigned char *zip;
+  size_t zip_cap;
+  unsigned char *out;
+  size_t out_cap;
+  const unsigned char *data;
+  size_t size, pos;
+  int whole;                /* starts with an object */
+
+  /* object continued from earlier containers */
+  unsigned char *obj;
+  size_t obj_cap, obj_have;
+  size_t skip;              /* padding continued from the last container */
+
+  /* the next object */
+  const VBLObjectHeaderBase *next;
+  uint64_t ns;              /* its time, or that of the one before */
+  int at_start;             /* begins the current container */
+  int eof;
+} input_t;
+
+typedef struct {
+  unsigned int n;
+  unsigned long v[MAX_FILTER];
+} filter_t;
+
+static filter_t keep_bus, drop_bus, keep_id, drop_id;
+static double t_from = -HUGE_VAL, t_to = HUGE_VAL;
+static double split_time = 0;
+static double split_size = 0;
+static int verbose_level = 0;
+
+typedef struct {
+  const char *pattern;
+  int split;
+  int index;
+  FILE *fp;
+  BlfWriter *writer;
+  uint64_t objects;         /* in the current output */
+  uint64_t window;          /* ns, of the current output with split_time */
+  int started;
+  uint64_t copied, packed;  /* containers copied, objects packed */
+  const LOGG_t *logg;
+} output_t;
+
+static unsigned char *scratch;
+static size_t scratch_cap;
+
+
+static int grow(unsigned char **buf, size_t *cap, size_t n)
+{
+  unsigned char *p;
+  if(n <= *cap) return 1;
+  p = realloc(*buf, n);
+  if(!p) {
+    fprintf(stderr, "error: out of memory\n");
+    return 0;
+  }
+  *buf = p;
+  *cap = n;
+  return 1;
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/* size of the object at p of which n bytes are there, 0 if there is none */
+static uint32_t object_size(const unsigned char *p, size_t n)
+{
+  uint32_t size;
+  if(n < sizeof(VBLObjectHeaderBase)) return 0;
+  size = get32(p + 8);
+  if(memcmp(p, "LOBJ", 4) != 0 || size < sizeof(VBLObjectHeaderBase))
+    return 0;
+  return size;
+}
+
+/* ms since the epoch of a start of measurement, 0 if unknown */
+static int64_t systemtime_ms(const SYSTEMTIME *s)
+{
+  struct tm tm;
+  if(s->wYear == 0) return 0;
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_year = s->wYear - 1900;
+  tm.tm_mon = s->wMonth - 1;
+  tm.tm_mday = s->wDay;
+  tm.tm_hour = s->wHour;
+  tm.tm_min = s->wMinute;
+  tm.tm_sec = s->wSecond;
+  return (int64_t)timegm(&tm) * 1000 + s->wMilliseconds;
+}
+
+static int load_container(input_t *in)
+{
+  unsigned char padding[4];
+  size_t size;
+
+  if(blfSourceRead(in->src, &in->log, sizeof(in->log)) != sizeof(in->log))
+    return 0;
+  if(memcmp(&in->log.base.mSignature, "LOBJ", 4) != 0
+     || in->log.base.mObjectType != BL_OBJ_TYPE_LOG_CONTAINER
+     || in->log.base.mObjectSize < sizeof(in->log)) {
+    fprintf(stderr, "error: %s: expected a log container\n", in->name);
+    return 0;
+  }
+  size = in->log.base.mObjectSize - sizeof(in->log);
+  if(!grow(&in->zip, &in->zip_cap, size)) return 0;
+  if(blfSourceRead(in->src, in->zip, size) != size) {
+    fprintf(stderr, "error: %s: container cut short\n", in->name);
+    return 0;
+  }
+  blfSourceRead(in->src, padding, size % 4); /* missing after the last one */
+
+  if(in->log.compressedflag == 2) {
+    uLongf n = in->log.deflatebuffersize;
+    if(!grow(&in->out, &in->out_cap, n)) return 0;
+    if(uncompress(in->out, &n, in->zip, size) != Z_OK) {
+      fprintf(stderr, "error: %s: inflating a container failed\n", in->name);
+      return 0;
+    }
+    in->data = in->out;
+    in->size = n;
+  } else {
+    in->data = in->zip;
+    in->size = size;
+  }
+  in->pos = 0;
+  in->whole = !in->obj_have && !in->skip;
+  return 1;
+}
+
+/* time stamp of obj moved by offset, in a copy */
+static const VBLObjectHeaderBase *shift_time(const VBLObjectHeaderBase *obj,
+                                             int64_t offset)
+{
+  VBLObjectHeader *h;
+  if(!grow(&scratch, &scratch_cap, obj->mObjectSize)) return NULL;
+  memcpy(scratch, obj, obj->mObjectSize);
+  h = (VBLObjectHeader *)scratch;
+  if(h->mObjectFlags & BL_OBJ_FLAG_TIME_TEN_MICS)
+    h->mObjectTimeStamp += offset / 10000;
+  else
+    h->mObjectTimeStamp += offset;
+  return (VBLObjectHeaderBase *)scratch;
+}
+
+/* move to the next object of in, 0 at the end */
+static int advance(input_t *in)
+{
+  uint64_t ns;
+  uint32_t size;
+
+  in->next = NULL;
+  in->at_start = 0;
+  while(!in->eof) {
+    if(in->pos >= in->size) {
+      if(!load_container(in)) {
+        /* the padding of the last object may be missing */
+        size = object_size(in->obj, in->obj_have);
+        if(in->obj_have && (!size || in->obj_have < size))
+          fprintf(stderr, "warning: %s ends within an object\n", in->name);
+        in->eof = 1;
+        if(!size || in->obj_have < size) return 0;
+        in->next = (VBLObjectHeaderBase *)in->obj;
+        in->obj_have = 0;
+        break;
+      }
+      continue;
+    }
+    if(in->skip) {
+      size_t n = in->size - in->pos < in->skip ? in->size - in->pos : in->skip;
+      in->pos += n;
+      in->skip -= n;
+      continue;
+    }
+
+    if(in->obj_have) {
+      /* gather the base, then the rest of the object */
+      size_t total = in->obj_have < sizeof(VBLObjectHeaderBase)
+        ? sizeof(VBLObjectHeaderBase) : object_size(in->obj, in->obj_have);
+      size_t n;
+      if(!total) break;
+      n = in->size - in->pos < total - in->obj_have
+        ? in->size - in->pos : total - in->obj_have;
+      if(!grow(&in->obj, &in->obj_cap, in->obj_have + n)) break;
+      memcpy(in->obj + in->obj_have, in->data + in->pos, n);
+      in->obj_have += n;
+      in->pos += n;
+      size = object_size(in->obj, in->obj_have);
+      if(!size && in->obj_have >= sizeof(VBLObjectHeaderBase)) break;
+      if(!size || in->obj_have < size) continue;
+      in->next = (VBLObjectHeaderBase *)in->obj;
+      in->obj_have = 0;
+      in->skip = size % 4;
+      break;
+    }
+
+    size = object_size(in->data + in->pos, in->size - in->pos);
+    if(size && in->size - in->pos >= size) {
+      /* in place */
+      in->next = (const VBLObjectHeaderBase *)(in->data + in->pos);
+      in->at_start = in->whole && in->pos == 0;
+      in->pos += size;
+      in->skip = size % 4;
+      break;
+    }
+    if(!size && in->size - in->pos >= sizeof(VBLObjectHeaderBase)) break;
+
+    /* continues in the next container */
+    if(!grow(&in->obj, &in->obj_cap, size > sizeof(VBLObjectHeaderBase)
+             ? size : sizeof(VBLObjectHeaderBase))) break;
+    in->obj_have = in->size - in->pos;
+    memcpy(in->obj, in->data + in->pos, in->obj_have);
+    in->pos = in->size;
+  }
+
+  if(!in->next) {
+    if(!in->eof)
+      fprintf(stderr, "error: %s: unreadable object\n", in->name);
+    in->eof = 1;
+    return 0;
+  }
+  if(blfObjectTime(in->next, &ns))
+    in->ns = ns + in->offset;
+  return 1;
+}
+
+static int in_filter(const filter_t *f, unsigned long v, unsigned long mask)
+{
+  unsigned int i;
+  for(i = 0; i < f->n; i++)
+    if((f->v[i] & mask) == (v & mask)) return 1;
+  return 0;
+}
+
+/* whether obj at time ns goes to the output */
+static int keep(const VBLObjectHeaderBase *obj, uint64_t ns)
+{
+  const unsigned char *p = (const unsigned char *)obj;
+  double t = ns * 1e-9;
+  uint32_t type = obj->mObjectType;
+  unsigned long bus, id;
+
+  if(t < t_from || t > t_to) return 0;
+  switch(type) {
+  case BL_OBJ_TYPE_CAN_MESSAGE:
+  case BL_OBJ_TYPE_CAN_MESSAGE2:
+  case BL_OBJ_TYPE_CAN_FD_MESSAGE:
+  case BL_OBJ_TYPE_CAN_FD_MESSAGE_64:
+    if(obj->mObjectSize < 40) return 1;
+    id = get32(p + 36);
+    if(keep_id.n && !in_filter(&keep_id, id, ID_MASK)) return 0;
+    if(in_filter(&drop_id, id, ID_MASK)) return 0;
+    /* the bus is at 32 for these too */
+    /* fall through */
+  case BL_OBJ_TYPE_CAN_STATISTIC:
+  case BL_OBJ_TYPE_CAN_DRIVER_ERROR:
+  case BL_OBJ_TYPE_CAN_ERROR_EXT:
+    if(obj->mObjectSize < 34) return 1;
+    bus = type == BL_OBJ_TYPE_CAN_FD_MESSAGE_64 ? p[32] : p[32] | p[33] << 8;
+    if(keep_bus.n && !in_filter(&keep_bus, bus, ~0ul)) return 0;
+    if(in_filter(&drop_bus, bus, ~0ul)) return 0;
+    return 1;
+  default:
+    return 1;
+  }
+}
+
+static int output_close(output_t *out)
+{
+  int ret = 0;
+  if(out->writer && !blfWriterClose(out->writer)) ret = 1;
+  if(out->fp && out->fp != stdout && fclose(out->fp) != 0) ret = 1;
+  out->writer = NULL;
+  out->fp = NULL;
+  return ret;
+}
+
+/* start the next output, name_NNN.blf when splitting */
+static int output_open(output_t *out)
+{
+  char *name;
+  const char *dot = strrchr(out->pattern, '.');
+  size_t len = strlen(out->pattern) + 16;
+
+  if(output_close(out)) return 1;
+  if(!out->split) {
+    name = strdup(out->pattern);
+  } else {
+    name = malloc(len);
+    if(name) {
+      if(!dot || strchr(dot, '/')) dot = out->pattern + strlen(out->pattern);
+      snprintf(name, len, "%.*s_%03d%s", (int)(dot - out->pattern),
+               out->pattern, out->index, dot);
+    }
+  }
+  if(!name) return 1;
+  out->fp = strcmp(name, "-") ? fopen(name, "wb") : stdout;
+  if(!out->fp) {
+    fprintf(stderr, "error: could not open %s\n", name);
+    free(name);
+    return 1;
+  }
+  if(verbose_level) fprintf(stderr, "writing %s\n", name);
+  free(name);
+  out->writer = blfWriterOpen(out->fp, out->logg);
+  out->index++;
+  out->objects = 0;
+  return out->writer == NULL;
+}
+
+/* the output for objects from ns to last_ns, of n bytes */
+static int output_for(output_t *out, uint64_t ns, uint64_t last_ns, size_t n,
+                      int *fits)
+{
+  uint64_t span = (uint64_t)(split_time * 1e9);
+  int rotate = !out->writer;
+
+  if(!out->started) {
+    out->window = ns;
+    out->started = 1;
+  }
+  *fits = 1;
+  if(span) {
+    if(ns >= out->window + span) {
+      out->window += (ns - out->window) / span * span;
+      rotate = 1;
+    }
+    *fits = last_ns < out->window + span;
+  }
+  if(split_size > 0 && out->objects
+     && blfWriterSize(out->writer) + n > split_size * (1 << 20))
+    rotate = 1;
+  return rotate ? output_open(out) : 0;
+}
+
+/*
+ * Whether the container at which in stands can be copied: it ends at
+ * the end of an object, all its objects are kept and in time before
+ * those of the other inputs.
+ */
+static int copyable(input_t *in, input_t *inputs, int n_inputs,
+                    uint32_t *n_objects, uint64_t *last_ns)
+{
+  size_t pos = 0;
+  uint64_t ns = in->ns;
+  int i;
+
+  if(!in->at_start || in->offset) return 0;
+  *n_objects = 0;
+  *last_ns = in->ns;
+  while(pos < in->size) {
+    const VBLObjectHeaderBase *obj = (const VBLObjectHeaderBase *)(in->data + pos);
+    uint32_t size = object_size(in->data + pos, in->size - pos);
+    if(!size || pos + size + size % 4 > in->size) return 0;
+    if(blfObjectTime(obj, &ns) && ns > *last_ns) *last_ns = ns;
+    if(!keep(obj, ns)) return 0;
+    (*n_objects)++;
+    pos += size + size % 4;
+  }
+  for(i = 0; i < n_inputs; i++) {
+    input_t *other = &inputs[i];
+    if(other == in || other->eof) continue;
+    if(*last_ns > other->ns || (*last_ns == other->ns && other < in))
+      return 0;
+  }
+  return 1;
+}
+
+static int open_input(input_t *in, const char *name)
+{
+  memset(in, 0, sizeof(*in));
+  in->name = name;
+  in->fp = strcmp(name, "-") ? fopen(name, "rb") : stdin;
+  if(!in->fp) {
+    fprintf(stderr, "error: could not open %s\n", name);
+    return 1;
+  }
+  if(fread(&in->logg, 1, sizeof(in->logg), in->fp) != sizeof(in->logg)
+     || memcmp(&in->logg.mSignature, "LOGG", 4) != 0) {
+    fprintf(stderr, "error: %s is not a BLF file\n", name);
+    return 1;
+  }
+  /* later versions may have a longer file header */
+  if(in->logg.mHeaderSize > sizeof(in->logg)) {
+    uint32_t n = in->logg.mHeaderSize - sizeof(in->logg);
+    while(n-- && fgetc(in->fp) != EOF);
+  }
+  in->src = blfSourceOpen(in->fp);
+  return in->src == NULL;
+}
+
+static void close_input(input_t *in)
+{
+  blfSourceClose(in->src);
+  if(in->fp && in->fp != stdin) fclose(in->fp);
+  free(in->zip);
+  free(in->out);
+  free(in->obj);
+}
+
+static int cut(input_t *inputs, int n_inputs, output_t *out)
+{
+  int64_t start = 0;
+  int i, ret = 0;
+
+  /* time stamps relative to the earliest start of measurement */
+  for(i = 0; i < n_inputs; i++) {
+    int64_t ms = systemtime_ms(&inputs[i].logg.mMeasurementStartTime);
+    if(ms && (!start || ms < start)) {
+      start = ms;
+      out->logg = &inputs[i].logg;
+    }
+  }
+  if(!out->logg) out->logg = &inputs[0].logg;
+  for(i = 0; i < n_inputs; i++) {
+    int64_t ms = systemtime_ms(&inputs[i].logg.mMeasurementStartTime);
+    inputs[i].offset = ms && start ? (ms - start) * 1000000 : 0;
+    advance(&inputs[i]);
+  }
+
+  while(!ret) {
+    input_t *in = NULL;
+    const VBLObjectHeaderBase *obj;
+    uint32_t n_objects;
+    uint64_t last_ns;
+    int fits;
+
+    for(i = 0; i < n_inputs; i++) {
+      if(inputs[i].next && (!in || inputs[i].ns < in->ns)) in = &inputs[i];
+    }
+    if(!in) break;
+
+    /* the rest of an input in time order is past the end */
+    if(in->at_start && in->ns * 1e-9 > t_to) {
+      in->next = NULL;
+      in->eof = 1;
+      continue;
+    }
+
+    if(copyable(in, inputs, n_inputs, &n_objects, &last_ns)) {
+      ret = output_for(out, in->ns, last_ns, in->log.base.mObjectSize, &fits);
+      if(!ret && fits) {
+        ret = !blfWriterContainer(out->writer, &in->log, in->zip,
+                                  n_objects, last_ns);
+        out->objects += n_objects;
+        out->copied++;
+        in->pos = in->size;
+        in->skip = 0;
+        advance(in);
+        continue;
+      }
+    }
+
+    obj = in->next;
+    if(keep(obj, in->ns)) {
+      if(in->offset) obj = shift_time(obj, in->offset);
+      ret = !obj || output_for(out, in->ns, in->ns, obj->mObjectSize, &fits)
+        || !blfWriterObject(out->writer, obj);
+      out->objects++;
+      out->packed++;
+    }
+    advance(in);
+  }
+
+  if(!out->writer && !ret) ret = output_open(out); /* nothing kept */
+  if(output_close(out)) ret = 1;
+  if(verbose_level)
+    fprintf(stderr, "%llu containers copied, %llu objects packed\n",
+            (unsigned long long)out->copied, (unsigned long long)out->packed);
+  return ret;
+}
+
+static int add_filter(filter_t *f, const char *arg)
+{
+  char *end;
+  unsigned long v = strtoul(arg, &end, 0);
+  if(*end != '\0' || end == arg || f->n == MAX_FILTER) {
+    fprintf(stderr, "error: invalid filter %s\n", arg);
+    return 1;
+  }
+  f->v[f->n++] = v;
+  return 0;
+}
+
+static void usage_error(const char *program_name)
+{
+  fprintf(stderr, "Type '%s --help' for more information\n",program_name);
+  exit(EXIT_FAILURE);
+}
+
+static void help(const char *program_name)
+{
+  fprintf(stderr,
+          "Usage: %s [OPTIONS] -o <blffile> <blffile> ... \n"
+          "Cut, filter and merge BLF files.\n"
+          "Several inputs are merged in time order. Containers of which\n"
+          "all objects are kept are copied as they are.\n"
+          "\n"
+          "Options:\n"
+          "  -o, --output <file>        output BLF file, - for stdout\n"
+          "  -f, --from <t0>            keep objects from time t0 in seconds\n"
+          "  -t, --to <t1>              keep objects up to time t1 in seconds\n"
+          "      --keep-bus <n>         keep frames of bus n only, repeatable\n"
+          "      --drop-bus <n>         drop frames of bus n, repeatable\n"
+          "      --keep-id <id>         keep frames of CAN ID id only, repeatable\n"
+          "      --drop-id <id>         drop frames of CAN ID id, repeatable\n"
+          "      --split-time <s>       start a new output every s seconds,\n"
+          "                             named <file>_000.blf and on\n"
+          "      --split-size <MB>      start a new output after about MB\n"
+          "  -j, --jobs <n>             containers deflated at once\n"
+          "                             (default one per CPU)\n"
+          "  -z, --level <n>            zlib compression level (default 6)\n"
+          "  -v, --verbose              verbose output\n"
+          "  -h, --help                 display this help and exit\n"
+          "\n", program_name);
+}
+
+enum {
+  OPT_KEEP_BUS = 256, OPT_DROP_BUS, OPT_KEEP_ID, OPT_DROP_ID,
+  OPT_SPLIT_TIME, OPT_SPLIT_SIZE
+};
+
+int
+main(int argc, char **argv)
+{
+  char *program_name = argv[0];
+  output_t out;
+  input_t *inputs;
+  int n_inputs, i, ret = 0;
+
+  memset(&out, 0, sizeof(out));
+
+  /* parse arguments */
+  while (1) {
+    static struct option long_options[] = {
+      {"verbose",    no_argument,       &verbose_level, 1},
+      {"output",     required_argument, NULL, (int)'o'},
+      {"from",       required_argument, NULL, (int)'f'},
+      {"to",         required_argument, NULL, (int)'t'},
+      {"keep-bus",   required_argument, NULL, OPT_KEEP_BUS},
+      {"drop-bus",   required_argument, NULL, OPT_DROP_BUS},
+      {"keep-id",    required_argument, NULL, OPT_KEEP_ID},
+      {"drop-id",    required_argument, NULL, OPT_DROP_ID},
+      {"split-time", required_argument, NULL, OPT_SPLIT_TIME},
+      {"split-size", required_argument, NULL, OPT_SPLIT_SIZE},
+      {"jobs",       required_argument, NULL, (int)'j'},
+      {"level",      required_argument, NULL, (int)'z'},
+      {"help",       no_argument,       NULL, (int)'h'},
+      {0, 0, 0, 0}
+    };
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+    int c;
+
+    c = getopt_long (argc, argv, "hvo:f:t:j:z:",
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1) break;
+
+    switch (c) {
+    case 0:
+      break;
+    case 'o':
+      out.pattern = optarg;
+      break;
+    case 'f':
+      t_from = atof(optarg);
+      break;
+    case 't':
+      t_to = atof(optarg);
+      break;
+    case OPT_KEEP_BUS:
+      if(add_filter(&keep_bus, optarg)) usage_error(program_name);
+      break;
+    case OPT_DROP_BUS:
+      if(add_filter(&drop_bus, optarg)) usage_error(program_name);
+      break;
+    case OPT_KEEP_ID:
+      if(add_filter(&keep_id, optarg)) usage_error(program_name);
+      break;
+    case OPT_DROP_ID:
+      if(add_filter(&drop_id, optarg)) usage_error(program_name);
+      break;
+    case OPT_SPLIT_TIME:
+      split_time = atof(optarg);
+      out.split = 1;
+      break;
+    case OPT_SPLIT_SIZE:
+      split_size = atof(optarg);
+      out.split = 1;
+      break;
+    case 'j':
+      blfWriterOpts.jobs = atoi(optarg);
+      break;
+    case 'z':
+      blfWriterOpts.level = atoi(optarg);
+      break;
+    case 'v':
+      verbose_level = 1;
+      break;
+    case 'h':
+      help(program_name);
+      exit(EXIT_SUCCESS);
+      break;
+    case '?':
+      /* getopt_long already printed an error message. */
+      usage_error(program_name);
+      break;
+    default:
+      fprintf(stderr, "error: unknown option %c\n", c);
+      usage_error(program_name);
+    }
+  }
+
+  if (out.pattern == NULL) {
+    fprintf(stderr, "error: output file not specified\n");
+    usage_error(program_name);
+  }
+  if (out.split && strcmp(out.pattern, "-") == 0) {
+    fprintf(stderr, "error: cannot split to stdout\n");
+    usage_error(program_name);
+  }
+  if (split_time < 0 || split_size < 0) {
+    fprintf(stderr, "error: invalid split\n");
+    usage_error(program_name);
+  }
+  n_inputs = argc - optind;
+  if (n_inputs < 1) {
+    fprintf(stderr, "error: missing .blf filename\n");
+    usage_error(program_name);
+  }
+
+  inputs = calloc(n_inputs, sizeof(input_t));
+  if (!inputs) return 1;
+  for (i = 0; i < n_inputs && !ret; i++)
+    ret = open_input(&inputs[i], argv[optind + i]);
+  if (!ret)
+    ret = cut(inputs, n_inputs, &out);
+  for (i = 0; i < n_inputs; i++)
+    close_input(&inputs[i]);
+  free(inputs);
+  free(scratch);
+  return ret;
+}
@@ -0,0 +1,578 @@
+/*  blfls -- list contents of BLF files
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/*
+ * Containers are read ahead and inflated in batches, one container per
+ * thread at a time. Objects are then walked in file order looking only
+ * at their headers, payloads are skipped without being copied. Headers
+ * cut by the end of a container are gathered from the next one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "blfapi.h"
+#include "blfsource.h"
+#include "hashtable.h"
+#include "hashtable_itr.h"
+
+/* header bytes looked at, up to the ID of a CAN message */
+#define HEAD_SIZE 40
+
+static int n_jobs = 0;
+
+typedef struct {
+  uint16_t bus;
+  uint32_t id;
+  uint64_t frames;
+  uint64_t t0, t1;    /* ns */
+} id_stats_t;
+
+typedef struct {
+  unsigned char *zip;
+  size_t zip_size, zip_cap;
+  unsigned char *out;   /* inflated */
+  size_t out_cap;
+  const unsigned char *data;  /* out, or zip when stored */
+  size_t size;
+  int compressed;
+  int failed;
+} container_t;
+
+typedef struct {
+  container_t *containers;
+  int n;
+  int next;           /* next container to inflate, taken atomically */
+} batch_t;
+
+typedef struct {
+  uint64_t containers;
+  uint64_t compressed, uncompressed;
+  uint64_t objects;
+  uint64_t types[256];
+  uint64_t other_types;
+  uint64_t frames;
+  uint64_t t0, t1;    /* ns, of objects with a time stamp */
+  int timed;
+  struct hashtable *ids;
+  id_stats_t *last;   /* looked up last, frames come in runs */
+
+  /* object cut by the end of a container */
+  unsigned char head[HEAD_SIZE];
+  size_t have;
+  uint64_t skip;      /* bytes of the current object not walked yet */
+  int corrupt;
+  int truncated;      /* containers missing or unreadable */
+} blfls_t;
+
+
+static unsigned int id_hash(void *k)
+{
+  const id_stats_t *s = k;
+  return s->id + 31 * s->bus;
+}
+
+static int id_equal(void *k1, void *k2)
+{
+  const id_stats_t *a = k1, *b = k2;
+  return a->bus == b->bus && a->id == b->id;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+  const id_stats_t *x = *(id_stats_t *const *)a, *y = *(id_stats_t *const *)b;
+  if(x->bus != y->bus) return x->bus < y->bus ? -1 : 1;
+  return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static const char *type_name(unsigned int type)
+{
+  switch(type) {
+  case BL_OBJ_TYPE_CAN_MESSAGE:      return "CAN_MESSAGE";
+  case BL_OBJ_TYPE_CAN_STATISTIC:    return "CAN_STATISTIC";
+  case BL_OBJ_TYPE_CAN_DRIVER_ERROR: return "CAN_DRIVER_ERROR";
+  case BL_OBJ_TYPE_CAN_ERROR_EXT:    return "CAN_ERROR_EXT";
+  case BL_OBJ_TYPE_CAN_MESSAGE2:     return "CAN_MESSAGE2";
+  case BL_OBJ_TYPE_CAN_FD_MESSAGE:   return "CAN_FD_MESSAGE";
+  case BL_OBJ_TYPE_CAN_FD_MESSAGE_64: return "CAN_FD_MESSAGE_64";
+  default:                           return "";
+  }
+}
+
+static void count_frame(blfls_t *ls, uint16_t bus, uint32_t id, uint64_t ns)
+{
+  id_stats_t key, *s = ls->last;
+
+  if(!s || s->bus != bus || s->id != id) {
+    key.bus = bus;
+    key.id = id;
+    s = hashtable_search(ls->ids, &key);
+    if(!s) {
+      s = calloc(1, sizeof(id_stats_t));
+      if(!s) return;
+      s->bus = bus;
+      s->id = id;
+      s->t0 = ns;
+      hashtable_insert(ls->ids, s, s);
+    }
+    ls->last = s;
+  }
+  if(ns < s->t0) s->t0 = ns;
+  if(ns > s->t1) s->t1 = ns;
+  s->frames++;
+  ls->frames++;
+}
+
+/* account one object from the first min(size, HEAD_SIZE) bytes of it */
+static void count_object(blfls_t *ls, const unsigned char *obj, uint32_t size)
+{
+  uint32_t type = get32(obj + 12);
+  uint64_t ns = 0;
+  int timed = size >= sizeof(VBLObjectHeader)
+    && blfObjectTime((const VBLObjectHeaderBase *)obj, &ns);
+
+  ls->objects++;
+  if(type < 256) ls->types[type]++;
+  else ls->other_types++;
+
+  if(timed) {
+    if(!ls->timed || ns < ls->t0) ls->t0 = ns;
+    if(!ls->timed || ns > ls->t1) ls->t1 = ns;
+    ls->timed = 1;
+  }
+
+  /* channel at 32, ID at 36 in all CAN message objects */
+  if(size >= HEAD_SIZE && (type == BL_OBJ_TYPE_CAN_MESSAGE
+                           || type == BL_OBJ_TYPE_CAN_MESSAGE2
+                           || type == BL_OBJ_TYPE_CAN_FD_MESSAGE
+                           || type == BL_OBJ_TYPE_CAN_FD_MESSAGE_64)) {
+    uint16_t bus = type == BL_OBJ_TYPE_CAN_FD_MESSAGE_64
+      ? obj[32] : (uint16_t)(obj[32] | obj[33] << 8);
+    count_frame(ls, bus, get32(obj + 36), ns);
+  }
+}
+
+/* header bytes needed of an object, 0 if there is no object */
+static size_t object_need(const unsigned char *obj)
+{
+  uint32_t size = get32(obj + 8);
+  if(memcmp(obj, "LOBJ", 4) != 0 || size < sizeof(VBLObjectHeaderBase))
+    return 0;
+  return size < HEAD_SIZE ? size : HEAD_SIZE;
+}
+
+/* walk the objects of the inflated data of one container */
+static void walk(blfls_t *ls, const unsigned char *d, size_t len)
+{
+  const size_t base = sizeof(VBLObjectHeaderBase);
+  size_t pos = 0;
+
+  while(pos < len && !ls->corrupt) {
+    const unsigned char *obj;
+    size_t walked;
+    uint32_t size;
+
+    if(ls->skip) {
+      size_t n = len - pos < ls->skip ? len - pos : ls->skip;
+      pos += n;
+      ls->skip -= n;
+      continue;
+    }
+
+    if(!ls->have && len - pos >= base && object_need(d + pos)
+       && len - pos >= object_need(d + pos)) {
+      /* in place */
+      obj = d + pos;
+      walked = 0;
+    } else {
+      /* gather the base, then the rest of the header */
+      size_t need = ls->have < base ? base : object_need(ls->head);
+      size_t n;
+      if(!need) {
+        ls->corrupt = 1;
+        break;
+      }
+      n = len - pos < need - ls->have ? len - pos : need - ls->have;
+      memcpy(ls->head + ls->have, d + pos, n);
+      ls->have += n;
+      pos += n;
+      if(ls->have < need || (need == base && object_need(ls->head) > base))
+        continue;
+      if(!object_need(ls->head)) {
+        ls->corrupt = 1;
+        break;
+      }
+      obj = ls->head;
+      walked = ls->have;
+      ls->have = 0;
+    }
+
+    if(!object_need(obj)) {
+      ls->corrupt = 1;
+      break;
+    }
+    size = get32(obj + 8);
+    count_object(ls, obj, size);
+    ls->skip = (uint64_t)size + size % 4 - walked; /* padding as blfBufferSkip */
+  }
+}
+
+static void inflate_container(container_t *c)
+{
+  uLongf size = c->out_cap;
+
+  if(!c->compressed) {
+    c->data = c->zip;
+    c->size = c->zip_size;
+    return;
+  }
+  c->failed = uncompress(c->out, &size, c->zip, c->zip_size) != Z_OK;
+  c->data = c->out;
+  c->size = c->failed ? 0 : size;
+}
+
+static void *inflate_worker(void *arg)
+{
+  batch_t *batch = arg;
+  int i;
+
+  while((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->n)
+    inflate_container(&batch->containers[i]);
+  return NULL;
+}
+
+/* read the next container of src into c, 0 at the end */
+static int read_container(BlfSource *src, container_t *c, blfls_t *ls)
+{
+  VBLObjectHeaderBaseLOGG log;
+  unsigned char padding[4];
+  size_t size;
+
+  if(blfSourceRead(src, &log, sizeof(log)) != sizeof(log))
+    return 0;
+  if(memcmp(&log.base.mSignature, "LOBJ", 4) != 0
+     || log.base.mObjectType != BL_OBJ_TYPE_LOG_CONTAINER
+     || log.base.mObjectSize < sizeof(log)) {
+    fprintf(stderr, "error: container %lu is not a log container\n",
+            (unsigned long)ls->containers);
+    ls->truncated = 1;
+    return 0;
+  }
+  size = log.base.mObjectSize - sizeof(log);
+  if(size > c->zip_cap) {
+    free(c->zip);
+    c->zip = malloc(size);
+    c->zip_cap = c->zip ? size : 0;
+    if(!c->zip) return 0;
+  }
+  if(blfSourceRead(src, c->zip, size) != size) {
+    fprintf(stderr, "error: container %lu is cut short\n",
+            (unsigned long)ls->containers);
+    ls->truncated = 1;
+    return 0;
+  }
+  blfSourceRead(src, padding, size % 4); /* missing after the last one */
+
+  c->zip_size = size;
+  c->compressed = log.compressedflag == 2;
+  c->failed = 0;
+  if(c->compressed && log.deflatebuffersize > c->out_cap) {
+    free(c->out);
+    c->out = malloc(log.deflatebuffersize);
+    c->out_cap = c->out ? log.deflatebuffersize : 0;
+    if(!c->out) return 0;
+  }
+
+  ls->containers++;
+  ls->compressed += size;
+  ls->uncompressed += c->compressed ? log.deflatebuffersize : size;
+  return 1;
+}
+
+/* read, inflate and walk all containers of src */
+static void read_containers(BlfSource *src, blfls_t *ls)
+{
+  int jobs = n_jobs > 0 ? n_jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int n_containers = 4 * (jobs > 0 ? jobs : 1);
+  container_t *containers = calloc(n_containers, sizeof(container_t));
+  pthread_t *threads = calloc(jobs > 0 ? jobs : 1, sizeof(pthread_t));
+  int done = 0, i;
+
+  if(!containers || !threads) {
+    fprintf(stderr, "error: out of memory\n");
+    goto exit;
+  }
+  while(!done && !ls->corrupt) {
+    batch_t batch = { containers, 0, 0 };
+    int started = 0;
+
+    while(batch.n < n_containers
+          && read_container(src, &containers[batch.n], ls))
+      batch.n++;
+    done = batch.n < n_containers;
+
+    for(i = 1; i < jobs && i < batch.n; i++) {
+      if(pthread_create(&threads[i], NULL, inflate_worker, &batch) != 0)
+        break;
+      started = i;
+    }
+    inflate_worker(&batch);
+    for(i = 1; i <= started; i++)
+      pthread_join(threads[i], NULL);
+
+    for(i = 0; i < batch.n && !ls->corrupt; i++) {
+      if(containers[i].failed) {
+        fprintf(stderr, "error: inflating a container failed\n");
+        ls->corrupt = 1;
+        break;
+      }
+      walk(ls, containers[i].data, containers[i].size);
+    }
+  }
+
+exit:
+  if(containers) {
+    for(i = 0; i < n_containers; i++) {
+      free(containers[i].out);
+      free(containers[i].zip);
+    }
+  }
+  free(containers);
+  free(threads);
+}
+
+static void print_systemtime(const char *label, const SYSTEMTIME *s)
+{
+  printf("%-20s %04u-%02u-%02u %02u:%02u:%02u.%03u\n", label,
+         s->wYear, s->wMonth, s->wDay, s->wHour, s->wMinute, s->wSecond,
+         s->wMilliseconds);
+}
+
+static void report(const char *filename, const LOGG_t *logg, blfls_t *ls)
+{
+  double span = ls->timed ? (ls->t1 - ls->t0) * 1e-9 : 0;
+  unsigned int n_ids = hashtable_count(ls->ids);
+  id_stats_t **ids = NULL;
+  unsigned int i, j;
+
+  printf("%s\n", filename);
+  printf("%-20s %u.%u.%u (application %u)\n", "written by",
+         logg->appMajor, logg->appMinor, logg->appBuild, logg->appID);
+  printf("%-20s %llu\n", "file size",
+         (unsigned long long)logg->fileSize);
+  printf("%-20s %llu\n", "uncompressed size",
+         (unsigned long long)logg->uncompressedFileSize);
+  printf("%-20s %u\n", "object count", logg->objectCount);
+  print_systemtime("start", &logg->mMeasurementStartTime);
+  print_systemtime("end", &logg->mMeasurementEndTime);
+
+  printf("%-20s %llu\n", "containers", (unsigned long long)ls->containers);
+  printf("%-20s %llu\n", "compressed bytes",
+         (unsigned long long)ls->compressed);
+  printf("%-20s %llu\n", "uncompressed bytes",
+         (unsigned long long)ls->uncompressed);
+  if(ls->compressed)
+    printf("%-20s %.2f\n", "compression ratio",
+           (double)ls->uncompressed / ls->compressed);
+  printf("%-20s %llu\n", "objects", (unsigned long long)ls->objects);
+  if(ls->timed)
+    printf("%-20s %.6f..%.6f s (%.3f s)\n", "time span",
+           ls->t0 * 1e-9, ls->t1 * 1e-9, span);
+  if(ls->corrupt)
+    printf("%-20s objects after %llu are unreadable\n", "corrupt",
+           (unsigned long long)ls->objects);
+
+  printf("\n%-6s %-20s %12s\n", "type", "name", "objects");
+  for(i = 0; i < 256; i++) {
+    if(ls->types[i])
+      printf("%-6u %-20s %12llu\n", i, type_name(i),
+             (unsigned long long)ls->types[i]);
+  }
+  if(ls->other_types)
+    printf("%-6s %-20s %12llu\n", ">255", "",
+           (unsigned long long)ls->other_types);
+
+  if(!n_ids) return;
+  ids = malloc(n_ids * sizeof(*ids));
+  if(!ids) return;
+  {
+    struct hashtable_itr *itr = hashtable_iterator(ls->ids);
+    i = 0;
+    do {
+      ids[i++] = hashtable_iterator_value(itr);
+    } while(hashtable_iterator_advance(itr));
+    free(itr);
+  }
+  qsort(ids, n_ids, sizeof(*ids), compare_ids);
+
+  /* per bus, then per ID */
+  printf("\n%-4s %12s %12s\n", "bus", "frames", "rate/s");
+  for(i = 0; i < n_ids; i = j) {
+    uint64_t frames = 0;
+    for(j = i; j < n_ids && ids[j]->bus == ids[i]->bus; j++)
+      frames += ids[j]->frames;
+    printf("%-4u %12llu %12.1f\n", ids[i]->bus,
+           (unsigned long long)frames, span > 0 ? frames / span : 0);
+  }
+  printf("\n%-4s %10s %12s %12s\n", "bus", "id", "frames", "rate/s");
+  for(i = 0; i < n_ids; i++) {
+    const id_stats_t *s = ids[i];
+    double id_span = (s->t1 - s->t0) * 1e-9;
+    printf("%-4u %10lX %12llu %12.1f\n", s->bus, (unsigned long)s->id,
+           (unsigned long long)s->frames,
+           id_span > 0 ? (s->frames - 1) / id_span : 0);
+  }
+  free(ids);
+}
+
+static int list_file(const char *filename)
+{
+  FILE *fp = strcmp(filename, "-") ? fopen(filename, "rb") : stdin;
+  BlfSource *src;
+  LOGG_t logg;
+  blfls_t *ls;
+  int ret = 1;
+
+  if(!fp) {
+    fprintf(stderr, "error: could not open %s\n", filename);
+    return 1;
+  }
+  ls = calloc(1, sizeof(blfls_t));
+  if(!ls) goto exit;
+  ls->ids = create_hashtable(64, id_hash, id_equal);
+  if(!ls->ids) goto exit;
+
+  if(fread(&logg, 1, sizeof(logg), fp) != sizeof(logg)
+     || memcmp(&logg.mSignature, "LOGG", 4) != 0) {
+    fprintf(stderr, "error: %s is not a BLF file\n", filename);
+    goto exit;
+  }
+  /* later versions may have a longer file header */
+  if(logg.mHeaderSize > sizeof(logg)) {
+    uint32_t n = logg.mHeaderSize - sizeof(logg);
+    while(n-- && fgetc(fp) != EOF);
+  }
+
+  src = blfSourceOpen(fp);
+  if(!src) goto exit;
+  read_containers(src, ls);
+  blfSourceClose(src);
+
+  if(ls->skip || ls->have)
+    fprintf(stderr, "warning: %s ends within an object\n", filename);
+  report(filename, &logg, ls);
+  ret = ls->corrupt || ls->truncated;
+
+exit:
+  if(ls) {
+    if(ls->ids) hashtable_destroy(ls->ids, 0); /* keys are the values */
+    free(ls);
+  }
+  if(fp != stdin) fclose(fp);
+  return ret;
+}
+
+static void usage_error(const char *program_name)
+{
+  fprintf(stderr, "Type '%s --help' for more information\n",program_name);
+  exit(EXIT_FAILURE);
+}
+
+static void help(const char *program_name)
+{
+  fprintf(stderr,
+          "Usage: %s [OPTIONS] <blffile> ... \n"
+          "List contents of BLF files.\n"
+          "Show the file header, containers, compression ratio, object\n"
+          "types, time span and frame counts and rates per bus and ID.\n"
+          "Only object headers are looked at. - reads stdin.\n"
+          "\n"
+          "Options:\n"
+          "  -j, --jobs <n>             containers inflated at once\n"
+          "                             (default one per CPU)\n"
+          "  -h, --help                 display this help and exit\n"
+          "\n", program_name);
+}
+
+int
+main(int argc, char **argv)
+{
+  char *program_name = argv[0];
+  int ret = 0;
+
+  /* parse arguments */
+  while (1) {
+    static struct option long_options[] = {
+      {"jobs",    required_argument, NULL,            (int)'j'},
+      {"help",    no_argument,       NULL,            (int)'h'},
+      {0, 0, 0, 0}
+    };
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+    int c;
+
+    c = getopt_long (argc, argv, "hj:",
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1) break;
+
+    switch (c) {
+    case 0:
+      break;
+    case 'j':
+      n_jobs = atoi(optarg);
+      if(n_jobs < 1) {
+        fprintf(stderr, "error: invalid number of jobs %s\n", optarg);
+        usage_error(program_name);
+      }
+      break;
+    case 'h':
+      help(program_name);
+      exit(EXIT_SUCCESS);
+      break;
+    case '?':
+      /* getopt_long already printed an error message. */
+      usage_error(program_name);
+      break;
+    default:
+      fprintf(stderr, "error: unknown option %c\n", c);
+      usage_error(program_name);
+    }
+  }
+
+  if (optind > argc - 1) {
+    fprintf(stderr, "error: missing .blf filename\n");
+    usage_error(program_name);
+  }
+  for(; optind < argc; optind++) {
+    ret |= list_file(argv[optind]);
+    if(optind < argc - 1) printf("\n");
+  }
+  return ret;
+}
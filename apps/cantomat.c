@@ -16,16 +16,33 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <glob.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 #include "busassignment.h"
 #include "measurement.h"
+#include "selection.h"
+#include "resample.h"
+#include "changes.h"
+#include "stats.h"
 
 // readers
-//#include "ascreader.h"
+#include "ascreader.h"
 //#include "clgreader.h"
 #include "blfreader.h"
+#include "blfsource.h"
+#include "candumpreader.h"
+#include "mdfreader.h"
 //#include "vsbreader.h"
 
 // writers - dispatched through central station.
@@ -35,26 +52,149 @@
 const char *program_name;
 int verbose_flag = 0;
 int debug_flag   = 0;
+int j1939_flag   = 0;
+int stream_flag  = 0;
+int stats_json   = 0;
+selection_t *selection = NULL; // NULL keeps everything
+const char *input_format = NULL; // NULL picks by the input extension
+
+// getopt values of the selection options, kind * 2 + drop above this
+#define SELECT_OPTION 0x100
+
+/* one file of a batch conversion */
+typedef struct {
+    char *in_file;
+    char *out_file;
+    int pid;
+    int status;          // exit status as from wait, -1 if not run
+    double seconds;
+} batch_job_t;
+
+typedef struct {
+    batch_job_t *jobs;
+    size_t n;
+    size_t cap;
+    int expanded;        // inputs came from a list, directory or pattern
+} batch_t;
 
 
 static void help(void)
 {
     fprintf(stderr,
             "Usage: %s [OPTION] -d dbcfile\n"
+            "       %s [OPTION] -d dbcfile -i input ... -o outdir\n"
             "cantomat " VERSION ": Convert CAN trace file to MAT file.\n"
             "\n"
             "Options:\n"
             "  -b, --bus <busid>          specify bus for next database\n"
             "  -d, --dbc <dbcfile>        assign database to previously specified bus\n"
-            "  -i, --in <infile>          input file, default to stdin. \n"
+            "  -i, --in <infile>          input file, - or default: stdin, also a pipe\n"
+            "                             BLF, Vector ASC (.asc), candump (.log) or\n"
+            "                             MDF 4 bus logging (.mf4)\n"
+            "                             .ctf frame archives are decoded again\n"
+            "                             may be repeated, may be a directory, a\n"
+            "                             quoted pattern or @list with one file per\n"
+            "                             line. Several inputs run in batch mode.\n"
             "  -o, --out <outfile>        output file, defaults to stdout. \n"
-            "  -t, --timeres <nanosec>    time resolution\n"
+            "                             In batch mode the output directory.\n"
+            "  -t, --timeres <nanosec>    truncate time stamps to multiples of nanosec,\n"
+            "                             of frames in the same step the last is kept\n"
+            "  -j, --j1939                match extended frames by J1939 PGN,\n"
+            "                             exact IDs in the DBC take precedence\n"
+            "  -z, --compress <level>     compression level 0-9, 0 disables (default 4)\n"
+            "      --codec <name>         deflate (default), lz4 or zstd\n"
+            "      --chunk <samples>      samples per compressed chunk\n"
+            "      --single               store signal values as float32\n"
+            "  -T, --threads <n>          compress on n threads (.h5 with deflate),\n"
+            "                             with --stream decode on n threads\n"
+            "      --per-message          one variable per message (.mat)\n"
+            "      --mat73                write MAT v7.3 files (.mat)\n"
+            "      --stream               decode and write in blocks of one chunk,\n"
+            "                             reading, decoding and writing overlap,\n"
+            "                             for inputs larger than memory (.h5, .cta)\n"
+            "      --keep-bus <pattern>   keep only frames of matching busses\n"
+            "      --drop-bus <pattern>   drop frames of matching busses\n"
+            "      --keep-message <pattern>\n"
+            "                             keep only matching messages, by name or ID\n"
+            "      --drop-message <pattern>\n"
+            "                             drop matching messages\n"
+            "      --keep-signal <pattern>\n"
+            "                             decode only matching signals,\n"
+            "                             Signal or Message.Signal\n"
+            "      --drop-signal <pattern>\n"
+            "                             do not decode matching signals\n"
+            "                             Patterns are globs, re:<regex> or @file\n"
+            "                             with one pattern per line.\n"
+            "      --drop-unknown         drop frames not in any DBC as they are read\n"
+            "  -r, --resample <grid>      write all signals on a common time grid,\n"
+            "                             a rate (100Hz), a period (10ms, 0.5s) or\n"
+            "                             the name of a reference message. May be\n"
+            "                             repeated, one matrix per grid.\n"
+            "      --interpolate <mode>   zoh (default) or linear\n"
+            "      --changes              write each signal on its own time vector,\n"
+            "                             only samples where it changes and the\n"
+            "                             first and last sample\n"
+            "      --deadband <value>     with --changes, ignore changes of at most\n"
+            "                             value since the last sample written\n"
+            "  -f, --format <ext>         batch output format (default h5)\n"
+            "  -P, --jobs <n>             batch files converted at once\n"
+            "                             (default one per CPU)\n"
+            "      --report <file>        write a per file batch summary, - for stdout\n"
+            "      --input-format <name>  blf, asc, candump or mdf, for stdin or other\n"
+            "                             extensions (default by extension, blf)\n"
+            "      --readahead <MB>       read BLF input in pieces of MB on a thread\n"
+            "                             of its own (default 4), 0 disables\n"
+            "      --direct               read BLF input with O_DIRECT, bypassing\n"
+            "                             the page cache\n"
+            "      --io-uring[=<n>]       read BLF input with n reads in flight on\n"
+            "                             io_uring (default 8), where built with\n"
+            "                             liburing\n"
+            "      --stats[=json]         report counters, stage timings and peak\n"
+            "                             memory per conversion, as text on stderr\n"
+            "                             or as a JSON line on stdout\n"
             "      --verbose              verbose output\n"
             "      --brief                brief output (default)\n"
             "      --debug                output debug information\n"
             "      --help                 display this help and exit\n"
             "\n",
-            program_name);
+            program_name, program_name);
+}
+
+
+/* Check if file name ends with ext. */
+static int has_extension(const char *file, const char *ext)
+{
+    size_t file_len = strlen(file);
+    size_t ext_len = strlen(ext);
+    return file_len >= ext_len && 0 == strcmp(file + file_len - ext_len, ext);
+}
+
+
+/* input parsers by --input-format name and file extensions */
+static const struct {
+    const char *name;
+    const char *exts[2];
+    parserFunction_t parse;
+} parsers[] = {
+    {"blf",     {".blf", ".BLF"}, blfReader_processFile},
+    {"asc",     {".asc", ".ASC"}, ascReader_processFile},
+    {"candump", {".log", ".LOG"}, candumpReader_processFile},
+    {"mdf",     {".mf4", ".MF4"}, mdfReader_processFile},
+};
+
+
+/* Parser of --input-format, else by extension, BLF for anything else. */
+static parserFunction_t find_parser(const char *in_file)
+{
+    for (size_t i = 0; i < sizeof(parsers) / sizeof(parsers[0]); i++) {
+        if (input_format && 0 == strcmp(input_format, parsers[i].name))
+            return parsers[i].parse;
+        if (!input_format && in_file
+            && (has_extension(in_file, parsers[i].exts[0])
+                || has_extension(in_file, parsers[i].exts[1])))
+            return parsers[i].parse;
+    }
+    return blfReader_processFile;
 }
 
 
@@ -62,39 +202,424 @@ int cantomat(char *in_file,
              busAssignment_t *busAssignment,
              char *out_file)
 {
-    // FIXME: Dispatch on input file extension.
-    parserFunction_t parserFunction = blfReader_processFile;
+    parserFunction_t parserFunction = find_parser(in_file);
+    // Frame archives hold grouped frames already, no parsing needed.
+    int from_archive = in_file && has_extension(in_file, ".ctf");
+    can_writer_t *writer = find_writer(out_file);
+
+    if (resample_opts.n_grids && writer && writer->raw) {
+        fprintf(stderr, "Raw frames cannot be resampled.\n");
+        return 1;
+    }
+    if (change_opts.enabled && writer && writer->raw) {
+        fprintf(stderr, "Raw frames have no signals to write on change.\n");
+        return 1;
+    }
+    if (change_opts.enabled && resample_opts.n_grids) {
+        fprintf(stderr, "Resampled signals cannot be written on change.\n");
+        return 1;
+    }
+
+    if (stream_flag) {
+        if (!writer) {
+            fprintf(stderr, "Cannot guess output format, nothing written.\n");
+            return 1;
+        }
+        if (from_archive) {
+            fprintf(stderr, "Frame archives cannot be streamed.\n");
+            return 1;
+        }
+        return stream_messages(in_file, parserFunction, busAssignment,
+                               selection,
+                               writer, out_file) != 0;
+    }
 
     // READ
-    struct hashtable *can_hashmap = read_messages(in_file,
-                                                  parserFunction);
+    struct hashtable *can_hashmap = from_archive
+        ? read_frame_archive(in_file, busAssignment, selection)
+        : read_messages(in_file, parserFunction, busAssignment, selection);
     if (!can_hashmap) {
-        fprintf(stderr, "Reading msgs from input file failed.\n");
+        fprintf(stderr, "Reading msgs from %s failed.\n",
+                in_file ? in_file : "standard input");
         return 1;
     }
 
-    // DECODE
-    int signal_count = can_decode(can_hashmap, busAssignment);
-    if (signal_count < 0) {
-        fprintf(stderr, "Reading signals from msgs failed.\n");
-        return 1;
+    // DECODE, raw writers take the frames as they are
+    if (!writer || !writer->raw) {
+        int signal_count = can_decode(can_hashmap, busAssignment, selection);
+        if (signal_count < 0) {
+            fprintf(stderr, "Reading signals from msgs failed.\n");
+            destroy_messages(can_hashmap);
+            return 1;
+        }
+        if (verbose_flag)
+            fprintf(stderr, "Decoded %d timeseries\n", signal_count);
     }
-    if (verbose_flag)
-        fprintf(stderr, "Decoded %d timeseries\n", signal_count);
 
-    // WRITE
-    // FIXME: Dispatch on out_file ext
-    writer_f writer = guess_writer(out_file);
-    if (writer)
-        writer(can_hashmap, out_file);
-    else
+    // WRITE, or RESAMPLE and write the grids only,
+    // or write the signals on change only
+    int failed = 0;
+    STATS_START(t);
+    if (writer && resample_opts.n_grids) {
+        failed = resample_write(can_hashmap, writer, out_file) != 0;
+    } else if (writer && change_opts.enabled) {
+        struct hashtable *changes = split_changes(can_hashmap);
+        if (changes) {
+            failed = writer->write_fcn(changes, out_file) != 0;
+        } else {
+            fprintf(stderr, "Reducing signals to their changes failed.\n");
+            failed = 1;
+        }
+        destroy_messages(changes);
+    } else if (writer) {
+        failed = writer->write_fcn(can_hashmap, out_file) != 0;
+    } else {
         fprintf(stderr, "Cannot guess output format, nothing written.\n");
+        failed = 1;
+    }
+    STATS_STOP(stat_write, t);
+    if (failed && writer)
+        fprintf(stderr, "Writing %s failed.\n", out_file);
 
+    account_frames(can_hashmap, in_file);
     destroy_messages(can_hashmap);
+    return failed;
+}
+
+
+/* Check if file has the extension of a supported input format. */
+static int is_input_file(const char *file)
+{
+    const char *exts[] = {".blf", ".asc", ".log", ".mf4", ".ctf"};
+    size_t file_len = strlen(file);
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        size_t ext_len = strlen(exts[i]);
+        if (file_len > ext_len
+            && 0 == strcasecmp(file + file_len - ext_len, exts[i]))
+            return 1;
+    }
     return 0;
 }
 
 
+static int add_job(batch_t *batch, const char *in_file)
+{
+    if (batch->n == batch->cap) {
+        batch->cap = batch->cap ? 2 * batch->cap : 16;
+        batch->jobs = realloc(batch->jobs, batch->cap * sizeof(batch_job_t));
+        if (!batch->jobs)
+            return 1;
+    }
+    batch_job_t *job = &batch->jobs[batch->n++];
+    job->in_file = strdup(in_file);
+    job->out_file = NULL;
+    job->pid = 0;
+    job->status = -1;
+    job->seconds = 0;
+    return job->in_file == NULL;
+}
+
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+
+/* Add the input files of a directory, in name order. */
+static int add_directory(batch_t *batch, const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "error: cannot read directory %s\n", path);
+        return 1;
+    }
+
+    char **names = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!is_input_file(entry->d_name))
+            continue;
+        if (n == cap) {
+            cap = cap ? 2 * cap : 16;
+            names = realloc(names, cap * sizeof(char *));
+        }
+        size_t len = strlen(path) + strlen(entry->d_name) + 2;
+        names[n] = malloc(len);
+        snprintf(names[n++], len, "%s/%s", path, entry->d_name);
+    }
+    closedir(dir);
+
+    int err = 0;
+    qsort(names, n, sizeof(char *), compare_names);
+    for (size_t i = 0; i < n; i++) {
+        err |= add_job(batch, names[i]);
+        free(names[i]);
+    }
+    free(names);
+    return err;
+}
+
+
+/* Add the files named in list, one per line. */
+static int add_list(batch_t *batch, const char *list)
+{
+    FILE *fp = fopen(list, "r");
+    if (!fp) {
+        fprintf(stderr, "error: cannot open file list %s\n", list);
+        return 1;
+    }
+
+    char line[4096];
+    int err = 0;
+    while (!err && fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0' && line[0] != '#')
+            err = add_job(batch, line);
+    }
+    fclose(fp);
+    return err;
+}
+
+
+/*
+ * Add the inputs of one -i argument: @list, a directory,
+ * a pattern or a plain file.
+ */
+static int add_inputs(batch_t *batch, const char *arg)
+{
+    struct stat st;
+
+    if (arg[0] == '@') {
+        batch->expanded = 1;
+        return add_list(batch, arg + 1);
+    }
+    if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode)) {
+        batch->expanded = 1;
+        return add_directory(batch, arg);
+    }
+#ifndef _WIN32
+    if (strpbrk(arg, "*?[")) {
+        glob_t g;
+        int err = 0;
+        batch->expanded = 1;
+        if (glob(arg, 0, NULL, &g) != 0) {
+            fprintf(stderr, "error: no files match %s\n", arg);
+            return 1;
+        }
+        for (size_t i = 0; i < g.gl_pathc && !err; i++)
+            err = add_job(batch, g.gl_pathv[i]);
+        globfree(&g);
+        return err;
+    }
+#endif
+    return add_job(batch, arg);
+}
+
+
+/* Name the output of every job out_dir/<input stem>.<ext>. */
+static int plan_outputs(batch_t *batch, const char *out_dir, const char *ext)
+{
+    for (size_t i = 0; i < batch->n; i++) {
+        batch_job_t *job = &batch->jobs[i];
+        const char *base = strrchr(job->in_file, '/');
+        base = base ? base + 1 : job->in_file;
+        const char *dot = strrchr(base, '.');
+        int stem = dot && dot != base ? (int) (dot - base) : (int) strlen(base);
+
+        size_t len = strlen(out_dir) + stem + strlen(ext) + 3;
+        job->out_file = malloc(len);
+        if (!job->out_file)
+            return 1;
+        snprintf(job->out_file, len, "%s/%.*s.%s", out_dir, stem, base, ext);
+
+        for (size_t j = 0; j < i; j++) {
+            if (0 == strcmp(job->out_file, batch->jobs[j].out_file)) {
+                fprintf(stderr, "error: %s and %s both write to %s\n",
+                        batch->jobs[j].in_file, job->in_file, job->out_file);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* Convert one input, and report its statistics with --stats. */
+static int convert(char *in_file, busAssignment_t *busAssignment,
+                   char *out_file)
+{
+    double start = now();
+    int ret = cantomat(in_file, busAssignment, out_file);
+    if (stats.enabled)
+        stats_report(stats_json ? stdout : stderr, stats_json,
+                     in_file, now() - start);
+    return ret;
+}
+
+
+/* Bytes of file, summed over the files of a directory output. */
+static long long file_size(const char *file)
+{
+    struct stat st;
+    if (stat(file, &st) != 0)
+        return -1;
+    if (!S_ISDIR(st.st_mode))
+        return S_ISREG(st.st_mode) ? st.st_size : -1;
+
+    // Arrow and Parquet outputs have one file per message.
+    DIR *dir = opendir(file);
+    if (!dir)
+        return -1;
+    long long size = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, ".."))
+            continue;
+        size_t len = strlen(file) + strlen(entry->d_name) + 2;
+        char *path = malloc(len);
+        if (!path)
+            break;
+        snprintf(path, len, "%s/%s", file, entry->d_name);
+        long long entry_size = file_size(path);
+        free(path);
+        if (entry_size > 0)
+            size += entry_size;
+    }
+    closedir(dir);
+    return size;
+}
+
+
+static int job_failed(const batch_job_t *job)
+{
+#ifndef _WIN32
+    return !WIFEXITED(job->status) || WEXITSTATUS(job->status) != 0;
+#else
+    return job->status != 0;
+#endif
+}
+
+
+/*
+ * Convert all files of the batch, jobs at a time.
+ *
+ * Every file is converted in a child process forked once the DBCs are
+ * parsed, so the children share them and the writer libraries, which
+ * are not thread safe, each get a process of their own.
+ */
+static void run_batch(batch_t *batch, busAssignment_t *busAssignment, int jobs)
+{
+#ifndef _WIN32
+    size_t next = 0, running = 0;
+    while (next < batch->n || running > 0) {
+        if (next < batch->n && running < (size_t) jobs) {
+            batch_job_t *job = &batch->jobs[next++];
+            if (verbose_flag)
+                fprintf(stderr, "Converting %s to %s\n",
+                        job->in_file, job->out_file);
+            fflush(stdout);
+            fflush(stderr);
+
+            job->seconds = now();
+            job->pid = fork();
+            if (job->pid == 0)
+                exit(convert(job->in_file, busAssignment, job->out_file));
+            if (job->pid < 0) {
+                fprintf(stderr, "error: cannot start conversion of %s\n",
+                        job->in_file);
+                job->status = 1 << 8;
+                job->seconds = 0;
+            } else {
+                running++;
+            }
+            continue;
+        }
+
+        int status;
+        int pid = wait(&status);
+        if (pid < 0)
+            break;
+        for (size_t i = 0; i < batch->n; i++) {
+            batch_job_t *job = &batch->jobs[i];
+            if (job->pid == pid) {
+                job->status = status;
+                job->seconds = now() - job->seconds;
+                running--;
+            }
+        }
+    }
+#else
+    (void) jobs;
+    for (size_t i = 0; i < batch->n; i++) {
+        batch_job_t *job = &batch->jobs[i];
+        job->seconds = now();
+        job->status = cantomat(job->in_file, busAssignment, job->out_file);
+        job->seconds = now() - job->seconds;
+    }
+#endif
+}
+
+
+/* Per file summary as tab separated columns, totals on stderr. */
+static int report_batch(const batch_t *batch, const char *report_file,
+                        double seconds)
+{
+    FILE *fp = NULL;
+    if (report_file) {
+        fp = strcmp(report_file, "-") ? fopen(report_file, "w") : stdout;
+        if (!fp)
+            fprintf(stderr, "error: cannot write report %s\n", report_file);
+    }
+    if (fp)
+        fprintf(fp, "input\toutput\tstatus\tseconds\tin_bytes\tout_bytes\n");
+
+    size_t failed = 0;
+    long long in_bytes = 0;
+    for (size_t i = 0; i < batch->n; i++) {
+        const batch_job_t *job = &batch->jobs[i];
+        long long in_size = file_size(job->in_file);
+        char status[32];
+
+#ifndef _WIN32
+        if (WIFSIGNALED(job->status))
+            snprintf(status, sizeof(status), "signal %d", WTERMSIG(job->status));
+        else
+#endif
+        if (job_failed(job))
+            snprintf(status, sizeof(status), "failed");
+        else
+            snprintf(status, sizeof(status), "ok");
+
+        failed += job_failed(job);
+        if (in_size > 0)
+            in_bytes += in_size;
+        if (fp)
+            fprintf(fp, "%s\t%s\t%s\t%.3f\t%lld\t%lld\n",
+                    job->in_file, job->out_file, status, job->seconds,
+                    in_size, file_size(job->out_file));
+        if (job_failed(job))
+            fprintf(stderr, "%s: %s\n", job->in_file, status);
+    }
+    if (fp && fp != stdout)
+        fclose(fp);
+
+    fprintf(stderr, "Converted %zu of %zu files in %.2f s, %.1f MB/s\n",
+            batch->n - failed, batch->n, seconds,
+            seconds > 0 ? in_bytes / seconds / 1e6 : 0.0);
+    return failed > 0;
+}
+
+
 int main(int argc, char **argv)
 {
     program_name = argv[0];
@@ -103,9 +628,12 @@ int main(int argc, char **argv)
     // Program arguments
     char *in_file = NULL;
     char *out_file = NULL;
+    char *format = "h5";
+    char *report_file = NULL;
+    batch_t batch = {NULL, 0, 0, 0};
+    int jobs = 0;
     busAssignment_t *busAssignment = busAssignment_create();
     int bus = -1;
-    sint32 timeResolution = 0;
 
     /* parse arguments */
     while (1) {
@@ -114,6 +642,7 @@ int main(int argc, char **argv)
             {"verbose", no_argument,       &verbose_flag, 1},
             {"brief",   no_argument,       &verbose_flag, 0},
             {"debug",   no_argument,       &debug_flag,   1},
+            {"j1939",   no_argument,       &j1939_flag,   1},
             /* These options don't set a flag.
                We distinguish them by their indices. */
             {"in",      required_argument, NULL, 'i'},
@@ -121,12 +650,39 @@ int main(int argc, char **argv)
             {"bus",     required_argument, NULL, 'b'},
             {"dbc",     required_argument, NULL, 'd'},
             {"timeres", required_argument, NULL, 't'},
+            {"compress", required_argument, NULL, 'z'},
+            {"codec",   required_argument, NULL, 'C'},
+            {"chunk",   required_argument, NULL, 'c'},
+            {"single",  no_argument,       &writer_opts.single, 1},
+            {"stream",  no_argument,       &stream_flag,  1},
+            {"threads", required_argument, NULL, 'T'},
+            {"per-message", no_argument,   &writer_opts.per_message, 1},
+            {"mat73",   no_argument,       &writer_opts.mat73, 1},
+            {"format",  required_argument, NULL, 'f'},
+            {"jobs",    required_argument, NULL, 'P'},
+            {"report",  required_argument, NULL, 'R'},
+            {"resample", required_argument, NULL, 'r'},
+            {"interpolate", required_argument, NULL, 'I'},
+            {"changes", no_argument,       &change_opts.enabled, 1},
+            {"deadband", required_argument, NULL, 'D'},
+            {"stats",   optional_argument, NULL, 'S'},
+            {"drop-unknown", no_argument,  &drop_unknown, 1},
+            {"input-format", required_argument, NULL, 'F'},
+            {"readahead", required_argument, NULL, 'A'},
+            {"direct",  no_argument,       &blfSourceOpts.direct, 1},
+            {"io-uring", optional_argument, NULL, 'U'},
+            {"keep-bus",     required_argument, NULL, SELECT_OPTION + 2 * select_bus},
+            {"drop-bus",     required_argument, NULL, SELECT_OPTION + 2 * select_bus + 1},
+            {"keep-message", required_argument, NULL, SELECT_OPTION + 2 * select_message},
+            {"drop-message", required_argument, NULL, SELECT_OPTION + 2 * select_message + 1},
+            {"keep-signal",  required_argument, NULL, SELECT_OPTION + 2 * select_signal},
+            {"drop-signal",  required_argument, NULL, SELECT_OPTION + 2 * select_signal + 1},
             {"help",    no_argument,       NULL, 'h'},
             {0, 0, 0, 0}
         };
 
         // Also short options, with req. arguments. as above
-        char short_options[] = "i:o:b:d:t:h";
+        char short_options[] = "i:o:b:d:t:jz:T:f:P:r:h";
 
         /* getopt_long stores the option index here. */
         int option_index = 0;
@@ -141,11 +697,8 @@ int main(int argc, char **argv)
             break;
 
         case 'i':
-            if (in_file) {
-                fprintf(stderr, "Multiple input files not supported!\n");
-                exit(1);
-            }
-            in_file = optarg;
+            if (add_inputs(&batch, optarg))
+                goto exit;
             break;
 
         case 'o':
@@ -175,7 +728,158 @@ int main(int argc, char **argv)
             break;
 
         case 't':
-            timeResolution = atoi(optarg);
+            time_resolution = atoll(optarg);
+            if (time_resolution < 0) {
+                fprintf(stderr, "error: time resolution must not be negative\n");
+                goto exit;
+            }
+            break;
+
+        case 'j':
+            j1939_flag = 1;
+            break;
+
+        case 'z': {
+            char *end;
+            unsigned long level = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || optarg[0] == '-'
+                || level > 9) {
+                fprintf(stderr, "error: invalid compression level %s\n", optarg);
+                goto exit;
+            }
+            writer_opts.level = (int) level;
+            break;
+        }
+
+        case 'C':
+            if (writer_codec_from_name(optarg) < 0) {
+                fprintf(stderr, "error: unknown codec %s\n", optarg);
+                goto exit;
+            }
+            writer_opts.codec = writer_codec_from_name(optarg);
+            break;
+
+        case 'T':
+            writer_opts.threads = atoi(optarg);
+            break;
+
+        case 'f':
+            format = optarg;
+            break;
+
+        case 'P':
+            jobs = atoi(optarg);
+            break;
+
+        case 'R':
+            report_file = optarg;
+            break;
+
+        case 'r':
+            if (resample_opts.n_grids == RESAMPLE_MAX_GRIDS) {
+                fprintf(stderr, "error: at most %d resampling grids\n",
+                        RESAMPLE_MAX_GRIDS);
+                goto exit;
+            }
+            if (resample_parse_grid(optarg,
+                                    &resample_opts.grids[resample_opts.n_grids]))
+                goto exit;
+            resample_opts.n_grids++;
+            break;
+
+        case 'I':
+            if (0 == strcmp(optarg, "zoh")) {
+                resample_opts.mode = resample_mode_zoh;
+            } else if (0 == strcmp(optarg, "linear")) {
+                resample_opts.mode = resample_mode_linear;
+            } else {
+                fprintf(stderr, "error: unknown interpolation %s\n", optarg);
+                goto exit;
+            }
+            break;
+
+        case 'F':
+            input_format = NULL;
+            for (size_t i = 0; i < sizeof(parsers) / sizeof(parsers[0]); i++) {
+                if (0 == strcmp(optarg, parsers[i].name))
+                    input_format = parsers[i].name;
+            }
+            if (!input_format) {
+                fprintf(stderr, "Unknown input format %s.\n", optarg);
+                goto exit;
+            }
+            break;
+
+        case 'A': {
+            char *end;
+            double mb = strtod(optarg, &end);
+            if (*end != '\0' || !(mb >= 0)) {
+                fprintf(stderr, "error: invalid read ahead %s\n", optarg);
+                goto exit;
+            }
+            blfSourceOpts.readAhead = (size_t) (mb * (1 << 20));
+            break;
+        }
+
+        case 'U':
+            blfSourceOpts.uring = 1;
+            blfSourceOpts.uringDepth = optarg ? atoi(optarg) : 8;
+            if (blfSourceOpts.uringDepth < 1) {
+                fprintf(stderr, "error: invalid number of reads %s\n", optarg);
+                goto exit;
+            }
+            if (!blfSourceHasUring())
+                fprintf(stderr, "warning: built without liburing, "
+                        "reading on a thread instead\n");
+            break;
+
+        case 'S':
+#ifdef CANTOOLS_NO_STATS
+            fprintf(stderr, "error: built without --stats\n");
+            goto exit;
+#endif
+            if (optarg && 0 == strcmp(optarg, "json")) {
+                stats_json = 1;
+            } else if (optarg && 0 != strcmp(optarg, "text")) {
+                fprintf(stderr, "error: unknown stats format %s\n", optarg);
+                goto exit;
+            }
+            stats.enabled = 1;
+            break;
+
+        case 'D': {
+            char *end;
+            change_opts.deadband = strtod(optarg, &end);
+            if (*end != '\0' || !(change_opts.deadband >= 0)) {
+                fprintf(stderr, "error: invalid deadband %s\n", optarg);
+                goto exit;
+            }
+            change_opts.enabled = 1;
+            break;
+        }
+
+        case 'c': {
+            char *end;
+            writer_opts.chunk = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || optarg[0] == '-'
+                || writer_opts.chunk == 0) {
+                fprintf(stderr, "error: invalid chunk size %s\n", optarg);
+                goto exit;
+            }
+            break;
+        }
+
+        case SELECT_OPTION + 2 * select_bus:
+        case SELECT_OPTION + 2 * select_bus + 1:
+        case SELECT_OPTION + 2 * select_message:
+        case SELECT_OPTION + 2 * select_message + 1:
+        case SELECT_OPTION + 2 * select_signal:
+        case SELECT_OPTION + 2 * select_signal + 1:
+            if (!selection)
+                selection = selection_create();
+            if (selection_add(selection, (c - SELECT_OPTION) / 2,
+                              (c - SELECT_OPTION) % 2, optarg))
+                goto exit;
             break;
 
         case 'h':
@@ -198,11 +902,51 @@ int main(int argc, char **argv)
         goto exit;
     }
 
+    /* several inputs are converted one output each into a directory */
+    if (batch.n > 1 || batch.expanded) {
+        char probe[64];
+        snprintf(probe, sizeof(probe), "x.%s", format);
+        if (!find_writer(probe)) {
+            fprintf(stderr, "error: unknown output format %s\n", format);
+            goto exit;
+        }
+#ifdef _WIN32
+        int err = mkdir(out_file);
+#else
+        int err = mkdir(out_file, 0777);
+#endif
+        if (err && errno != EEXIST) {
+            fprintf(stderr, "error: could not create directory %s\n", out_file);
+            goto exit;
+        }
+        if (plan_outputs(&batch, out_file, format))
+            goto exit;
+    } else if (batch.n == 1) {
+        in_file = batch.jobs[0].in_file;
+        if (0 == strcmp(in_file, "-"))
+            in_file = NULL; // stdin
+    }
+
     /* parse DBC files */
+    busAssignment_setJ1939(busAssignment, j1939_flag);
     if (busAssignment_parseDBC(busAssignment)) {
         goto exit;
     }
 
+    if (batch.n > 1 || batch.expanded) {
+        if (jobs <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+            jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+            if (jobs <= 0)
+                jobs = 1;
+        }
+        double start = now();
+        run_batch(&batch, busAssignment, jobs);
+        ret = report_batch(&batch, report_file, now() - start);
+        goto exit;
+    }
+
     // The actual decision is down in measurement.c...
     if (verbose_flag) {
         if (in_file != NULL) {
@@ -211,10 +955,14 @@ int main(int argc, char **argv)
         }
     }
 
-    ret = cantomat(in_file,
-                   busAssignment,
-                   out_file);
+    ret = convert(in_file, busAssignment, out_file);
 exit:
+    for (size_t i = 0; i < batch.n; i++) {
+        free(batch.jobs[i].in_file);
+        free(batch.jobs[i].out_file);
+    }
+    free(batch.jobs);
+    selection_free(selection);
     busAssignment_free(busAssignment);
     return ret;
 }
@@ -0,0 +1,216 @@
+/*  ctadump -- dump contents of .cta archives
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "ctareader.h"
+
+static int verbose_level = 0;
+
+static void
+list_archive(const cta_t *cta)
+{
+  uint32_t i, c, b;
+
+  for(i = 0; i < cta->n_series; i++) {
+    const cta_series_t *s = &cta->series[i];
+    const cta_column_t *time = &cta->columns[s->first_column];
+    double t0 = NAN, t1 = NAN;
+
+    if(time->n_blocks > 0) {
+      t0 = cta->blocks[time->first_block].t0;
+      t1 = cta->blocks[time->first_block + time->n_blocks - 1].t1;
+    }
+    /* frame archives have no names */
+    printf("%s (bus %u, id 0x%X, dbc %s): %lu rows, %u blocks, %.6f..%.6f s\n",
+           s->name ? cta_string(cta, s->name) : "-", s->bus, s->id,
+           s->dbc ? cta_string(cta, s->dbc) : "-",
+           (unsigned long)s->n_rows, time->n_blocks, t0, t1);
+
+    /* signal ranges from the block statistics, nothing is decoded */
+    for(c = s->first_column + 1; c < s->first_column + s->n_columns; c++) {
+      const cta_column_t *col = &cta->columns[c];
+      double min = NAN, max = NAN;
+      unsigned long bytes = 0;
+
+      for(b = col->first_block; b < col->first_block + col->n_blocks; b++) {
+        const cta_block_t *block = &cta->blocks[b];
+        if(!(block->min >= min)) min = block->min;
+        if(!(block->max <= max)) max = block->max;
+        bytes += block->size;
+      }
+      if(col->type == CTA_FRAME) {
+        printf("  %-24s dlc %u, %lu bytes\n",
+               cta_string(cta, col->name), col->width, bytes);
+        continue;
+      }
+      printf("  %-24s [%s] %g..%g, %lu bytes\n",
+             cta_string(cta, col->name), cta_string(cta, col->unit),
+             min, max, bytes);
+    }
+  }
+}
+
+static int
+dump_signal(const cta_t *cta, const char *name, double t0, double t1)
+{
+  char *message = NULL;
+  const char *signal = name;
+  const char *dot = strchr(name, '.');
+  double *time, *values;
+  size_t blocks_read;
+  long n, i;
+  int column;
+
+  /* Message.Signal or just Signal */
+  if(dot != NULL) {
+    message = strdup(name);
+    message[dot - name] = '\0';
+    signal = dot + 1;
+  }
+  column = cta_find_column(cta, message, signal);
+  free(message);
+  if(column < 0) {
+    fprintf(stderr, "error: signal %s not found\n", name);
+    return 1;
+  }
+
+  n = cta_read_range(cta, column, t0, t1, &time, &values, &blocks_read);
+  if(n < 0) {
+    fprintf(stderr, "error: could not read %s\n", name);
+    return 1;
+  }
+  if(verbose_level >= 1) {
+    fprintf(stderr, "%s: %ld rows from %lu of %u blocks\n", name, n,
+            (unsigned long)blocks_read, cta->columns[column].n_blocks);
+  }
+
+  printf("# %s.%s [%s]\n",
+         cta_string(cta, cta->series[cta->columns[column].series].name),
+         signal, cta_string(cta, cta->columns[column].unit));
+  for(i = 0; i < n; i++) {
+    printf("%.9f\t%.17g\n", time[i], values[i]);
+  }
+  free(time);
+  free(values);
+  return 0;
+}
+
+static void usage_error(const char *program_name)
+{
+  fprintf(stderr, "Type '%s --help' for more information\n",program_name);
+  exit(EXIT_FAILURE);
+}
+
+static void help(const char *program_name)
+{
+  fprintf(stderr,
+          "Usage: %s [OPTIONS] <ctafile> [signal1] ... \n"
+          "Dump contents of .cta archive.\n"
+          "List messages and signals, or dump the given signals as\n"
+          "time and value columns. Signals are named Message.Signal,\n"
+          "or just Signal for the first message that has it.\n"
+          "\n"
+          "Options:\n"
+          "  -v, --verbose              verbose output\n"
+          "  -f, --from <t0>            dump from time t0 in seconds\n"
+          "  -t, --to <t1>              dump up to time t1 in seconds\n"
+          "  -h, --help                 display this help and exit\n"
+          "\n", program_name);
+}
+
+int
+main(int argc, char **argv)
+{
+  char *cta_filename = NULL;
+  char *program_name = argv[0];
+  double t0 = -HUGE_VAL, t1 = HUGE_VAL;
+  cta_t *cta;
+  int ret = 0;
+
+  /* parse arguments */
+  while (1) {
+    static struct option long_options[] = {
+      {"verbose", no_argument,       &verbose_level,  1},
+      {"from",    required_argument, NULL,            (int)'f'},
+      {"to",      required_argument, NULL,            (int)'t'},
+      {"help",    no_argument,       NULL,            (int)'h'},
+      {0, 0, 0, 0}
+    };
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+    int c;
+
+    c = getopt_long (argc, argv, "hvf:t:",
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1) break;
+
+    switch (c) {
+    case 0:
+      break;
+    case 'f':
+      t0 = atof(optarg);
+      break;
+    case 't':
+      t1 = atof(optarg);
+      break;
+    case 'v':
+      verbose_level = 1;
+      break;
+    case 'h':
+      help(program_name);
+      exit(EXIT_SUCCESS);
+      break;
+    case '?':
+      /* getopt_long already printed an error message. */
+      usage_error(program_name);
+      break;
+    default:
+      fprintf(stderr, "error: unknown option %c\n", c);
+      usage_error(program_name);
+    }
+  }
+
+  /* cta file name */
+  if (optind <= argc - 1) {
+    cta_filename = argv[optind++];
+  } else {
+    fprintf(stderr, "error: missing .cta filename\n");
+    usage_error(program_name);
+    return 1;
+  }
+
+  cta = cta_open(cta_filename);
+  if(NULL == cta) {
+    return 1;
+  }
+
+  if(optind == argc) {
+    list_archive(cta);
+  } else {
+    for(; optind < argc; optind++) {
+      ret |= dump_signal(cta, argv[optind], t0, t1);
+    }
+  }
+
+  cta_close(cta);
+  return ret;
+}
@@ -14,28 +14,32 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
-#include "cantools_config.h"
-
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <errno.h>
-#include <assert.h>
-#include <matio.h>
 #include <getopt.h>
 #include <ctype.h>
-#include <matio.h>
-
-#include "mdfcg.h"
-#include "mdffilter.h"
+#include <time.h>
+
+#include "hashtable.h"
+#include "hashtable_itr.h"
+#include "dbcmodel.h"
+#include "measurement.h"
+#include "selection.h"
+#include "writer.h"
 #include "mdffile.h"
-#include "mdfdg.h"
+
+/* getopt values of the selection options, kind * 2 + drop above this */
+#define SELECT_OPTION 0x100
+
+int verbose_flag = 0;
 
 /*
  * A valid variable name is a character string of letters, digits, and
  * underscores [...] and beginning with a letter.
  */
-char *
+static char *
 sanitize_name(const char *in)
 {
   char *out;
@@ -46,7 +50,7 @@ sanitize_name(const char *in)
 
   /* initialize transformation table */
   if(!init) {
-    int i;
+    size_t i;
     for(i=0;i<sizeof(xtable);i++) {
       if(isupper(i) || islower(i) || isdigit(i) || (i=='_')) {
         xtable[i] = i;
@@ -58,13 +62,15 @@ sanitize_name(const char *in)
   }
 
   /* perform transformation */
-  out = malloc(n+1);
+  out = malloc(n+2);
   for(j=0;j<n;j++) {
-    out[j] = xtable[in[j]];
+    out[j] = xtable[(unsigned char)in[j]];
   }
 
   /* ensure name begins with letter */
-  if(!(isupper(out[0]) || islower(out[0]))) {
+  if(n == 0) {
+    out[j++] = 'X';
+  } else if(!(isupper(out[0]) || islower(out[0]))) {
     out[0] = 'X';
   }
 
@@ -74,80 +80,19 @@ sanitize_name(const char *in)
   return out;
 }
 
-static void
-mat_write_signal(const mdf_t *const mdf,
-                 const uint32_t can_channel,
-                 const uint32_t number_of_records,
-                 const uint16_t channel_type,
-                 const char *const message_name,
-                 const char *const signal_name,
-                 const double *const timeValue,
-                 const filter_t *const filter,
-                 const void *const cbData)
+/* simple string hash function for signal names */
+static unsigned int string_hash(void *k)
 {
-  char *filter_signal_name_in;
-  char *filter_message_name_in;
-  char *filter_name_out;
-  size_t dims[2];
-  mdftomat_t *const mdftomat = (mdftomat_t *)cbData;
-
-  dims[0] = number_of_records;
-  dims[1] = 2;
-
-  if(   ((can_channel != 0) && (channel_type == 0)) /* Vector CAN */
-     || ((can_channel == 0) && (channel_type == 0)) /* DIM */ ) {
-    if(mdf->verbose_level >= 2) {
-       uint32_t ir;
-       printf("ch=%lu n=%lu m=%s s=%s\n",
-              (unsigned long)can_channel,
-              (unsigned long)number_of_records,
-              message_name,
-              signal_name);
-      if(mdf->verbose_level >= 3) {
-       for(ir=0;ir<number_of_records;ir++) {
-          printf("%g %g\n",timeValue[ir],timeValue[ir+number_of_records]);
-       }
-      }
-    }
-    /* sanitize variable name */
-    filter_signal_name_in = sanitize_name(signal_name);
-    filter_message_name_in = sanitize_name(message_name);
-    filter_name_out = filter_apply(filter, can_channel,
-                                   filter_message_name_in,
-                                   filter_signal_name_in);
-    if(mdf->verbose_level >= 2) {
-      printf("    CNBLOCK can_ch       = %lu\n"
-             "            message      = %s\n"
-             "            signal_name  = %s\n"
-             "            filter_input = %s\n"
-             "            filter_output= %s\n",
-             (unsigned long)can_channel, filter_message_name_in,
-             signal_name, filter_signal_name_in,
-             (filter_name_out!=NULL)?filter_name_out:"<rejected by filter>" );
-      if(filter_name_out != NULL) {
-        printf("+ %d %s %s %s\n",
-               can_channel,
-               filter_message_name_in,
-               filter_signal_name_in,
-               filter_name_out );
-      }
-    }
-    free(filter_signal_name_in);
-    free(filter_message_name_in);
-
-    if(filter_name_out != NULL) {
-      matvar_t *matvar;
-      int rv;
-
-      /* write matlab variable */
-      matvar = Mat_VarCreate(filter_name_out, MAT_C_DOUBLE, MAT_T_DOUBLE,
-                             2, dims, (double *)timeValue, 0);
-      rv = Mat_VarWrite(mdftomat->mat, matvar, mdftomat->compress);
-      assert(rv == 0);
-      Mat_VarFree(matvar);
-      free(filter_name_out);
-    }
-  }
+  unsigned int hash = 0;
+  int c;
+  while((c = *(unsigned char *)k++))
+    hash = c + (hash << 6) + (hash << 16) - hash;
+  return hash;
+}
+
+static int string_equal(void *key1, void *key2)
+{
+  return strcmp((char *)key1, (char *)key2) == 0;
 }
 
 static void usage_error(const char *program_name)
@@ -159,131 +104,179 @@ static void usage_error(const char *program_name)
 static void help(const char *program_name)
 {
   fprintf(stderr,
-          "Usage: %s [OPTIONS] <mdffile> <matfile>\n"
-          "mdftomat " VERSION ": Convert MDF file to MAT file.\n"
+          "Usage: %s [OPTIONS] <mdffile> <outfile>\n"
+          "mdftomat " VERSION ": Convert MDF 4 file to MAT file.\n"
+          "\n"
+          "Every channel group is written as a message of its numeric\n"
+          "channels over its master channel. The output format is chosen\n"
+          "by extension, as with cantomat: .mat, .h5, .cta, .arrow, ...\n"
+          "CAN bus logging files are decoded with cantomat -d <dbc> -i x.mf4.\n"
           "\n"
           "Options:\n"
-          "  -f, --filter <filterfile>  filter signals\n"
+          "  -z, --compress <level>     compression level 0-9, 0 disables (default 4)\n"
+          "      --single               store signal values as float32\n"
+          "      --mat73                write MAT v7.3 files (.mat)\n"
+          "      --keep-message <pattern>\n"
+          "                             keep only matching channel groups, by\n"
+          "                             acquisition name or CG<n>\n"
+          "      --drop-message <pattern>\n"
+          "                             drop matching channel groups\n"
+          "      --keep-signal <pattern>\n"
+          "                             keep only matching channels,\n"
+          "                             Channel or Group.Channel\n"
+          "      --drop-signal <pattern>\n"
+          "                             drop matching channels\n"
+          "                             Patterns are globs, re:<regex> or @file\n"
+          "                             with one pattern per line.\n"
           "      --verbose              verbose output\n"
           "      --brief                brief output (default)\n"
-          "      --debug                output debug information\n"
-          "  -z, --compress             compression MAT file\n"
-          "      --v5                   output version 5 MAT file\n"
-          "      --v73                  output version 7.3 MAT file\n"
           "  -h, --help                 display this help and exit\n"
           "\n", program_name);
-  fprintf(stderr,
-          "Filter file format:\n"
-          "  // comment\n"
-          "  // any number of:\n"
-          "  <op> <channel> <message> <signal> [newName]\n"
-          "\n"
-          "  op = +   include signal\n"
-          "       -   exclude signal\n"
-          "  channel  numerical channel number or *\n"
-          "  message  message name, wildcards allowed\n"
-          "  signal   signal name, wildcards allowed\n"
-          "  newname  optional: rename signal\n");
 }
 
-/*
- * conversion of fixed-length text buffer to string.
- * input format: text array of up to len bytes, padded with null bytes
- * output format: null byte terminated string
- */
-static char *
-string_from_array(const char *input, const size_t len)
+static void
+mdfPrintHeaderInfo(const mdf_t *const mdf)
 {
-  char *const output = malloc(len+1);
-  char *const cp = memccpy(output, input, '\0', len);
-  if(cp == NULL) {
-    output[len]='\0';
+  time_t start = (time_t)(mdf->hd->start_time_ns / 1000000000);
+  char date[32];
+  uint32_t i;
+
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", gmtime(&start));
+  fprintf(stderr, "Version      = %u.%02u\n", mdf->version / 100, mdf->version % 100);
+  fprintf(stderr, "Start        = %s UTC\n", date);
+  fprintf(stderr, "Groups       = %lu\n", (unsigned long)mdf->n_groups);
+  for(i=0;i<mdf->n_groups;i++) {
+    const mdf_group_t *g = &mdf->groups[i];
+    fprintf(stderr, "  CG%lu %-20s %8llu records of %lu bytes, %lu channels\n",
+           (unsigned long)i, g->name ? g->name : "",
+           (unsigned long long)g->cg->cycle_count,
+           (unsigned long)g->record_size, (unsigned long)g->n_channels);
   }
-  return output;
 }
 
-#define FIELD_PRINT(desc,field) \
-{ \
-  char *const cp = \
-     string_from_array((const char *)&(field), sizeof(field));  \
-  fputs(desc,stdout); \
-  puts(cp);           \
-  free(cp);           \
-}
-
-static void
-mdfPrintHeaderInfo(const mdf_t *const mdf)
+/* message name of a group, unique among the names before it */
+static char *
+group_name(const mdf_t *mdf, uint32_t group, char **names)
 {
-  const id_block_t *id_block = id_block_get(mdf);
-  const hd_block_t *hd_block = hd_block_get(mdf);
-  const char *comment = tx_block_get_text(mdf, hd_block->link_tx_block);
-
-  if(comment) {
-    printf("File Comment =\n%s\n",comment);
+  const mdf_group_t *g = &mdf->groups[group];
+  char buf[32];
+  char *name;
+  uint32_t i;
+
+  snprintf(buf, sizeof(buf), "CG%lu", (unsigned long)group);
+  name = sanitize_name(g->name && *g->name ? g->name : buf);
+  for(i=0;i<group;i++) {
+    if(names[i] && 0 == strcmp(names[i], name)) {
+      char *unique = malloc(strlen(name) + sizeof(buf) + 1);
+      sprintf(unique, "%s_%s", name, buf);
+      free(name);
+      return unique;
+    }
   }
-  FIELD_PRINT("Date         = ", hd_block->recording_date);
-  FIELD_PRINT("Time         = ", hd_block->recording_time);
-  FIELD_PRINT("Author       = ", hd_block->author);
-  FIELD_PRINT("Organization = ", hd_block->organization);
-  FIELD_PRINT("Project      = ", hd_block->project);
-  FIELD_PRINT("Measurement  = ", hd_block->measurement_id);
-  printf("Byte Order   = %s\n",
-         (id_block->byte_order==0)?"Little Endian":"Big Endian");
-  printf("Version      = %u\n", id_block->version_number);
-  FIELD_PRINT("File Id      = ", id_block->file_identifier);
-  FIELD_PRINT("Format Id    = ", id_block->format_identifier);
-  FIELD_PRINT("Program Id   = ", id_block->program_identifier);
+  return name;
 }
 
-static void
-mdfProcess(const mdf_t *const mdf, const mdftomat_t *const mdftomat,
-           const filter_t *const filter)
+/*
+ * Reads the numeric channels of a group into msg, its DBC message
+ * stand in spec listing them. Returns the number of channels.
+ */
+static int
+read_group(const mdf_t *mdf, uint32_t group, msg_series_t *msg,
+           const selection_t *selection)
 {
-  hd_block_t *hd_block;
-
-  hd_block = hd_block_get(mdf);
-
-  if(mdf->verbose_level >= 1) {
-    mdfPrintHeaderInfo(mdf);
+  const mdf_group_t *g = &mdf->groups[group];
+  const unsigned char *records;
+  unsigned char *owned;
+  signal_list_t **tail = &msg->spec->signal_list;
+  long n = mdf_read_records(mdf, group, &records, &owned);
+  uint32_t i;
+  int count = 0;
+
+  if(n < 0) return -1;
+  msg->n = msg->cap = n;
+  msg->time = malloc(n * sizeof(double) + 1);
+  msg->ts_hash = create_hashtable(16, string_hash, string_equal);
+  if(!msg->time || !msg->ts_hash) {
+    free(owned);
+    return -1;
   }
 
-  /* process data groups */
-  mdfProcessDataGroups(mdf, filter, hd_block->link_dg_block,
-                         mat_write_signal, (const void * const)mdftomat);
-}
+  /* time of the master channel, else the record index */
+  if(g->master < 0 || mdf_read_values(mdf, g->master, records, n, msg->time)) {
+    if(verbose_flag >= 1 && n > 0) {
+      fprintf(stderr, "%s has no master channel, using record numbers\n",
+              msg->name);
+    }
+    for(i=0;i<n;i++) msg->time[i] = i;
+  }
 
-static int verbose_level = 0;
-static mdftomat_t mdftomat = {
-  NULL,
-  MAT_COMPRESSION_NONE
-};
+  for(i=g->first_channel;i<g->first_channel+g->n_channels;i++) {
+    const mdf_channel_t *c = &mdf->channels[i];
+    char *name;
+    double *values;
+
+    if((int) i == g->master || !mdf_channel_numeric(c)) continue;
+    name = sanitize_name(c->name);
+    if(hashtable_search(msg->ts_hash, name)
+       || !selection_signal(selection, msg->spec, name)) {
+      free(name);
+      continue;
+    }
+    values = malloc(n * sizeof(double) + 1);
+    if(!values || mdf_read_values(mdf, i, records, n, values)) {
+      fprintf(stderr, "Reading channel %s failed, skipped.\n", c->name);
+      free(values);
+      free(name);
+      continue;
+    }
 
-static int mat_file_ver = (int)MAT_FT_DEFAULT;
+    /* the stand in DBC signal, for writers listing signals */
+    signal_list_t *sl = calloc(1, sizeof(signal_list_t));
+    sl->signal = calloc(1, sizeof(signal_t));
+    sl->signal->name = strdup(name);
+    sl->signal->unit = c->unit ? strdup(c->unit) : NULL;
+    sl->signal->scale = 1;
+    sl->signal->signal_val_type = svt_double;
+    *tail = sl;
+    tail = &sl->next;
+
+    hashtable_insert(msg->ts_hash, name, values);
+    count++;
+  }
+  free(owned);
+  return count;
+}
 
 int
 main(int argc, char **argv)
 {
   char *mdf_filename = NULL;
-  char *mat_filename = NULL;
-  const mdf_t *mdf;
-  filter_t *filter;
-  char *filter_filename = NULL;
+  char *out_filename = NULL;
   char *program_name = argv[0];
+  selection_t *selection = NULL;
+  can_writer_t *writer;
+  mdf_t *mdf;
+  struct hashtable *msgs;
+  message_t **specs;
+  char **names;
+  uint32_t i;
+  int ret = 1;
 
   /* parse arguments */
   while (1) {
     static struct option long_options[] = {
       /* These options set a flag. */
-      {"verbose", no_argument,       &verbose_level,  1},
-      {"debug",   no_argument,       &verbose_level,  2},
-      {"deep",    no_argument,       &verbose_level,  3},
-      {"brief",   no_argument,       &verbose_level,  0},
-      {"v5",      no_argument,       &mat_file_ver,   (int)MAT_FT_MAT5},
-      {"v73",     no_argument,       &mat_file_ver,   (int)MAT_FT_MAT73},
-      {"compress",no_argument,       NULL,           'z'},
+      {"verbose", no_argument,       &verbose_flag,  1},
+      {"brief",   no_argument,       &verbose_flag,  0},
+      {"single",  no_argument,       &writer_opts.single, 1},
+      {"mat73",   no_argument,       &writer_opts.mat73, 1},
       /* These options don't set a flag.
          We distinguish them by their indices. */
-      {"filter",  required_argument, 0,            (int)'f'},
+      {"compress", required_argument, NULL,          'z'},
+      {"keep-message", required_argument, NULL, SELECT_OPTION + 2 * select_message},
+      {"drop-message", required_argument, NULL, SELECT_OPTION + 2 * select_message + 1},
+      {"keep-signal",  required_argument, NULL, SELECT_OPTION + 2 * select_signal},
+      {"drop-signal",  required_argument, NULL, SELECT_OPTION + 2 * select_signal + 1},
       {"help",    no_argument,       NULL,         (int)'h'},
       {0, 0, 0, 0}
     };
@@ -291,7 +284,7 @@ main(int argc, char **argv)
     int option_index = 0;
     int c;
 
-    c = getopt_long (argc, argv, "a:b:d:f:hm:t:vz",
+    c = getopt_long (argc, argv, "hz:",
                      long_options, &option_index);
 
     /* Detect the end of the options. */
@@ -300,97 +293,124 @@ main(int argc, char **argv)
     switch (c) {
     case 0:
       break;
-    case 'f':
-      filter_filename = optarg;
-      break;
     case 'h':
       help(program_name);
       exit(EXIT_SUCCESS);
       break;
-    case 'v':
-      verbose_level = 1;
-      break;
-    case 'd':
-      verbose_level = 2;
-      break;
     case 'z':
-      mdftomat.compress = MAT_COMPRESSION_ZLIB;
+      writer_opts.level = atoi(optarg);
+      if(writer_opts.level < 0 || writer_opts.level > 9) {
+        fprintf(stderr, "Compression level must be 0-9.\n");
+        usage_error(program_name);
+      }
       break;
     case '?':
       /* getopt_long already printed an error message. */
       usage_error(program_name);
       break;
     default:
+      if(c >= SELECT_OPTION && c < SELECT_OPTION + 2 * n_select_kinds) {
+        if(!selection) selection = selection_create();
+        if(selection_add(selection, (c - SELECT_OPTION) / 2,
+                         (c - SELECT_OPTION) % 2, optarg)) {
+          usage_error(program_name);
+        }
+        break;
+      }
       fprintf(stderr, "error: unknown option %c\n", c);
       usage_error(program_name);
     }
   }
 
-
-  /* check structure packing */
-  assert(offsetof(cn_block_t,link_asam_mcd_name) == 218);
-
   /* input files */
   if (optind == argc - 2) {
     mdf_filename = argv[optind++];
-    mat_filename = argv[optind++];
+    out_filename = argv[optind++];
   } else {
     fprintf(stderr, "error: wrong number of arguments\n");
     usage_error(program_name);
     return 1;
   }
 
+  writer = find_writer(out_filename);
+  if(!writer) {
+    fprintf(stderr, "Unknown output format of %s.\n", out_filename);
+    return 1;
+  }
+  if(writer->raw) {
+    fprintf(stderr, "%s files keep CAN frames, not channels.\n", writer->name);
+    return 1;
+  }
+
   /* print banner */
-  if(verbose_level >= 1) {
-    fprintf(stderr, "%s (%s, %s, cantools " PACKAGE_VERSION ")\n",
+  if(verbose_flag >= 1) {
+    fprintf(stderr, "%s (%s, %s, cantools " VERSION ")\n",
             program_name, __DATE__, __TIME__);
   }
 
-  /* connect to mdf file */
-  mdf = mdf_attach(mdf_filename, verbose_level);
+  /* map mdf file */
+  mdf = mdf_open(mdf_filename);
   if(mdf == NULL) {
     return 1;
   }
-
-  /* create mat file */
-  mdftomat.mat = Mat_CreateVer(mat_filename, NULL, (enum mat_ft)mat_file_ver);
-  if(mdftomat.mat == NULL) {
-    fprintf(stderr,"can't write to mat file %s\n",mat_filename);
-    return 1;
+  if(verbose_flag >= 1) {
+    mdfPrintHeaderInfo(mdf);
   }
 
-  /* read filter */
-  if(filter_filename != NULL) {
-    filter = mdf_filter_create(filter_filename);
-    if(filter == NULL) {
-      return 1;
+  /* one message per channel group */
+  msgs = create_hashtable(16, frame_key_hash, frame_key_equal);
+  specs = calloc(mdf->n_groups + 1, sizeof(message_t *));
+  names = calloc(mdf->n_groups + 1, sizeof(char *));
+  for(i=0;i<mdf->n_groups;i++) {
+    const mdf_group_t *g = &mdf->groups[i];
+    frame_key_t *key;
+    msg_series_t *msg;
+
+    if(g->cg->flags & MDF_CG_VLSD) continue;
+    names[i] = group_name(mdf, i, names);
+    specs[i] = calloc(1, sizeof(message_t));
+    specs[i]->id = i;
+    specs[i]->name = strdup(names[i]);
+    if(!selection_frame(selection, 0, i, specs[i])) continue;
+
+    msg = calloc(1, sizeof(msg_series_t));
+    msg->name = strdup(names[i]);
+    msg->dbcname = mdf_filename;
+    msg->spec = specs[i];
+    key = calloc(1, sizeof(frame_key_t));
+    key->id = i;
+    hashtable_insert(msgs, key, msg);
+
+    int count = read_group(mdf, i, msg, selection);
+    if(count < 0) goto exit;
+    if(verbose_flag >= 1) {
+      fprintf(stderr, "%s: %u records, %d channels\n",
+              msg->name, msg->n, count);
     }
-  } else {
-    filter = NULL;
   }
 
-  /* process MDF file */
-  if(verbose_level >= 1) {
-    fprintf(stderr, "converting %s to %sfile %s\n",
-            mdf_filename,
-            (mdftomat.compress == MAT_COMPRESSION_ZLIB)?"compressed ":"",
-            mat_filename);
+  /* write through the writer of the output extension */
+  if(verbose_flag >= 1) {
+    fprintf(stderr, "converting %s to %s file %s\n",
+            mdf_filename, writer->name, out_filename);
   }
-  mdfProcess(mdf, &mdftomat, filter);
+  ret = writer->write_fcn(msgs, out_filename) != 0;
 
-  /* free filter */
-  filter_free(filter);
-
-  /* detach from mdf file */
-  mdf_detach(mdf);
-
-  /* close mat file */
-  Mat_Close(mdftomat.mat);
+exit:
+  destroy_messages(msgs);
+  for(i=0;i<mdf->n_groups;i++) {
+    message_free(specs[i]);
+    free(names[i]);
+  }
+  free(specs);
+  free(names);
+  selection_free(selection);
+  mdf_close(mdf);
 
   /* say goodbye */
-  if(verbose_level >= 1) {
-    puts("done.");
+  if(verbose_flag >= 1 && ret == 0) {
+    fputs("done.\n", stderr);
   }
 
-  return 0;
+  return ret;
 }
@@ -0,0 +1,582 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "measurement.h"
+#include "hashtable_itr.h"
+#include "writer.h"
+#include "stats.h"
+
+// Arrow IPC file format, also known as Feather v2.
+// https://arrow.apache.org/docs/format/Columnar.html#ipc-file-format
+//
+// An Arrow file has a single schema, but every CAN message has its own
+// set of signals. The output is therefore a directory with one file per
+// message, each holding one record batch: a duration[ns] "time" column
+// followed by the signals in DBC order.
+//
+// The metadata is flatbuffers, built by the small builder below.
+// Like the BLF reader, it assumes a little endian host.
+// https://flatbuffers.dev/flatbuffers_internals.html
+
+#define ARROW_ALIGN 64           // buffer alignment, for zero copy mmap
+#define ARROW_V5 4               // MetadataVersion
+#define ARROW_HEADER_SCHEMA 1    // MessageHeader union
+#define ARROW_HEADER_BATCH 3
+#define ARROW_TYPE_FLOAT 3       // Type union
+#define ARROW_TYPE_DURATION 18
+#define ARROW_DOUBLE 2           // Precision
+#define ARROW_SINGLE 1
+#define ARROW_NANOSECOND 3       // TimeUnit
+
+#define FB_MAX_FIELDS 8
+
+
+/*
+ * Flatbuffer builder.
+ *
+ * Buffers are built back to front, children before their parents, so
+ * all offsets point forward. Positions are counted from the end.
+ */
+typedef struct {
+    unsigned char *buf;
+    size_t cap;
+    size_t size;
+    size_t minalign;
+    size_t table_start;
+    size_t fields[FB_MAX_FIELDS]; // positions in the open table, 0 if unset
+    int failed;
+} fb_builder_t;
+
+
+static void fb_push(fb_builder_t *b, const void *data, size_t n)
+{
+    if (n == 0)
+        return;
+    if (b->size + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 1024;
+        while (cap < b->size + n)
+            cap *= 2;
+        unsigned char *buf = malloc(cap);
+        if (!buf) {
+            b->failed = 1;
+            return;
+        }
+        if (b->size)
+            memcpy(buf + cap - b->size, b->buf + b->cap - b->size, b->size);
+        free(b->buf);
+        b->buf = buf;
+        b->cap = cap;
+    }
+    b->size += n;
+    memcpy(b->buf + b->cap - b->size, data, n);
+}
+
+
+// Pad so that the size is a multiple of align after adding n bytes.
+static void fb_align(fb_builder_t *b, size_t align, size_t n)
+{
+    static const unsigned char zeros[8] = {0};
+    if (align > b->minalign)
+        b->minalign = align;
+    fb_push(b, zeros, (align - (b->size + n) % align) % align);
+}
+
+
+static size_t fb_offset(fb_builder_t *b, size_t target)
+{
+    fb_align(b, 4, 4);
+    uint32_t off = b->size + 4 - target;
+    fb_push(b, &off, 4);
+    return b->size;
+}
+
+
+static size_t fb_string(fb_builder_t *b, const char *s)
+{
+    uint32_t len = strlen(s);
+    fb_align(b, 4, len + 1);
+    fb_push(b, s, len + 1);
+    fb_push(b, &len, 4);
+    return b->size;
+}
+
+
+static size_t fb_struct_vector(fb_builder_t *b, const void *elems,
+                               size_t n, size_t elem_size)
+{
+    uint32_t len = n;
+    fb_align(b, 4, n * elem_size);
+    fb_align(b, 8, n * elem_size);
+    fb_push(b, elems, n * elem_size);
+    fb_push(b, &len, 4);
+    return b->size;
+}
+
+
+static size_t fb_offset_vector(fb_builder_t *b, const size_t *targets, size_t n)
+{
+    uint32_t len = n;
+    fb_align(b, 4, 4 * n);
+    for (size_t i = n; i-- > 0;)
+        fb_offset(b, targets[i]);
+    fb_push(b, &len, 4);
+    return b->size;
+}
+
+
+static void fb_table_start(fb_builder_t *b)
+{
+    memset(b->fields, 0, sizeof(b->fields));
+    b->table_start = b->size;
+}
+
+
+static void fb_field(fb_builder_t *b, int id, const void *value, size_t n)
+{
+    fb_align(b, n, n);
+    fb_push(b, value, n);
+    b->fields[id] = b->size;
+}
+
+
+static void fb_field_offset(fb_builder_t *b, int id, size_t target)
+{
+    b->fields[id] = fb_offset(b, target);
+}
+
+
+// Close the table and put its vtable right before it.
+static size_t fb_table_end(fb_builder_t *b)
+{
+    int32_t soffset = 0;
+    fb_align(b, 4, 4);
+    fb_push(b, &soffset, 4);
+    size_t table = b->size;
+
+    int n_fields = 0;
+    for (int i = 0; i < FB_MAX_FIELDS; i++) {
+        if (b->fields[i])
+            n_fields = i + 1;
+    }
+    uint16_t vtable[2 + FB_MAX_FIELDS];
+    vtable[0] = (2 + n_fields) * sizeof(uint16_t);
+    vtable[1] = table - b->table_start;
+    for (int i = 0; i < n_fields; i++)
+        vtable[2 + i] = b->fields[i] ? table - b->fields[i] : 0;
+    fb_push(b, vtable, vtable[0]);
+
+    soffset = b->size - table;
+    if (!b->failed)
+        memcpy(b->buf + b->cap - table, &soffset, 4);
+    return table;
+}
+
+
+static const unsigned char *fb_finish(fb_builder_t *b, size_t root)
+{
+    fb_align(b, b->minalign, 4);
+    fb_offset(b, root);
+    return b->failed ? NULL : b->buf + b->cap - b->size;
+}
+
+
+static void fb_reset(fb_builder_t *b)
+{
+    b->size = 0;
+    b->minalign = 1;
+    b->failed = 0;
+}
+
+
+/*
+ * Arrow metadata
+ */
+typedef struct {
+    const char *name;
+    const char *unit;
+    const double *data;
+} arrow_column_t;
+
+typedef struct {
+    int64_t length;
+    int64_t null_count;
+} arrow_field_node_t;
+
+typedef struct {
+    int64_t offset;
+    int64_t length;
+} arrow_buffer_t;
+
+typedef struct {
+    int64_t offset;
+    int32_t meta_len;
+    int32_t pad;
+    int64_t body_len;
+} arrow_block_t;
+
+
+static size_t arrow_key_values(fb_builder_t *b, const char **kv, size_t n)
+{
+    size_t pairs[8];
+    for (size_t i = 0; i < n; i++) {
+        size_t key = fb_string(b, kv[2*i]);
+        size_t value = fb_string(b, kv[2*i + 1]);
+        fb_table_start(b);
+        fb_field_offset(b, 0, key);
+        fb_field_offset(b, 1, value);
+        pairs[i] = fb_table_end(b);
+    }
+    return fb_offset_vector(b, pairs, n);
+}
+
+
+static size_t arrow_field(fb_builder_t *b, const char *name, const char *unit,
+                          uint8_t type_type, size_t type)
+{
+    size_t name_off = fb_string(b, name);
+    size_t children = fb_offset_vector(b, NULL, 0);
+    const char *kv[] = {"unit", unit};
+    size_t meta = unit && *unit ? arrow_key_values(b, kv, 1) : 0;
+
+    fb_table_start(b);
+    fb_field_offset(b, 0, name_off);
+    fb_field_offset(b, 3, type);
+    fb_field_offset(b, 5, children);
+    if (meta)
+        fb_field_offset(b, 6, meta);
+    fb_field(b, 2, &type_type, 1);
+    return fb_table_end(b);
+}
+
+
+static size_t arrow_schema(fb_builder_t *b, const frame_key_t *key,
+                           const msg_series_t *msg,
+                           const arrow_column_t *cols, size_t n_cols)
+{
+    size_t *fields = malloc(n_cols * sizeof(size_t));
+    if (!fields) {
+        b->failed = 1;
+        return 0;
+    }
+
+    int16_t unit = ARROW_NANOSECOND;
+    fb_table_start(b);
+    fb_field(b, 0, &unit, sizeof(unit));
+    size_t duration = fb_table_end(b);
+    fields[0] = arrow_field(b, cols[0].name, NULL, ARROW_TYPE_DURATION, duration);
+
+    int16_t precision = writer_opts.single ? ARROW_SINGLE : ARROW_DOUBLE;
+    fb_table_start(b);
+    fb_field(b, 0, &precision, sizeof(precision));
+    size_t floating = fb_table_end(b);
+    for (size_t i = 1; i < n_cols; i++)
+        fields[i] = arrow_field(b, cols[i].name, cols[i].unit,
+                                ARROW_TYPE_FLOAT, floating);
+    size_t field_vector = fb_offset_vector(b, fields, n_cols);
+    free(fields);
+
+    char bus[8], id[16];
+    snprintf(bus, sizeof(bus), "%u", key->bus);
+    snprintf(id, sizeof(id), "0x%X", key->id);
+    const char *kv[] = {
+        "message", msg->name,
+        "dbc", msg->dbcname,
+        "bus", bus,
+        "id", id,
+    };
+    size_t meta = arrow_key_values(b, kv, 4);
+
+    fb_table_start(b);
+    fb_field_offset(b, 1, field_vector);
+    fb_field_offset(b, 2, meta);
+    return fb_table_end(b);
+}
+
+
+static size_t arrow_message(fb_builder_t *b, uint8_t header_type,
+                            size_t header, int64_t body_len)
+{
+    int16_t version = ARROW_V5;
+    fb_table_start(b);
+    fb_field(b, 3, &body_len, sizeof(body_len));
+    fb_field_offset(b, 2, header);
+    fb_field(b, 0, &version, sizeof(version));
+    fb_field(b, 1, &header_type, 1);
+    return fb_table_end(b);
+}
+
+
+/* Bytes of the values buffer of column i, before padding. */
+static size_t column_bytes(const msg_series_t *msg, size_t i)
+{
+    if (i == 0)
+        return msg->n * sizeof(int64_t);
+    return msg->n * (writer_opts.single ? sizeof(float) : sizeof(double));
+}
+
+
+static size_t padded(size_t n)
+{
+    return (n + ARROW_ALIGN - 1) / ARROW_ALIGN * ARROW_ALIGN;
+}
+
+
+/*
+ * Write an encapsulated message: continuation marker, metadata length,
+ * flatbuffer, padded so that the body that follows is aligned.
+ * Returns the metadata length including prefix, 0 on failure.
+ */
+static int32_t write_metadata(FILE *fp, long pos,
+                              const unsigned char *fb, size_t fb_len)
+{
+    static const unsigned char zeros[ARROW_ALIGN] = {0};
+    const uint32_t continuation = 0xFFFFFFFF;
+    size_t pad = padded(pos + 8 + fb_len) - (pos + 8 + fb_len);
+    int32_t len = fb_len + pad;
+
+    if (fwrite(&continuation, 4, 1, fp) != 1
+        || fwrite(&len, 4, 1, fp) != 1
+        || fwrite(fb, 1, fb_len, fp) != fb_len
+        || fwrite(zeros, 1, pad, fp) != pad)
+        return 0;
+    return 8 + len;
+}
+
+
+/*
+ * Write the column values as the record batch body. Doubles go from
+ * the decoded series straight to the file, the rest through a small
+ * conversion buffer.
+ */
+static int write_body(FILE *fp, const msg_series_t *msg,
+                      const arrow_column_t *cols, size_t n_cols)
+{
+    static const unsigned char zeros[ARROW_ALIGN] = {0};
+    union {
+        int64_t ns[1024];
+        float single[1024];
+    } tmp;
+    const size_t n_tmp = sizeof(tmp.ns) / sizeof(tmp.ns[0]);
+
+    for (size_t i = 0; i < n_cols; i++) {
+        const double *data = cols[i].data;
+
+        if (i == 0) {
+            for (size_t k = 0; k < msg->n; k += n_tmp) {
+                size_t m = msg->n - k < n_tmp ? msg->n - k : n_tmp;
+                for (size_t j = 0; j < m; j++)
+                    tmp.ns[j] = (int64_t) (data[k + j] * 1e9 + 0.5);
+                if (fwrite(tmp.ns, sizeof(int64_t), m, fp) != m)
+                    return 1;
+            }
+        } else if (writer_opts.single) {
+            for (size_t k = 0; k < msg->n; k += n_tmp) {
+                size_t m = msg->n - k < n_tmp ? msg->n - k : n_tmp;
+                for (size_t j = 0; j < m; j++)
+                    tmp.single[j] = (float) data[k + j];
+                if (fwrite(tmp.single, sizeof(float), m, fp) != m)
+                    return 1;
+            }
+        } else if (fwrite(data, sizeof(double), msg->n, fp) != msg->n) {
+            return 1;
+        }
+
+        size_t bytes = column_bytes(msg, i);
+        size_t pad = padded(bytes) - bytes;
+        if (fwrite(zeros, 1, pad, fp) != pad)
+            return 1;
+    }
+    return 0;
+}
+
+
+/* Columns of a message: time, then its decoded signals in DBC order. */
+static arrow_column_t *message_columns(const msg_series_t *msg, size_t *n_cols)
+{
+    arrow_column_t *cols = malloc((1 + hashtable_count(msg->ts_hash))
+                                  * sizeof(arrow_column_t));
+    if (!cols)
+        return NULL;
+
+    cols[0].name = "time";
+    cols[0].unit = NULL;
+    cols[0].data = msg->time;
+    *n_cols = 1;
+
+    signal_list_t *sl;
+    for (sl = msg->spec->signal_list; sl != NULL; sl = sl->next) {
+        const signal_t *const sig = sl->signal;
+        const double *data = hashtable_search(msg->ts_hash, sig->name);
+        int seen = 0;
+        for (size_t i = 1; i < *n_cols; i++)
+            seen |= cols[i].data == data;
+        if (!data || seen)
+            continue;
+
+        cols[*n_cols].name = sig->name;
+        cols[*n_cols].unit = sig->unit;
+        cols[*n_cols].data = data;
+        (*n_cols)++;
+    }
+    return cols;
+}
+
+
+static int write_message_file(fb_builder_t *b, const char *path,
+                              const frame_key_t *key, const msg_series_t *msg)
+{
+    static const char magic[8] = "ARROW1\0";
+    int ret = 1;
+    size_t n_cols;
+    arrow_column_t *cols = message_columns(msg, &n_cols);
+    arrow_field_node_t *nodes = malloc(n_cols * sizeof(arrow_field_node_t));
+    arrow_buffer_t *buffers = malloc(2 * n_cols * sizeof(arrow_buffer_t));
+    FILE *fp = fopen(path, "wb");
+    if (!cols || !nodes || !buffers || !fp)
+        goto exit;
+
+    // Primitive columns have a validity and a values buffer.
+    // Nothing is null, so validity buffers are left empty.
+    int64_t body_len = 0;
+    for (size_t i = 0; i < n_cols; i++) {
+        nodes[i].length = msg->n;
+        nodes[i].null_count = 0;
+        buffers[2*i].offset = body_len;
+        buffers[2*i].length = 0;
+        buffers[2*i + 1].offset = body_len;
+        buffers[2*i + 1].length = column_bytes(msg, i);
+        body_len += padded(column_bytes(msg, i));
+    }
+
+    if (fwrite(magic, 1, sizeof(magic), fp) != sizeof(magic))
+        goto exit;
+    long pos = sizeof(magic);
+
+    // Schema message
+    fb_reset(b);
+    size_t schema = arrow_schema(b, key, msg, cols, n_cols);
+    size_t root = arrow_message(b, ARROW_HEADER_SCHEMA, schema, 0);
+    const unsigned char *fb = fb_finish(b, root);
+    int32_t meta_len;
+    if (!fb || !(meta_len = write_metadata(fp, pos, fb, b->size)))
+        goto exit;
+    pos += meta_len;
+
+    // Record batch message and body
+    arrow_block_t block = {pos, 0, 0, body_len};
+    int64_t length = msg->n;
+    fb_reset(b);
+    size_t buffer_vector = fb_struct_vector(b, buffers, 2 * n_cols,
+                                            sizeof(arrow_buffer_t));
+    size_t node_vector = fb_struct_vector(b, nodes, n_cols,
+                                          sizeof(arrow_field_node_t));
+    fb_table_start(b);
+    fb_field(b, 0, &length, sizeof(length));
+    fb_field_offset(b, 1, node_vector);
+    fb_field_offset(b, 2, buffer_vector);
+    size_t batch = fb_table_end(b);
+    root = arrow_message(b, ARROW_HEADER_BATCH, batch, body_len);
+    fb = fb_finish(b, root);
+    if (!fb || !(block.meta_len = write_metadata(fp, pos, fb, b->size)))
+        goto exit;
+    if (write_body(fp, msg, cols, n_cols))
+        goto exit;
+
+    // Footer
+    fb_reset(b);
+    schema = arrow_schema(b, key, msg, cols, n_cols);
+    size_t dictionaries = fb_struct_vector(b, NULL, 0, sizeof(arrow_block_t));
+    size_t batches = fb_struct_vector(b, &block, 1, sizeof(arrow_block_t));
+    int16_t version = ARROW_V5;
+    fb_table_start(b);
+    fb_field_offset(b, 1, schema);
+    fb_field_offset(b, 2, dictionaries);
+    fb_field_offset(b, 3, batches);
+    fb_field(b, 0, &version, sizeof(version));
+    root = fb_table_end(b);
+    fb = fb_finish(b, root);
+    int32_t footer_len = b->size;
+    if (!fb
+        || fwrite(fb, 1, b->size, fp) != b->size
+        || fwrite(&footer_len, 4, 1, fp) != 1
+        || fwrite(magic, 1, 6, fp) != 6)
+        goto exit;
+
+    STATS_ADD(stat_bytes_written, ftell(fp));
+    ret = 0;
+exit:
+    if (fp && fclose(fp) != 0)
+        ret = 1;
+    free(buffers);
+    free(nodes);
+    free(cols);
+    return ret;
+}
+
+
+/*
+ * write_arrow - write one Arrow IPC file per message into outdir
+ */
+int write_arrow(struct hashtable *msg_hash, const char *outdir)
+{
+    int ret = 1;
+    if (hashtable_count(msg_hash) == 0) {
+        fprintf(stderr, "error: measurement empty, nothing to write\n");
+        return 1;
+    }
+
+#ifdef _WIN32
+    int err = mkdir(outdir);
+#else
+    int err = mkdir(outdir, 0777);
+#endif
+    if (err && errno != EEXIST) {
+        fprintf(stderr, "error: could not create directory %s\n", outdir);
+        return 1;
+    }
+
+    fb_builder_t b = {0};
+    char *path = NULL;
+
+    struct hashtable_itr *msg_itr = hashtable_iterator(msg_hash);
+    do {
+        frame_key_t *msg_key = hashtable_iterator_key(msg_itr);
+        msg_series_t *msg = hashtable_iterator_value(msg_itr);
+        if (!msg->ts_hash || hashtable_count(msg->ts_hash) == 0)
+            continue;
+
+        free(path);
+        path = message_path(msg_hash, outdir, msg_key, msg, "arrow");
+        if (!path || write_message_file(&b, path, msg_key, msg)) {
+            fprintf(stderr, "error: could not write %s\n",
+                    path ? path : msg->name);
+            goto exit;
+        }
+    } while (hashtable_iterator_advance(msg_itr));
+
+    ret = 0;
+exit:
+    free(msg_itr);
+    free(path);
+    free(b.buf);
+    return ret;
+}
+
+
+// Export this format so writer.c can use it.
+// Feather v2 is the Arrow IPC file format under another name.
+can_writer_t arrow_writer = {
+    .name="arrow",
+    .ext="arrow",
+    .write_fcn=write_arrow
+};
+
+can_writer_t feather_writer = {
+    .name="feather",
+    .ext="feather",
+    .write_fcn=write_arrow
+};
@@ -0,0 +1,8 @@
+#ifndef ARROWWRITE_H
+#define ARROWWRITE_H
+
+#include "measurement.h"
+
+int write_arrow(struct hashtable *msg_hash, const char *outdir);
+
+#endif /* ARROWWRITE_H */
@@ -25,10 +25,12 @@ struct busAssignmentEntry_s {
     char *filename;
     char *basename;
     messageHash_t *messageHash;
+    messageHash_t *pgnHash; /* J1939 PGN index, NULL if disabled */
 };
 
 struct busAssignment_s {
     int n;
+    int j1939; /* index extended messages by PGN */
     struct busAssignmentEntry_s *list; /* array of n busAssigmentEntry_t's */
 };
 
@@ -67,10 +69,21 @@ busAssignment_t *busAssignment_create(void)
     CREATE(busAssignment_t, busAssignment);
 
     busAssignment->n = 0;
+    busAssignment->j1939 = 0;
     busAssignment->list = NULL;
     return busAssignment;
 }
 
+/*
+ * Enable J1939 lookup: extended frames without an exact ID match
+ * in a DBC fall back to the message with the same PGN.
+ * Must be called before busAssignment_parseDBC.
+ */
+void busAssignment_setJ1939(busAssignment_t *busAssignment, int enable)
+{
+    busAssignment->j1939 = enable;
+}
+
 void busAssignment_associate(busAssignment_t *busAssignment,
                              int bus, char *filename)
 {
@@ -82,6 +95,7 @@ void busAssignment_associate(busAssignment_t *busAssignment,
     busAssignment->list[busAssignment->n-1].filename = strdup(filename);
     busAssignment->list[busAssignment->n-1].basename = basename(filename);
     busAssignment->list[busAssignment->n-1].messageHash = NULL;
+    busAssignment->list[busAssignment->n-1].pgnHash = NULL;
 }
 
 int busAssignment_parseDBC(busAssignment_t *busAssignment)
@@ -107,6 +121,10 @@ int busAssignment_parseDBC(busAssignment_t *busAssignment)
                 ret = 1;
                 break;
             }
+            if(busAssignment->j1939) {
+                busAssignment->list[i].pgnHash =
+                    messageHash_createPGN(messageHash, dbc->message_list);
+            }
             dbc_free(dbc);
         } else {
             fprintf(stderr, "busAssignment_parseDBC(): error opening DBC file %s\n",
@@ -127,6 +145,7 @@ void busAssignment_free(busAssignment_t *busAssignment)
             busAssignmentEntry_t *entry = &(busAssignment->list[i]);
             free(entry->filename);
             free(entry->basename);
+            messageHash_freePGN(entry->pgnHash);
             messageHash_free(entry->messageHash);
         }
         if(busAssignment->list != NULL) free(busAssignment->list);
@@ -141,6 +160,8 @@ void busAssignment_free(busAssignment_t *busAssignment)
  *             Only buses matching argument bus as used.
  *             bus=-1 means match all buses
  *             Writes the basename of the used dbc into basename_used.
+ *             With J1939 lookup enabled, exact ID matches in any of
+ *             the libraries take precedence over PGN matches.
  *             Returns NULL if no match was found.
  */
 message_t *get_msg_spec(busAssignment_t *bus_lib,
@@ -159,5 +180,15 @@ message_t *get_msg_spec(busAssignment_t *bus_lib,
         }
     }
 
+    for (int i = 0; i < bus_lib->n ; i++) {
+        busAssignmentEntry_t entry = bus_lib->list[i];
+        if (entry.bus == bus) {
+            if ((match = messageHash_searchPGN(entry.pgnHash, id))) {
+                *basename_used = entry.basename;
+                return match;
+            }
+        }
+    }
+
     return NULL;
 }
@@ -26,6 +26,7 @@ typedef struct busAssignmentEntry_s busAssignmentEntry_t;
 typedef struct busAssignment_s busAssignment_t;
 
 busAssignment_t *busAssignment_create(void);
+void busAssignment_setJ1939(busAssignment_t *busAssignment, int enable);
 void busAssignment_associate(busAssignment_t *busAssigment,
                              int bus, char *filename);
 void busAssignment_free(busAssignment_t *busAssigment);
@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "changes.h"
+#include "hashtable_itr.h"
+
+change_opts_t change_opts = {
+    .enabled = 0,
+    .deadband = 0.0,
+};
+
+
+/* simple string hash function for signal names */
+static unsigned int string_hash(void *k)
+{
+    unsigned int hash = 0;
+    int c;
+    while ((c = *(unsigned char *)k++))
+        hash = c + (hash << 6) + (hash << 16) - hash;
+    return hash;
+}
+
+
+static int string_equal(void *key1, void *key2)
+{
+    return strcmp((char *)key1, (char *)key2) == 0;
+}
+
+
+size_t change_mask(const double *values, size_t n, double deadband,
+                   const double *last, unsigned char *keep)
+{
+    if (n == 0)
+        return 0;
+
+    size_t count = 0;
+    if (deadband > 0) {
+        // Against the last kept value, one sample at a time.
+        double ref = last ? *last : values[0];
+        keep[0] = !last;
+        for (size_t i = last ? 0 : 1; i < n; i++) {
+            double d = fabs(values[i] - ref);
+            keep[i] = d > deadband || (isnan(d) && isnan(values[i]) != isnan(ref));
+            if (keep[i])
+                ref = values[i];
+        }
+    } else {
+        // Any change of the bits, a sample equal to the one before it
+        // equals the last kept. Branch free, vectorizes.
+        uint64_t a, b;
+        if (last) {
+            memcpy(&a, values, sizeof(a));
+            memcpy(&b, last, sizeof(b));
+            keep[0] = a != b;
+        } else {
+            keep[0] = 1;
+        }
+        for (size_t i = 1; i < n; i++) {
+            memcpy(&a, values + i, sizeof(a));
+            memcpy(&b, values + i - 1, sizeof(b));
+            keep[i] = a != b;
+        }
+    }
+    for (size_t i = 0; i < n; i++)
+        count += keep[i];
+    return count;
+}
+
+
+typedef struct {
+    int started;        // a sample was kept
+    double last;        // value last kept
+    int pending;        // last sample of the series, not kept yet
+    double pending_time;
+    double pending_value;
+} change_signal_t;
+
+typedef struct {
+    frame_key_t key;
+    char *name;
+    char *dbcname;
+    message_t *spec;
+    size_t n_signals;
+    change_signal_t *signals; // in DBC order
+} change_series_t;
+
+struct change_state_s {
+    struct hashtable *series; // frame_key_t -> change_series_t
+    unsigned char *keep;
+    size_t keep_cap;
+};
+
+
+change_state_t *change_state_create(void)
+{
+    change_state_t *state = calloc(1, sizeof(change_state_t));
+    if (!state)
+        return NULL;
+    state->series = create_hashtable(16, frame_key_hash, frame_key_equal);
+    if (!state->series) {
+        free(state);
+        return NULL;
+    }
+    return state;
+}
+
+
+void change_state_free(change_state_t *state)
+{
+    if (!state)
+        return;
+    if (hashtable_count(state->series)) {
+        struct hashtable_itr *itr = hashtable_iterator(state->series);
+        do {
+            change_series_t *cs = hashtable_iterator_value(itr);
+            free(cs->name);
+            free(cs->signals);
+            free(cs);
+        } while (hashtable_iterator_advance(itr));
+        free(itr);
+    }
+    hashtable_destroy(state->series, 0);
+    free(state->keep);
+    free(state);
+}
+
+
+static change_series_t *find_series(change_state_t *state,
+                                    const frame_key_t *key,
+                                    const msg_series_t *block)
+{
+    change_series_t *cs = hashtable_search(state->series, (void *) key);
+    if (cs)
+        return cs;
+
+    size_t n_signals = 0;
+    for (signal_list_t *sl = block->spec->signal_list; sl; sl = sl->next)
+        n_signals++;
+
+    cs = calloc(1, sizeof(change_series_t));
+    frame_key_t *k = malloc(sizeof(frame_key_t));
+    if (!cs || !k) {
+        free(cs);
+        free(k);
+        return NULL;
+    }
+    cs->key = *key;
+    cs->name = strdup(block->name);
+    cs->dbcname = block->dbcname;
+    cs->spec = block->spec;
+    cs->n_signals = n_signals;
+    cs->signals = calloc(n_signals ? n_signals : 1, sizeof(change_signal_t));
+    *k = *key;
+    hashtable_insert(state->series, k, cs);
+    return cs;
+}
+
+
+/* Hand n samples of one signal to append, as a series of its own. */
+static int append_signal(const change_series_t *cs, size_t c,
+                         const char *signal, double *time, double *values,
+                         size_t n, stream_append_f append, void *stream)
+{
+    size_t len = strlen(cs->name) + strlen(signal) + 2;
+    char *name = malloc(len);
+    if (!name)
+        return 1;
+    snprintf(name, len, "%s_%s", cs->name, signal);
+
+    msg_series_t out;
+    memset(&out, 0, sizeof(out));
+    out.n = n;
+    out.cap = n;
+    out.time = time;
+    out.name = name;
+    out.dbcname = cs->dbcname;
+    out.spec = cs->spec;
+    out.ts_hash = create_hashtable(16, string_hash, string_equal);
+    if (!out.ts_hash) {
+        free(name);
+        return 1;
+    }
+    hashtable_insert(out.ts_hash, strdup(signal), values);
+
+    frame_key_t key = cs->key;
+    key.signal = c + 1;
+    int ret = append(stream, &key, &out);
+
+    // The values stay with the caller.
+    hashtable_destroy(out.ts_hash, 0);
+    free(name);
+    return ret;
+}
+
+
+int change_block(change_state_t *state, const frame_key_t *key,
+                 const msg_series_t *block,
+                 stream_append_f append, void *stream)
+{
+    if (!block->spec || !block->ts_hash || block->n == 0)
+        return 0;
+
+    change_series_t *cs = find_series(state, key, block);
+    if (!cs)
+        return 1;
+
+    size_t n = block->n;
+    if (n > state->keep_cap) {
+        free(state->keep);
+        state->keep = malloc(n);
+        state->keep_cap = state->keep ? n : 0;
+        if (!state->keep)
+            return 1;
+    }
+    double *time = malloc(n * sizeof(double));
+    double *values = malloc(n * sizeof(double));
+    if (!time || !values) {
+        free(time);
+        free(values);
+        return 1;
+    }
+
+    int ret = 0;
+    size_t c = 0;
+    for (signal_list_t *sl = cs->spec->signal_list; sl && !ret;
+         sl = sl->next, c++) {
+        const double *v = hashtable_search(block->ts_hash, sl->signal->name);
+        if (!v)
+            continue;
+        change_signal_t *s = &cs->signals[c];
+        unsigned char *keep = state->keep;
+
+        size_t m = change_mask(v, n, change_opts.deadband,
+                               s->started ? &s->last : NULL, keep);
+        size_t j = 0;
+        for (size_t i = 0; i < n; i++) {
+            time[j] = block->time[i];
+            values[j] = v[i];
+            j += keep[i];
+        }
+
+        // Hold back the last sample, it is written if no other follows.
+        s->pending = !keep[n - 1];
+        s->pending_time = block->time[n - 1];
+        s->pending_value = v[n - 1];
+        if (m == 0)
+            continue;
+        s->started = 1;
+        s->last = values[m - 1];
+        ret = append_signal(cs, c, sl->signal->name, time, values, m,
+                            append, stream);
+    }
+    free(time);
+    free(values);
+    return ret;
+}
+
+
+int change_flush(change_state_t *state, stream_append_f append, void *stream)
+{
+    if (!hashtable_count(state->series))
+        return 0;
+
+    int ret = 0;
+    struct hashtable_itr *itr = hashtable_iterator(state->series);
+    do {
+        change_series_t *cs = hashtable_iterator_value(itr);
+        size_t c = 0;
+        for (signal_list_t *sl = cs->spec->signal_list; sl && !ret;
+             sl = sl->next, c++) {
+            change_signal_t *s = &cs->signals[c];
+            if (!s->pending)
+                continue;
+            s->pending = 0;
+            ret = append_signal(cs, c, sl->signal->name,
+                                &s->pending_time, &s->pending_value, 1,
+                                append, stream);
+        }
+    } while (!ret && hashtable_iterator_advance(itr));
+    free(itr);
+    return ret;
+}
+
+
+/* Append a signal series to the one of the same key in stream. */
+static int collect_append(void *stream, const frame_key_t *key,
+                          const msg_series_t *block)
+{
+    struct hashtable *h = stream;
+    struct hashtable_itr *itr = hashtable_iterator(block->ts_hash);
+    const char *signal = hashtable_iterator_key(itr);
+    const double *values = hashtable_iterator_value(itr);
+    free(itr);
+
+    msg_series_t *msg = hashtable_search(h, (void *) key);
+    if (!msg) {
+        msg = calloc(1, sizeof(msg_series_t));
+        frame_key_t *k = malloc(sizeof(frame_key_t));
+        if (!msg || !k) {
+            free(msg);
+            free(k);
+            return 1;
+        }
+        *k = *key;
+        msg->name = strdup(block->name);
+        msg->dbcname = block->dbcname;
+        msg->spec = block->spec;
+        msg->ts_hash = create_hashtable(16, string_hash, string_equal);
+        hashtable_insert(h, k, msg);
+    }
+
+    // Taken out while it grows, NULL at first.
+    double *data = hashtable_remove(msg->ts_hash, (void *) signal);
+    unsigned int n = msg->n + block->n;
+    if (n > msg->cap) {
+        msg->cap = n > 2 * msg->cap ? n : 2 * msg->cap;
+        msg->time = realloc(msg->time, msg->cap * sizeof(double));
+        data = realloc(data, msg->cap * sizeof(double));
+    }
+    hashtable_insert(msg->ts_hash, strdup(signal), data);
+    if (!msg->time || !data)
+        return 1;
+    memcpy(msg->time + msg->n, block->time, block->n * sizeof(double));
+    memcpy(data + msg->n, values, block->n * sizeof(double));
+    msg->n = n;
+    return 0;
+}
+
+
+struct hashtable *split_changes(struct hashtable *msg_hashmap)
+{
+    struct hashtable *h = create_hashtable(16, frame_key_hash, frame_key_equal);
+    change_state_t *state = change_state_create();
+    int ret = !h || !state;
+
+    if (!ret && hashtable_count(msg_hashmap)) {
+        struct hashtable_itr *itr = hashtable_iterator(msg_hashmap);
+        do {
+            frame_key_t *key = hashtable_iterator_key(itr);
+            msg_series_t *msg = hashtable_iterator_value(itr);
+            ret = change_block(state, key, msg, collect_append, h);
+        } while (!ret && hashtable_iterator_advance(itr));
+        free(itr);
+    }
+    if (!ret)
+        ret = change_flush(state, collect_append, h);
+
+    change_state_free(state);
+    if (ret) {
+        destroy_messages(h);
+        return NULL;
+    }
+    return h;
+}
@@ -0,0 +1,49 @@
+#ifndef CHANGES_H
+#define CHANGES_H
+
+#include <stddef.h>
+#include "hashtable.h"
+#include "measurement.h"
+#include "writer.h"
+
+// Change-only output.
+//
+// Every decoded signal becomes a series of its own, named
+// Message_Signal with its own time vector. It keeps the samples where
+// the value moved by more than the deadband from the last kept sample,
+// plus the first and the last sample.
+typedef struct {
+    int enabled;
+    double deadband;        // 0 keeps every change
+} change_opts_t;
+
+extern change_opts_t change_opts;
+
+/*
+ * Mark the samples of values to keep in keep, returns how many.
+ * last is the value last kept before them, NULL at the start of a series.
+ */
+size_t change_mask(const double *values, size_t n, double deadband,
+                   const double *last, unsigned char *keep);
+
+typedef struct change_state_s change_state_t;
+
+change_state_t *change_state_create(void);
+void change_state_free(change_state_t *state);
+
+/*
+ * Split a decoded block of a message into its signal series and
+ * hand the kept samples to append. Blocks of a message in time order.
+ * Returns 0 on success.
+ */
+int change_block(change_state_t *state, const frame_key_t *key,
+                 const msg_series_t *block,
+                 stream_append_f append, void *stream);
+
+/* Hand over the last samples held back, once all blocks are done. */
+int change_flush(change_state_t *state, stream_append_f append, void *stream);
+
+/* A decoded measurement as signal series, in a new hashtable. */
+struct hashtable *split_changes(struct hashtable *msg_hashmap);
+
+#endif /* CHANGES_H */
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "measurement.h"
+#include "hashtable_itr.h"
+#include "writer.h"
+#include "stats.h"
+#include "cta.h"
+
+// Writer for the cantools archive, the format is described in cta.h.
+//
+// Blocks go to the file as they are encoded while the index grows in
+// memory, it is written behind the blocks on close. Whole measurements
+// are written through the same stream, --chunk rows per block.
+//
+// Frame archives (.ctf) keep the raw payloads of every message instead
+// of decoded signals, for decoding again later with other DBCs.
+
+typedef struct {
+    cta_column_t col;
+    cta_block_t *blocks;
+    size_t cap;
+} cta_wcolumn_t;
+
+typedef struct {
+    FILE *fp;
+    uint64_t pos;
+    struct hashtable *index;  // frame_key_t -> series number
+    cta_series_t *series;
+    size_t n_series;
+    cta_wcolumn_t *columns;
+    size_t n_columns;
+    char *strings;
+    size_t strings_size;
+    unsigned char *scratch;
+    unsigned char *out;
+    size_t buf_rows;
+    int frames;               // store raw frames, not signals
+    int failed;
+} cta_stream_t;
+
+
+static void cta_write(cta_stream_t *cta, const void *data, size_t n)
+{
+    if (cta->failed || (n && fwrite(data, 1, n, cta->fp) != n))
+        cta->failed = 1;
+    cta->pos += n;
+    STATS_ADD(stat_bytes_written, n);
+}
+
+
+static void cta_align(cta_stream_t *cta)
+{
+    static const unsigned char zeros[8] = {0};
+    cta_write(cta, zeros, (8 - cta->pos % 8) % 8);
+}
+
+
+/* Offset of str in the string table, "" is at 0. */
+static uint32_t add_string(cta_stream_t *cta, const char *str)
+{
+    size_t len = str ? strlen(str) : 0;
+    if (len == 0)
+        return 0;
+
+    char *strings = realloc(cta->strings, cta->strings_size + len + 1);
+    if (!strings) {
+        cta->failed = 1;
+        return 0;
+    }
+    memcpy(strings + cta->strings_size, str, len + 1);
+    cta->strings = strings;
+    cta->strings_size += len + 1;
+    return cta->strings_size - len - 1;
+}
+
+
+static cta_wcolumn_t *add_column(cta_stream_t *cta, uint32_t series,
+                                 const char *name, const char *unit,
+                                 uint32_t type, uint32_t width)
+{
+    cta_wcolumn_t *columns = realloc(cta->columns,
+                                     (cta->n_columns + 1) * sizeof(cta_wcolumn_t));
+    if (!columns) {
+        cta->failed = 1;
+        return NULL;
+    }
+    cta->columns = columns;
+
+    cta_wcolumn_t *wc = &cta->columns[cta->n_columns++];
+    memset(wc, 0, sizeof(*wc));
+    wc->col.name = add_string(cta, name);
+    wc->col.unit = add_string(cta, unit);
+    wc->col.series = series;
+    wc->col.type = type;
+    wc->col.width = width;
+    return wc;
+}
+
+
+/* Series of the message, its columns are laid out on first sight. */
+static cta_series_t *find_series(cta_stream_t *cta, const frame_key_t *key,
+                                 const msg_series_t *msg)
+{
+    size_t *number = hashtable_search(cta->index, (void *) key);
+    if (number)
+        return &cta->series[*number];
+
+    cta_series_t *series = realloc(cta->series,
+                                   (cta->n_series + 1) * sizeof(cta_series_t));
+    frame_key_t *series_key = malloc(sizeof(frame_key_t));
+    number = malloc(sizeof(size_t));
+    if (series)
+        cta->series = series;
+    if (!series || !series_key || !number) {
+        free(series_key);
+        free(number);
+        cta->failed = 1;
+        return NULL;
+    }
+    *series_key = *key;
+    *number = cta->n_series++;
+    hashtable_insert(cta->index, series_key, number);
+
+    series = &cta->series[*number];
+    memset(series, 0, sizeof(*series));
+    series->id = key->id;
+    series->bus = key->bus;
+    series->name = add_string(cta, msg->name);
+    series->dbc = add_string(cta, msg->dbcname);
+    series->first_column = cta->n_columns;
+
+    // Time, then the payloads or the signals in DBC order.
+    add_column(cta, *number, "time", "s", CTA_TIME_NS, sizeof(int64_t));
+    if (cta->frames)
+        add_column(cta, *number, "frames", NULL, CTA_FRAME, msg->dlc);
+
+    signal_list_t *sl;
+    for (sl = cta->frames ? NULL : msg->spec->signal_list; sl != NULL; sl = sl->next) {
+        const signal_t *const sig = sl->signal;
+        int seen = 0;
+        for (size_t c = series->first_column; c < cta->n_columns; c++)
+            seen |= 0 == strcmp(cta->strings + cta->columns[c].col.name, sig->name);
+        if (seen || !hashtable_search(msg->ts_hash, sig->name))
+            continue;
+        if (writer_opts.single)
+            add_column(cta, *number, sig->name, sig->unit, CTA_F32, sizeof(float));
+        else
+            add_column(cta, *number, sig->name, sig->unit, CTA_F64, sizeof(double));
+    }
+    series->n_columns = cta->n_columns - series->first_column;
+    return series;
+}
+
+
+/* Encode and write one block of a column, and index it. */
+static void write_block(cta_stream_t *cta, cta_wcolumn_t *wc,
+                        const void *data, const double *time,
+                        size_t n, uint64_t first_row)
+{
+    const double *values = (const double *) data;
+
+    if (n > cta->buf_rows) {
+        size_t bound = cta_block_bound(n);
+        unsigned char *scratch = realloc(cta->scratch, bound);
+        if (scratch)
+            cta->scratch = scratch;
+        unsigned char *out = realloc(cta->out, bound);
+        if (out)
+            cta->out = out;
+        if (!scratch || !out) {
+            cta->failed = 1;
+            return;
+        }
+        cta->buf_rows = n;
+    }
+    if (wc->col.n_blocks == wc->cap) {
+        size_t cap = wc->cap ? 2 * wc->cap : 16;
+        cta_block_t *blocks = realloc(wc->blocks, cap * sizeof(cta_block_t));
+        if (!blocks) {
+            cta->failed = 1;
+            return;
+        }
+        wc->blocks = blocks;
+        wc->cap = cap;
+    }
+
+    cta_block_t *block = &wc->blocks[wc->col.n_blocks++];
+    memset(block, 0, sizeof(*block));
+    block->first_row = first_row;
+    block->n_rows = n;
+    block->min = block->max = NAN;
+    block->t0 = block->t1 = time[0];
+    for (size_t i = 0; i < n; i++) {
+        if (wc->col.type != CTA_FRAME && values[i] == values[i]) {
+            if (!(values[i] >= block->min))
+                block->min = values[i];
+            if (!(values[i] <= block->max))
+                block->max = values[i];
+        }
+        if (time[i] < block->t0)
+            block->t0 = time[i];
+        if (time[i] > block->t1)
+            block->t1 = time[i];
+    }
+
+    cta_align(cta);
+    block->offset = cta->pos;
+    if (wc->col.type == CTA_FRAME)
+        block->size = cta_frames_encode(writer_opts.level, data, n, wc->col.width,
+                                        cta->scratch, cta->out, &block->codec);
+    else
+        block->size = cta_block_encode(wc->col.type, writer_opts.level, values, n,
+                                       cta->scratch, cta->out, &block->codec);
+    cta_write(cta, cta->out, block->size);
+}
+
+
+static void *cta_stream_open(const char *outfile)
+{
+    cta_stream_t *cta = calloc(1, sizeof(cta_stream_t));
+    if (!cta)
+        return NULL;
+
+    cta->fp = fopen(outfile, "wb");
+    cta->index = create_hashtable(16, frame_key_hash, frame_key_equal);
+    cta->strings = calloc(1, 1);
+    cta->strings_size = 1;
+    if (!cta->fp || !cta->index || !cta->strings) {
+        if (cta->fp)
+            fclose(cta->fp);
+        if (cta->index)
+            hashtable_destroy(cta->index, 1);
+        free(cta->strings);
+        free(cta);
+        return NULL;
+    }
+
+    cta_header_t header = {CTA_MAGIC, CTA_VERSION, 0};
+    cta_write(cta, &header, sizeof(header));
+    return cta;
+}
+
+
+static int cta_stream_append(void *stream,
+                             const frame_key_t *key,
+                             const msg_series_t *msg)
+{
+    cta_stream_t *cta = (cta_stream_t *) stream;
+    cta_series_t *series = find_series(cta, key, msg);
+    if (!series)
+        return -1;
+
+    for (size_t start = 0; start < msg->n; start += writer_opts.chunk) {
+        size_t n = msg->n - start < writer_opts.chunk
+            ? msg->n - start : writer_opts.chunk;
+
+        for (size_t c = 0; c < series->n_columns; c++) {
+            cta_wcolumn_t *wc = &cta->columns[series->first_column + c];
+            const void *data;
+            if (c == 0) {
+                data = msg->time + start;
+            } else if (wc->col.type == CTA_FRAME) {
+                data = msg->data + start * msg->dlc;
+            } else {
+                const double *values = hashtable_search(msg->ts_hash,
+                                                        cta->strings + wc->col.name);
+                if (!values) {
+                    fprintf(stderr, "error: signal %s missing in %s\n",
+                            cta->strings + wc->col.name, msg->name);
+                    return -1;
+                }
+                data = values + start;
+            }
+            write_block(cta, wc, data, msg->time + start,
+                        n, series->n_rows + start);
+        }
+    }
+    series->n_rows += msg->n;
+    return cta->failed ? -1 : 0;
+}
+
+
+/* Write the index and the trailer, then free the stream. */
+static int cta_stream_close(void *stream)
+{
+    cta_stream_t *cta = (cta_stream_t *) stream;
+    cta_trailer_t trailer = {0};
+
+    // Pad the strings so that the trailer is aligned too.
+    size_t strings_size = (cta->strings_size + 7) / 8 * 8;
+    char *strings = realloc(cta->strings, strings_size);
+    if (strings) {
+        memset(strings + cta->strings_size, 0, strings_size - cta->strings_size);
+        cta->strings = strings;
+        cta->strings_size = strings_size;
+    } else {
+        cta->failed = 1;
+    }
+
+    cta_align(cta);
+    trailer.index_offset = cta->pos;
+    trailer.n_series = cta->n_series;
+    trailer.n_columns = cta->n_columns;
+    trailer.strings_size = cta->strings_size;
+    memcpy(trailer.magic, CTA_TRAILER_MAGIC, 8);
+
+    cta_write(cta, cta->series, cta->n_series * sizeof(cta_series_t));
+    for (size_t c = 0; c < cta->n_columns; c++) {
+        cta->columns[c].col.first_block = trailer.n_blocks;
+        trailer.n_blocks += cta->columns[c].col.n_blocks;
+        cta_write(cta, &cta->columns[c].col, sizeof(cta_column_t));
+    }
+    for (size_t c = 0; c < cta->n_columns; c++) {
+        cta_write(cta, cta->columns[c].blocks,
+                  cta->columns[c].col.n_blocks * sizeof(cta_block_t));
+    }
+    cta_write(cta, cta->strings, cta->strings_size);
+    cta_write(cta, &trailer, sizeof(trailer));
+
+    int ret = cta->failed ? -1 : 0;
+    if (fclose(cta->fp) != 0)
+        ret = -1;
+
+    for (size_t c = 0; c < cta->n_columns; c++)
+        free(cta->columns[c].blocks);
+    hashtable_destroy(cta->index, 1);
+    free(cta->columns);
+    free(cta->series);
+    free(cta->strings);
+    free(cta->scratch);
+    free(cta->out);
+    free(cta);
+    return ret;
+}
+
+
+static void *ctf_stream_open(const char *outfile)
+{
+    cta_stream_t *cta = cta_stream_open(outfile);
+    if (cta)
+        cta->frames = 1;
+    return cta;
+}
+
+
+static int write_archive(struct hashtable *msg_hash, const char *outfile,
+                         int frames)
+{
+    if (hashtable_count(msg_hash) == 0) {
+        fprintf(stderr, "error: measurement empty, nothing to write\n");
+        return 1;
+    }
+
+    void *stream = frames ? ctf_stream_open(outfile) : cta_stream_open(outfile);
+    if (!stream) {
+        fprintf(stderr, "error: could not open %s\n", outfile);
+        return 1;
+    }
+
+    int err = 0;
+    struct hashtable_itr *msg_itr = hashtable_iterator(msg_hash);
+    do {
+        frame_key_t *msg_key = hashtable_iterator_key(msg_itr);
+        msg_series_t *msg = hashtable_iterator_value(msg_itr);
+        if (frames ? msg->n == 0
+            : !msg->ts_hash || hashtable_count(msg->ts_hash) == 0)
+            continue;
+        err = cta_stream_append(stream, msg_key, msg);
+    } while (!err && hashtable_iterator_advance(msg_itr));
+    free(msg_itr);
+
+    if (cta_stream_close(stream) || err) {
+        fprintf(stderr, "error: could not write %s\n", outfile);
+        return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * write_cta - write all decoded messages to a cantools archive
+ */
+int write_cta(struct hashtable *msg_hash, const char *outfile)
+{
+    return write_archive(msg_hash, outfile, 0);
+}
+
+
+/*
+ * write_ctf - write the raw frames of all messages to a frame archive
+ */
+int write_ctf(struct hashtable *msg_hash, const char *outfile)
+{
+    return write_archive(msg_hash, outfile, 1);
+}
+
+
+// Export these formats so writer.c can use them.
+can_writer_t cta_writer = {
+    .name="cta",
+    .ext="cta",
+    .write_fcn=write_cta,
+    .open_fcn=cta_stream_open,
+    .append_fcn=cta_stream_append,
+    .close_fcn=cta_stream_close,
+};
+
+can_writer_t ctf_writer = {
+    .name="ctf",
+    .ext="ctf",
+    .write_fcn=write_ctf,
+    .open_fcn=ctf_stream_open,
+    .append_fcn=cta_stream_append,
+    .close_fcn=cta_stream_close,
+    .raw=1,
+};
@@ -1,13 +1,320 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
 #include "hdf5.h"
-#include "hdf5_hl.h"
 
 #include "measurement.h"
 #include "hashtable_itr.h"
 #include "writer.h"
+#include "stats.h"
 
-// https://support.hdfgroup.org/HDF5/doc/HL/RM_H5LT.html
+// https://support.hdfgroup.org/HDF5/doc/Advanced/Chunking/
+
+// Registered third party filters, used when the plugin is installed.
+// https://portal.hdfgroup.org/display/support/Filters
+#define H5Z_FILTER_LZ4  32004
+#define H5Z_FILTER_ZSTD 32015
+
+
+/*
+ * Dataset creation properties for a 1D dataset of n samples,
+ * chunked and compressed according to writer_opts.
+ * Extendible datasets are always chunked.
+ */
+static hid_t make_dcpl(hsize_t n, int extendible)
+{
+    static int codec_warned = 0;
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    if (dcpl < 0 || n == 0)
+        return dcpl;
+    if (writer_opts.level == 0 && !extendible)
+        return dcpl;
+
+    // Chunks may not be larger than a fixed size dataset.
+    hsize_t chunk = writer_opts.chunk < n ? writer_opts.chunk : n;
+    if (H5Pset_chunk(dcpl, 1, &chunk) < 0)
+        goto fail;
+
+    if (writer_opts.level == 0)
+        return dcpl;
+
+    // Byte shuffling makes slowly changing doubles far more compressible.
+    if (H5Pset_shuffle(dcpl) < 0)
+        goto fail;
+
+    unsigned int cd_values[1] = {writer_opts.level};
+    switch (writer_opts.codec) {
+    case codec_lz4:
+        if (H5Zfilter_avail(H5Z_FILTER_LZ4) > 0) {
+            cd_values[0] = 0; // default block size
+            if (H5Pset_filter(dcpl, H5Z_FILTER_LZ4, H5Z_FLAG_OPTIONAL,
+                              1, cd_values) < 0)
+                goto fail;
+            return dcpl;
+        }
+        break;
+    case codec_zstd:
+        if (H5Zfilter_avail(H5Z_FILTER_ZSTD) > 0) {
+            if (H5Pset_filter(dcpl, H5Z_FILTER_ZSTD, H5Z_FLAG_OPTIONAL,
+                              1, cd_values) < 0)
+                goto fail;
+            return dcpl;
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (writer_opts.codec != codec_deflate && !codec_warned) {
+        fprintf(stderr, "WARNING: HDF5 filter plugin not available, "
+                "using deflate instead.\n");
+        codec_warned = 1;
+    }
+    if (H5Pset_deflate(dcpl, writer_opts.level > 9 ? 9 : writer_opts.level) < 0)
+        goto fail;
+    return dcpl;
+
+fail:
+    H5Pclose(dcpl);
+    return -1;
+}
+
+
+/*
+ * Write n doubles as dataset name in loc, stored as file_type.
+ */
+static herr_t write_dataset(hid_t loc, const char *name,
+                            hid_t file_type, hid_t dcpl,
+                            hsize_t n, const double *data)
+{
+    herr_t err = -1;
+    hid_t space = H5Screate_simple(1, &n, NULL);
+    if (space < 0)
+        return -1;
+
+    hid_t dset = H5Dcreate(loc, name, file_type, space,
+                           H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    if (dset >= 0) {
+        // HDF5 converts from memory to file type during write.
+        err = H5Dwrite(dset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                       H5P_DEFAULT, data);
+        H5Dclose(dset);
+    }
+    H5Sclose(space);
+    return err;
+}
+
+
+#if H5_VERSION_GE(1,10,3)
+/*
+ * Parallel compression.
+ *
+ * HDF5 runs its filter pipeline on the calling thread only. With
+ * writer_opts.threads > 1 and deflate, write_h5 instead creates all
+ * datasets with the usual shuffle+deflate filters, compresses their
+ * chunks on a pool of threads exactly as those filters would, and
+ * hands the results to H5Dwrite_chunk in order. Readers see ordinary
+ * filtered datasets.
+ */
+
+typedef struct {
+    hid_t dset;
+    hsize_t offset;      // first sample of the chunk
+    const double *data;
+    size_t chunk;        // samples per chunk of dset, at most pool->chunk
+    size_t n;            // valid samples, the rest of the chunk is padding
+    size_t size;         // element size in the file, 4 or 8
+    int last;            // last chunk of dset, close it once written
+    unsigned char *zbuf;
+    uLongf zsize;        // 0 if compression failed
+    int done;
+} h5_chunk_t;
+
+typedef struct {
+    h5_chunk_t *chunks;
+    size_t n_chunks;
+    size_t cap;
+    size_t chunk;        // max samples per chunk, writer_opts.chunk
+    size_t next;         // next chunk to compress
+    size_t written;      // chunks handed to HDF5
+    size_t window;       // max chunks compressed ahead of writing
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} h5_pool_t;
+
+
+/* Only possible when the raw chunk layout matches what we produce. */
+static int can_write_chunks(void)
+{
+    return writer_opts.threads > 1
+        && writer_opts.level > 0
+        && writer_opts.codec == codec_deflate
+        && H5Tget_order(H5T_NATIVE_DOUBLE) == H5T_ORDER_LE;
+}
+
+
+/* Convert, shuffle and deflate one chunk, as the HDF5 filters would. */
+static void compress_chunk(h5_chunk_t *c,
+                           unsigned char *raw, unsigned char *shuffled)
+{
+    const size_t chunk = c->chunk;
+    const size_t bytes = chunk * c->size;
+
+    // Edge chunks are stored full size, pad with zeros.
+    if (c->size == sizeof(float)) {
+        float *f = (float *) raw;
+        for (size_t i = 0; i < c->n; i++)
+            f[i] = (float) c->data[i];
+    } else {
+        memcpy(raw, c->data, c->n * sizeof(double));
+    }
+    memset(raw + c->n * c->size, 0, bytes - c->n * c->size);
+
+    // Byte j of every element goes into the j:th plane.
+    for (size_t j = 0; j < c->size; j++) {
+        unsigned char *plane = shuffled + j * chunk;
+        for (size_t i = 0; i < chunk; i++)
+            plane[i] = raw[i * c->size + j];
+    }
+
+    c->zsize = compressBound(bytes);
+    c->zbuf = malloc(c->zsize);
+    if (!c->zbuf || compress2(c->zbuf, &c->zsize, shuffled, bytes,
+                              writer_opts.level > 9 ? 9 : writer_opts.level) != Z_OK)
+        c->zsize = 0;
+}
+
+
+static void *compress_worker(void *arg)
+{
+    h5_pool_t *pool = (h5_pool_t *) arg;
+    unsigned char *raw = malloc(pool->chunk * sizeof(double));
+    unsigned char *shuffled = malloc(pool->chunk * sizeof(double));
+
+    pthread_mutex_lock(&pool->lock);
+    if (!raw || !shuffled)
+        pool->failed = 1;
+    while (!pool->failed && pool->next < pool->n_chunks) {
+        if (pool->next >= pool->written + pool->window) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        h5_chunk_t *c = &pool->chunks[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+
+        compress_chunk(c, raw, shuffled);
+
+        pthread_mutex_lock(&pool->lock);
+        c->done = 1;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    free(raw);
+    free(shuffled);
+    return NULL;
+}
+
+
+/* Create dataset name in loc and queue its chunks for compression. */
+static herr_t queue_dataset(h5_pool_t *pool, hid_t loc, const char *name,
+                            hid_t file_type, hid_t dcpl,
+                            hsize_t n, const double *data)
+{
+    hid_t space = H5Screate_simple(1, &n, NULL);
+    if (space < 0)
+        return -1;
+    hid_t dset = H5Dcreate(loc, name, file_type, space,
+                           H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Sclose(space);
+    if (dset < 0)
+        return -1;
+
+    hsize_t chunk;
+    H5Pget_chunk(dcpl, 1, &chunk);
+    for (hsize_t offset = 0; offset < n; offset += chunk) {
+        if (pool->n_chunks == pool->cap) {
+            pool->cap = pool->cap ? 2 * pool->cap : 1024;
+            pool->chunks = realloc(pool->chunks,
+                                   pool->cap * sizeof(h5_chunk_t));
+            if (!pool->chunks) {
+                H5Dclose(dset);
+                return -1;
+            }
+        }
+        h5_chunk_t *c = &pool->chunks[pool->n_chunks++];
+        c->dset = dset;
+        c->offset = offset;
+        c->data = data + offset;
+        c->chunk = chunk;
+        c->n = n - offset < chunk ? n - offset : chunk;
+        c->size = H5Tget_size(file_type);
+        c->last = offset + chunk >= n;
+        c->zbuf = NULL;
+        c->zsize = 0;
+        c->done = 0;
+    }
+    return 0;
+}
+
+
+/* Compress all queued chunks on the pool, writing them in order. */
+static herr_t run_pool(h5_pool_t *pool)
+{
+    pthread_t *threads = malloc(writer_opts.threads * sizeof(pthread_t));
+    int n_threads = 0;
+    herr_t err = 0;
+
+    pool->window = 4 * writer_opts.threads;
+    for (int i = 0; threads && i < writer_opts.threads; i++) {
+        if (pthread_create(&threads[i], NULL, compress_worker, pool) == 0)
+            n_threads++;
+    }
+    if (n_threads == 0) {
+        pthread_mutex_lock(&pool->lock);
+        pool->failed = 1;
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    for (size_t i = 0; i < pool->n_chunks; i++) {
+        h5_chunk_t *c = &pool->chunks[i];
+
+        // Once failed, workers take no more chunks, but the ones they
+        // took are waited for before their buffers are freed.
+        pthread_mutex_lock(&pool->lock);
+        while (!c->done && (!pool->failed || i < pool->next))
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        const int done = c->done;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (done && c->zsize && err >= 0) {
+            err = H5Dwrite_chunk(c->dset, H5P_DEFAULT, 0, &c->offset,
+                                 c->zsize, c->zbuf);
+        } else {
+            err = -1;
+        }
+        free(c->zbuf);
+        if (c->last)
+            H5Dclose(c->dset);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->written++;
+        if (err < 0)
+            pool->failed = 1;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    for (int i = 0; i < n_threads; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    return err;
+}
+#endif
 
 
 /*
@@ -17,27 +324,52 @@ int write_h5(struct hashtable *msg_hash, const char *out_file)
 {
     herr_t err;
     int ret = -1;
+    const hid_t sig_type = writer_opts.single ? H5T_IEEE_F32LE : H5T_IEEE_F64LE;
     /* loop over all time series */
     if (hashtable_count(msg_hash) == 0) {
         fprintf(stderr, "error: measurement empty, nothing to write\n");
         return 1;
     }
 
+#if H5_VERSION_GE(1,10,3)
+    h5_pool_t pool_storage = {NULL, 0, 0, writer_opts.chunk, 0, 0, 0, 0,
+                              PTHREAD_MUTEX_INITIALIZER,
+                              PTHREAD_COND_INITIALIZER};
+    h5_pool_t *pool = can_write_chunks() ? &pool_storage : NULL;
+    int pool_ran = 0;
+#define STORE_DATASET(loc, name, type, dcpl, n, data)                   \
+    (pool ? queue_dataset(pool, loc, name, type, dcpl, n, data)         \
+          : write_dataset(loc, name, type, dcpl, n, data))
+#else
+#define STORE_DATASET write_dataset
+#endif
+    // Open until closed in the loop, closed at exit on failure.
+    hid_t h5_msg = -1;
+    hid_t dcpl = -1;
+    struct hashtable_itr *msg_itr = NULL;
+    struct hashtable_itr *sig_itr = NULL;
+
     hid_t h5_file = H5Fcreate(out_file, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
     if (h5_file < 0)
         goto exit;
 
     /* Iterator constructor only returns a valid iterator if
      * the hashtable is not empty */
-    struct hashtable_itr *msg_itr = hashtable_iterator(msg_hash);
+    msg_itr = hashtable_iterator(msg_hash);
     do {
         frame_key_t *msg_key = hashtable_iterator_key(msg_itr);
         msg_series_t *msg = hashtable_iterator_value(msg_itr);
         if (!msg->ts_hash || hashtable_count(msg->ts_hash) == 0)
             continue;
 
-        hid_t h5_msg = H5Gcreate(h5_file, msg->name,
-                                 H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if (H5Lexists(h5_file, msg->name, H5P_DEFAULT) > 0) {
+            fprintf(stderr, "error: several messages are named %s, "
+                    "0x%X on bus %u is one\n", msg->name, msg_key->id,
+                    msg_key->bus);
+            goto exit;
+        }
+        h5_msg = H5Gcreate(h5_file, msg->name,
+                           H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
         if (h5_msg < 0)
             goto exit;
 
@@ -46,40 +378,219 @@ int write_h5(struct hashtable *msg_hash, const char *out_file)
         // DBC name: msg->dbcname
 
         const hsize_t samples_in_msg = msg->n;
-        // Light interface, HDF5 space+data+write in one go!
-        err = H5LTmake_dataset_double(h5_msg, "__time", 1,
-                                      &samples_in_msg, msg->time);
+        dcpl = make_dcpl(samples_in_msg, 0);
+        if (dcpl < 0)
+            goto exit;
+
+        // Time always in double, float32 cannot resolve ms over a day.
+        err = STORE_DATASET(h5_msg, "__time", H5T_IEEE_F64LE, dcpl,
+                            samples_in_msg, msg->time);
         if (err < 0)
-            goto exit; //FIXME: This will leak stuff...
+            goto exit;
 
-        struct hashtable_itr *sig_itr = hashtable_iterator(msg->ts_hash);
+        sig_itr = hashtable_iterator(msg->ts_hash);
         do {
             char *signame = hashtable_iterator_key(sig_itr);
             double *sigdata = hashtable_iterator_value(sig_itr);
 
-            // Light interface, HDF5 space+data+write in one go!
-            err = H5LTmake_dataset_double(h5_msg, signame, 1,
-                                          &samples_in_msg, sigdata);
+            err = STORE_DATASET(h5_msg, signame, sig_type, dcpl,
+                                samples_in_msg, sigdata);
             if (err < 0)
                 goto exit;
 
         } while (hashtable_iterator_advance(sig_itr));
         free(sig_itr);
+        sig_itr = NULL;
+        H5Pclose(dcpl);
+        dcpl = -1;
         H5Gclose(h5_msg);
+        h5_msg = -1;
 
     } while (hashtable_iterator_advance(msg_itr));
     free(msg_itr);
+    msg_itr = NULL;
+
+#if H5_VERSION_GE(1,10,3)
+    pool_ran = 1;
+    if (pool && run_pool(pool) < 0)
+        goto exit;
+#endif
 
     ret = 0;
 exit:
-    if (h5_file > 0) H5Fclose(h5_file);
+#if H5_VERSION_GE(1,10,3)
+    // run_pool closes the datasets of all queued chunks.
+    for (size_t i = 0; !pool_ran && i < pool_storage.n_chunks; i++) {
+        if (pool_storage.chunks[i].last)
+            H5Dclose(pool_storage.chunks[i].dset);
+    }
+    free(pool_storage.chunks);
+#endif
+    free(sig_itr);
+    free(msg_itr);
+    if (dcpl >= 0) H5Pclose(dcpl);
+    if (h5_msg >= 0) H5Gclose(h5_msg);
+    if (h5_file >= 0 && H5Fclose(h5_file) < 0)
+        ret = -1;
+    if (ret == 0)
+        STATS_ADD(stat_bytes_written, stats_file_size(out_file));
     return ret;
 }
+#undef STORE_DATASET
+
+
+/*
+ * Append n doubles to the extendible dataset name in loc,
+ * creating it on the first block.
+ */
+static herr_t append_dataset(hid_t loc, const char *name,
+                             hid_t file_type,
+                             hsize_t n, const double *data)
+{
+    herr_t err = -1;
+    hsize_t offset = 0;
+    hid_t dset;
+
+    if (H5Lexists(loc, name, H5P_DEFAULT) > 0) {
+        dset = H5Dopen(loc, name, H5P_DEFAULT);
+        if (dset < 0)
+            return -1;
+
+        hid_t space = H5Dget_space(dset);
+        H5Sget_simple_extent_dims(space, &offset, NULL);
+        H5Sclose(space);
+
+        hsize_t size = offset + n;
+        if (H5Dset_extent(dset, &size) < 0)
+            goto exit;
+    } else {
+        // The first block decides the chunk size, so messages that
+        // only ever get one short block are not padded to a full chunk.
+        const hsize_t maxdims = H5S_UNLIMITED;
+        hid_t space = H5Screate_simple(1, &n, &maxdims);
+        hid_t dcpl = make_dcpl(n, 1);
+        dset = H5Dcreate(loc, name, file_type, space,
+                         H5P_DEFAULT, dcpl, H5P_DEFAULT);
+        H5Pclose(dcpl);
+        H5Sclose(space);
+        if (dset < 0)
+            return -1;
+    }
+
+    hid_t file_space = H5Dget_space(dset);
+    hid_t mem_space = H5Screate_simple(1, &n, NULL);
+    H5Sselect_hyperslab(file_space, H5S_SELECT_SET, &offset, NULL, &n, NULL);
+    err = H5Dwrite(dset, H5T_NATIVE_DOUBLE, mem_space, file_space,
+                   H5P_DEFAULT, data);
+    H5Sclose(mem_space);
+    H5Sclose(file_space);
+exit:
+    H5Dclose(dset);
+    return err;
+}
+
+
+/* open streaming output, one group per message kept open until close */
+typedef struct {
+    hid_t file;
+    struct hashtable *groups; // frame_key_t -> hid_t
+    char *path;
+} h5_stream_t;
+
+
+static void *h5_stream_open(const char *out_file)
+{
+    h5_stream_t *h5 = malloc(sizeof(h5_stream_t));
+    if (!h5)
+        return NULL;
+
+    h5->file = H5Fcreate(out_file, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (h5->file < 0) {
+        free(h5);
+        return NULL;
+    }
+    h5->groups = create_hashtable(16, frame_key_hash, frame_key_equal);
+    h5->path = strdup(out_file);
+    return h5;
+}
+
+
+static int h5_stream_append(void *stream,
+                            const frame_key_t *key,
+                            const msg_series_t *msg)
+{
+    h5_stream_t *h5 = (h5_stream_t *) stream;
+    const hid_t sig_type = writer_opts.single ? H5T_IEEE_F32LE : H5T_IEEE_F64LE;
+
+    hid_t *h5_msg = hashtable_search(h5->groups, (void *) key);
+    if (!h5_msg) {
+        if (H5Lexists(h5->file, msg->name, H5P_DEFAULT) > 0) {
+            fprintf(stderr, "error: several messages are named %s, "
+                    "0x%X on bus %u is one\n", msg->name, key->id, key->bus);
+            return -1;
+        }
+        hid_t group = H5Gcreate(h5->file, msg->name,
+                                H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if (group < 0)
+            return -1;
+
+        frame_key_t *group_key = malloc(sizeof(frame_key_t));
+        *group_key = *key;
+        h5_msg = malloc(sizeof(hid_t));
+        *h5_msg = group;
+        hashtable_insert(h5->groups, group_key, h5_msg);
+    }
+
+    if (append_dataset(*h5_msg, "__time", H5T_IEEE_F64LE,
+                       msg->n, msg->time) < 0)
+        return -1;
+
+    struct hashtable_itr *sig_itr = hashtable_iterator(msg->ts_hash);
+    do {
+        char *signame = hashtable_iterator_key(sig_itr);
+        double *sigdata = hashtable_iterator_value(sig_itr);
+
+        if (append_dataset(*h5_msg, signame, sig_type,
+                           msg->n, sigdata) < 0) {
+            free(sig_itr);
+            return -1;
+        }
+    } while (hashtable_iterator_advance(sig_itr));
+    free(sig_itr);
+
+    return 0;
+}
+
+
+static int h5_stream_close(void *stream)
+{
+    h5_stream_t *h5 = (h5_stream_t *) stream;
+
+    if (hashtable_count(h5->groups)) {
+        struct hashtable_itr *itr = hashtable_iterator(h5->groups);
+        do {
+            hid_t *group = hashtable_iterator_value(itr);
+            H5Gclose(*group);
+        } while (hashtable_iterator_advance(itr));
+        free(itr);
+    }
+    hashtable_destroy(h5->groups, 1);
+
+    herr_t err = H5Fclose(h5->file);
+    if (err >= 0)
+        STATS_ADD(stat_bytes_written, stats_file_size(h5->path));
+    free(h5->path);
+    free(h5);
+    return err < 0 ? -1 : 0;
+}
 
 
 // Export this format so writer.c can use it.
 can_writer_t hdf5_writer = {
     .name="hdf5",
     .ext="h5",
-    .write_fcn=write_h5
+    .write_fcn=write_h5,
+    .open_fcn=h5_stream_open,
+    .append_fcn=h5_stream_append,
+    .close_fcn=h5_stream_close,
 };
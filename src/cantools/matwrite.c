@@ -26,6 +26,7 @@
 #include "measurement.h"
 #include "hashtable_itr.h"
 #include "writer.h"
+#include "stats.h"
 
 // TODO: Use a "spec" struct instead. Also include function handle?
 const char *FIELD_NAMES[6] = {"bus", "dbc", "msg", "signal", "time", "data"};
@@ -73,10 +74,132 @@ static int count_signals(struct hashtable *msg_hash)
             continue;
         n += hashtable_count(msg->ts_hash);
     } while (hashtable_iterator_advance(msg_itr));
+    free(msg_itr);
     return n;
 }
 
 
+/* matio compression according to writer_opts */
+static enum matio_compression mat_compression(void)
+{
+    return writer_opts.level ? MAT_COMPRESSION_ZLIB : MAT_COMPRESSION_NONE;
+}
+
+
+/* set a 1 x size field of a scalar struct */
+static void set_in_struct(matvar_t *structvar,
+                          const char *fieldname,
+                          enum matio_classes class_type,
+                          enum matio_types data_type,
+                          size_t size,
+                          void *data,
+                          int opt)
+{
+    size_t dim[] = {1, size};
+    matvar_t *var = Mat_VarCreate(fieldname, class_type, data_type,
+                                  2, dim, data, opt);
+    Mat_VarSetStructFieldByName(structvar, fieldname, 0, var);
+}
+
+
+/*
+ * write_message_var - write one message as a struct variable named
+ * after the message, with fields bus, dbc, time and one per signal
+ */
+static int write_message_var(mat_t *matfile,
+                             frame_key_t *msg_key,
+                             msg_series_t *msg)
+{
+    static int clash_warned = 0;
+    const unsigned n_meta = 3;
+    unsigned n_fields = n_meta + hashtable_count(msg->ts_hash);
+    const char **fieldnames = malloc(n_fields * sizeof(char *));
+    if (!fieldnames)
+        return 1;
+
+    fieldnames[0] = "bus";
+    fieldnames[1] = "dbc";
+    fieldnames[2] = "time";
+
+    n_fields = n_meta;
+    struct hashtable_itr *sig_itr = hashtable_iterator(msg->ts_hash);
+    do {
+        char *signame = hashtable_iterator_key(sig_itr);
+        int clash = 0;
+        for (unsigned i = 0; i < n_meta; i++)
+            clash |= 0 == strcmp(signame, fieldnames[i]);
+        if (clash) {
+            if (!clash_warned) {
+                fprintf(stderr, "WARNING: Signal %s in %s clashes with a "
+                        "message field, skipping it and all such signals.\n",
+                        signame, msg->name);
+                clash_warned = 1;
+            }
+            continue;
+        }
+        fieldnames[n_fields++] = signame;
+    } while (hashtable_iterator_advance(sig_itr));
+    free(sig_itr);
+
+    size_t structdim[2] = {1, 1};
+    matvar_t *msgstruct = Mat_VarCreateStruct(msg->name, 2, structdim,
+                                              fieldnames, n_fields);
+    if (msgstruct == NULL) {
+        fprintf(stderr, "error: could not create MAT struct %s\n", msg->name);
+        free(fieldnames);
+        return 1;
+    }
+
+    set_in_struct(msgstruct, "bus", MAT_C_UINT8, MAT_T_UINT8,
+                  1, &msg_key->bus, 0);
+    set_in_struct(msgstruct, "dbc", MAT_C_CHAR, MAT_T_UTF8,
+                  strlen(msg->dbcname), msg->dbcname, 0);
+    set_in_struct(msgstruct, "time", MAT_C_DOUBLE, MAT_T_DOUBLE,
+                  msg->n, msg->time, MAT_F_DONT_COPY_DATA);
+    for (unsigned i = n_meta; i < n_fields; i++) {
+        set_in_struct(msgstruct, fieldnames[i], MAT_C_DOUBLE, MAT_T_DOUBLE,
+                      msg->n, hashtable_search(msg->ts_hash,
+                                               (void *) fieldnames[i]),
+                      MAT_F_DONT_COPY_DATA);
+    }
+
+    int err = Mat_VarWrite(matfile, msgstruct, mat_compression());
+    Mat_VarFree(msgstruct);
+    free(fieldnames);
+    return err != 0;
+}
+
+
+/*
+ * matWritePerMessage - write every message as a variable of its own,
+ * so single messages can be loaded and only one message is held in
+ * matio structures at a time
+ */
+static int matWritePerMessage(mat_t *matfile, struct hashtable *msg_hash)
+{
+    int ret = 0;
+    struct hashtable_itr *msg_itr = hashtable_iterator(msg_hash);
+    do {
+        frame_key_t *msg_key = hashtable_iterator_key(msg_itr);
+        msg_series_t *msg = hashtable_iterator_value(msg_itr);
+
+        if (!msg->ts_hash || hashtable_count(msg->ts_hash) == 0)
+            continue;
+
+        if (write_message_var(matfile, msg_key, msg)) {
+            fprintf(stderr, "error: could not write message %s\n",
+                    msg->name);
+            ret = 1;
+            break;
+        }
+    } while (hashtable_iterator_advance(msg_itr));
+    free(msg_itr);
+
+    Mat_Close(matfile);
+    return ret;
+}
+
+
 /*
  * matWrite - write signals from measurement structure to MAT file
  */
@@ -90,12 +213,21 @@ int matWrite(struct hashtable *msg_hash, const char *outFileName)
         return 1;
     }
 
-    mat_t *matfile = Mat_Create(outFileName, NULL);
+    enum mat_ft version = writer_opts.mat73 ? MAT_FT_MAT73 : MAT_FT_MAT5;
+    mat_t *matfile = Mat_CreateVer(outFileName, NULL, version);
     if (matfile == NULL) {
         fprintf(stderr, "error: could not create MAT file %s\n", outFileName);
+        if (writer_opts.mat73)
+            fprintf(stderr, "MAT v7.3 needs matio built with HDF5 support.\n");
         return 1;
     }
 
+    if (writer_opts.per_message) {
+        int ret = matWritePerMessage(matfile, msg_hash);
+        STATS_ADD(stat_bytes_written, stats_file_size(outFileName));
+        return ret;
+    }
+
     const char *fieldnames[6] = {"bus", "dbc", "msg", "signal", "time", "data"};
     size_t structdim[2] = {1, n_signals};
     matvar_t* topstruct = Mat_VarCreateStruct("data",
@@ -160,11 +292,12 @@ int matWrite(struct hashtable *msg_hash, const char *outFileName)
     } while (hashtable_iterator_advance(msg_itr));
     free(msg_itr);
 
-    Mat_VarWrite(matfile, topstruct, 0);
+    int err = Mat_VarWrite(matfile, topstruct, mat_compression());
     Mat_VarFree(topstruct);
     Mat_Close(matfile);
+    STATS_ADD(stat_bytes_written, stats_file_size(outFileName));
 
-    return 0;
+    return err != 0;
 }
 
 
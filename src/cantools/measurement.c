@@ -17,6 +17,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 #include "measurement.h"
 #include "busassignment.h"
 #include "messagehash.h"
@@ -24,6 +26,12 @@
 #include "hashtable_itr.h"
 #include "messagedecoder.h"
 #include "dbcmodel.h"
+#include "writer.h"
+#include "ctareader.h"
+#include "selection.h"
+#include "resample.h"
+#include "changes.h"
+#include "stats.h"
 
 
 /* simple string hash function for signal names */
@@ -44,37 +52,40 @@ static int string_equal(void *key1, void *key2 )
 }
 
 
-static unsigned int msg_hash(void *this)
+unsigned int frame_key_hash(void *this)
 {
     frame_key_t *frame_key_p = (frame_key_t *) this;
-    return frame_key_p->id;
+    return frame_key_p->id + 31 * frame_key_p->signal;
 }
 
 
-static int msg_equal(void *this, void *that)
+int frame_key_equal(void *this, void *that)
 {
     frame_key_t *this_p = (frame_key_t *) this;
     frame_key_t *that_p = (frame_key_t *) that;
 
-    return this_p->id == that_p->id && this_p->bus == that_p->bus;
+    return this_p->id == that_p->id && this_p->bus == that_p->bus
+        && this_p->signal == that_p->signal;
 }
 
 
 /*
- * callback function for processing a CAN message
+ * find the series of a CAN message, creating it if it is new
  */
-static void canframe_callback(canMessage_t *canMessage, void *cb_data)
+static msg_series_t *find_series(struct hashtable *msg_hashmap,
+                                 canMessage_t *canMessage,
+                                 int *created)
 {
-    struct hashtable *msg_hashmap = (struct hashtable *) cb_data;
-
     /* look for signal in time series hash */
-    frame_key_t frame_key = {canMessage->id, canMessage->bus};
+    frame_key_t frame_key = {.id = canMessage->id, .bus = canMessage->bus, .signal = 0};
     msg_series_t *msg_series_p = hashtable_search(msg_hashmap,
                                                   (void *) &frame_key);
+    *created = 0;
     if (!msg_series_p) {
         frame_key_t *frame_key_p = malloc(sizeof(frame_key_t));
         frame_key_p->id = canMessage->id;
         frame_key_p->bus = canMessage->bus;
+        frame_key_p->signal = 0;
 
         msg_series_p = malloc(sizeof(msg_series_t));
         msg_series_p->n = 0;
@@ -84,15 +95,57 @@ static void canframe_callback(canMessage_t *canMessage, void *cb_data)
         msg_series_p->dlc = canMessage->dlc;
         msg_series_p->name = NULL;
         msg_series_p->dbcname = NULL;
+        msg_series_p->spec = NULL;
         msg_series_p->ts_hash = NULL;
+        msg_series_p->skip = 0;
+        msg_series_p->unknown = 0;
+        msg_series_p->n_dropped = 0;
+        msg_series_p->n_mismatch = 0;
 
         hashtable_insert(msg_hashmap,
                          (void *) frame_key_p,
                          (void *) msg_series_p);
+        *created = 1;
+    }
+    return msg_series_p;
+}
+
+
+int64_t time_resolution = 0;
+int drop_unknown = 0;
+
+
+/* time in seconds, truncated to time_resolution */
+static double quantise_time(int64_t sec, int64_t nsec)
+{
+    if (time_resolution > 0) {
+        int64_t ns = sec * 1000000000 + nsec;
+        ns -= ns % time_resolution;
+        sec = ns / 1000000000;
+        nsec = ns % 1000000000;
     }
+    return sec + nsec * 1e-9;
+}
+
 
+/*
+ * append payload and time stamp of a CAN message to its series
+ *
+ * With a time resolution, a frame in the same time step as the one
+ * before replaces it, so time stamps never repeat.
+ */
+static void append_frame(msg_series_t *msg_series_p, canMessage_t *canMessage)
+{
     if (msg_series_p->dlc != canMessage->dlc) {
-        fprintf(stderr, "DLC MISMATCH!\n");
+        msg_series_p->n_mismatch++; // reported by account_frames
+        return;
+    }
+
+    double time = quantise_time(canMessage->t.tv_sec, canMessage->t.tv_nsec);
+    if (time_resolution > 0 && msg_series_p->n > 0
+        && msg_series_p->time[msg_series_p->n - 1] == time) {
+        memcpy(msg_series_p->data + (msg_series_p->n - 1) * msg_series_p->dlc,
+               canMessage->byte_arr, msg_series_p->dlc);
         return;
     }
 
@@ -106,22 +159,116 @@ static void canframe_callback(canMessage_t *canMessage, void *cb_data)
 
     memcpy(msg_series_p->data + msg_series_p->n * msg_series_p->dlc,
            canMessage->byte_arr, msg_series_p->dlc);
-
-    uint64_t sec = canMessage->t.tv_sec;
-    int64_t nsec = canMessage->t.tv_nsec;
-    msg_series_p->time[msg_series_p->n] = sec + nsec * 1e-9;
+    msg_series_p->time[msg_series_p->n] = time;
 
     msg_series_p->n++;
 }
 
 
+/*
+ * truncate the time stamps of a loaded series to time_resolution,
+ * keeping only the last frame of each time step
+ */
+static void quantise_series(msg_series_t *msg)
+{
+    unsigned int n = 0;
+
+    for (unsigned int i = 0; i < msg->n; i++) {
+        // Split off whole seconds first, so nanoseconds stay exact.
+        double sec = floor(msg->time[i]);
+        double time = quantise_time((int64_t) sec,
+                                    llround((msg->time[i] - sec) * 1e9));
+
+        if (n > 0 && msg->time[n - 1] == time)
+            n--;
+        msg->time[n] = time;
+        memmove(msg->data + n * msg->dlc, msg->data + i * msg->dlc, msg->dlc);
+        n++;
+    }
+    msg->n = n;
+}
+
+
+/*
+  Find the spec of a frame.
+  With preference for dbcs assigned to the frames bus specifically.
+*/
+static message_t *find_msg_spec(frame_key_t *key,
+                                busAssignment_t *bus_lib,
+                                char **dbcname_loc)
+{
+    message_t *match = NULL;
+    // Find match in dbc's explicitly set on this bus.
+    match = get_msg_spec(bus_lib, key->id, key->bus, dbcname_loc);
+    if (match)
+        return match;
+
+    // else find match in dbc that are used for any bus.
+    return get_msg_spec(bus_lib, key->id, -1, dbcname_loc);
+}
+
+
+/*
+ * decide for a new series whether its frames are kept,
+ * looking it up in the DBCs if the selection needs its name
+ * or signals, or unknown frames are dropped
+ */
+static void select_series(msg_series_t *msg, frame_key_t *frame_key,
+                          busAssignment_t *bus_lib,
+                          const selection_t *selection)
+{
+    message_t *spec = msg->spec;
+    char *dbcname;
+
+    if (!spec && bus_lib && (drop_unknown || selection_needs_spec(selection))) {
+        spec = find_msg_spec(frame_key, bus_lib, &dbcname);
+        msg->unknown = !spec;
+    }
+    msg->skip = (drop_unknown && msg->unknown)
+        || !selection_frame(selection, frame_key->bus, frame_key->id, spec)
+        || !selection_signals(selection, spec);
+}
+
+
+/* state of reading a whole measurement */
+typedef struct {
+    struct hashtable *msg_hashmap;
+    busAssignment_t *bus_lib;
+    const selection_t *selection;
+} read_state_t;
+
+
+/*
+ * callback function for processing a CAN message
+ */
+static void canframe_callback(canMessage_t *canMessage, void *cb_data)
+{
+    read_state_t *state = (read_state_t *) cb_data;
+    int created;
+
+    STATS_ADD(stat_frames, 1);
+    msg_series_t *msg = find_series(state->msg_hashmap, canMessage, &created);
+    if (created) {
+        frame_key_t frame_key = {.id = canMessage->id, .bus = canMessage->bus,
+                                 .signal = 0};
+        select_series(msg, &frame_key, state->bus_lib, state->selection);
+    }
+    if (!msg->skip)
+        append_frame(msg, canMessage);
+    else
+        msg->n_dropped++;
+}
+
+
 /*
  * process CAN trace file with given input parser
  *
  * If filename is NULL, uses stdin instead.
  */
 struct hashtable *read_messages(const char *filename,
-                                parserFunction_t parserFunction)
+                                parserFunction_t parserFunction,
+                                busAssignment_t *bus_lib,
+                                const selection_t *selection)
 {
     /* open input file */
     FILE *fp = filename ? fopen(filename, "rb") : stdin;
@@ -131,7 +278,10 @@ struct hashtable *read_messages(const char *filename,
     }
 
     // TODO: One hashmap for each channel to avoid collisions
-    struct hashtable *msg_hashmap = create_hashtable(16, msg_hash, msg_equal);
+    read_state_t state;
+    state.msg_hashmap = create_hashtable(16, frame_key_hash, frame_key_equal);
+    state.bus_lib = bus_lib;
+    state.selection = selection;
 
     /*
      * Invoke the file format parser on file pointer fp.
@@ -140,11 +290,81 @@ struct hashtable *read_messages(const char *filename,
      * file stream
      * One of: blfReader_processFile or friends...
      */
-    parserFunction(fp, canframe_callback, msg_hashmap);
+    STATS_START(t);
+    parserFunction(fp, canframe_callback, &state);
+    STATS_STOP(stat_read, t);
 
     if (filename != NULL)
         fclose(fp);
+    return state.msg_hashmap;
+}
+
+
+/*
+ * load the frames of a frame archive (.ctf) written by a raw writer
+ *
+ * Payloads and time stamps are decoded block by block straight into
+ * the series, there is no parsing of frames one at a time.
+ */
+struct hashtable *read_frame_archive(const char *filename,
+                                     busAssignment_t *bus_lib,
+                                     const selection_t *selection)
+{
+    STATS_START(t);
+    cta_t *cta = cta_open(filename);
+    if (!cta)
+        return NULL;
+
+    struct hashtable *msg_hashmap = create_hashtable(16, frame_key_hash, frame_key_equal);
+
+    for (uint32_t i = 0; i < cta->n_series; i++) {
+        const cta_series_t *series = &cta->series[i];
+        const uint32_t time_col = series->first_column;
+        const uint32_t frame_col = series->first_column + 1;
+        if (series->n_columns != 2
+            || cta->columns[frame_col].type != CTA_FRAME) {
+            fprintf(stderr, "%s is not a frame archive.\n", filename);
+            goto fail;
+        }
+
+        canMessage_t frame;
+        frame.id = series->id;
+        frame.bus = series->bus;
+        frame.dlc = cta->columns[frame_col].width;
+        int created;
+        msg_series_t *msg = find_series(msg_hashmap, &frame, &created);
+        if (!created || series->n_rows == 0) {
+            fprintf(stderr, "%s has a broken index.\n", filename);
+            goto fail;
+        }
+        frame_key_t frame_key = {.id = frame.id, .bus = frame.bus, .signal = 0};
+        select_series(msg, &frame_key, bus_lib, selection);
+        if (msg->skip)
+            continue;
+
+        msg->cap = series->n_rows;
+        msg->data = malloc(msg->dlc * msg->cap + 1);
+        msg->time = malloc(sizeof(double) * msg->cap);
+        if (!msg->data || !msg->time
+            || cta_read_column(cta, time_col, msg->time)
+            || cta_read_column(cta, frame_col, msg->data)) {
+            fprintf(stderr, "Reading frames of 0x%X failed.\n", series->id);
+            goto fail;
+        }
+        msg->n = series->n_rows;
+        STATS_ADD(stat_frames, msg->n);
+        if (time_resolution > 0)
+            quantise_series(msg);
+    }
+
+    cta_close(cta);
+    STATS_STOP(stat_read, t);
     return msg_hashmap;
+
+fail:
+    cta_close(cta);
+    destroy_messages(msg_hashmap);
+    return NULL;
 }
 
 
@@ -159,6 +379,7 @@ void destroy_messages(struct hashtable *msg_hashmap)
             msg_series_t *msg = hashtable_iterator_value(itr);
             free(msg->time);
             free(msg->data);
+            free(msg->name);
 
             if (msg->ts_hash)
                 hashtable_destroy(msg->ts_hash, 1);
@@ -171,22 +392,154 @@ void destroy_messages(struct hashtable *msg_hashmap)
 }
 
 
+void account_frames(struct hashtable *msg_hashmap, const char *filename)
+{
+    unsigned long long mismatched = 0;
+    unsigned int mismatched_ids = 0;
+
+    if (!msg_hashmap || !hashtable_count(msg_hashmap))
+        return;
+
+    struct hashtable_itr *itr = hashtable_iterator(msg_hashmap);
+    do {
+        frame_key_t *key = hashtable_iterator_key(itr);
+        msg_series_t *msg = hashtable_iterator_value(itr);
+        // Frames of unknown IDs are stored, or dropped as read.
+        uint64_t unknown = msg->unknown ? msg->n + msg->n_dropped : 0;
+        if (!unknown && !msg->n_mismatch)
+            continue;
+
+        STATS_ADD(stat_unknown_ids, unknown > 0);
+        STATS_ADD(stat_unknown_frames, unknown);
+        STATS_ADD(stat_dlc_mismatch, msg->n_mismatch);
+        if (stats.enabled)
+            stats_frames(key->bus, key->id, unknown, msg->n_mismatch);
+        mismatched += msg->n_mismatch;
+        mismatched_ids += msg->n_mismatch > 0;
+    } while (hashtable_iterator_advance(itr));
+    free(itr);
+
+    if (mismatched && !stats.enabled)
+        fprintf(stderr, "%s%sDropped %llu frames of %u IDs with a DLC other "
+                "than their first frame, see --stats.\n",
+                filename ? filename : "", filename ? ": " : "",
+                mismatched, mismatched_ids);
+}
+
+
 /*
-  Find the spec of a frame.
-  With preference for dbcs assigned to the frames bus specifically.
+  Name of the decoded frame.
+  Frames matched by J1939 PGN get the fields of their ID that differ
+  from the DBC message appended: priority, destination address of
+  PDU1 formats and source address, so their series stay apart.
 */
-static message_t *find_msg_spec(frame_key_t *key,
-                                busAssignment_t *bus_lib,
-                                char **dbcname_loc)
+static char *series_name(const message_t *spec, uint32_t id)
 {
-    message_t *match = NULL;
-    // Find match in dbc's explicitly set on this bus.
-    match = get_msg_spec(bus_lib, key->id, key->bus, dbcname_loc);
-    if (match)
-        return match;
+    const uint32_t diff = spec->id ^ id;
+    char suffix[sizeof("_P0_DA00_SA00")];
+    int len = 0;
+
+    if (diff & 0x1C000000)
+        len += sprintf(suffix + len, "_P%u", (unsigned) (id >> 26) & 0x7);
+    if ((diff & 0x0000FF00) && ((id >> 16) & 0xFF) < 240)
+        len += sprintf(suffix + len, "_DA%02X", (unsigned) (id >> 8) & 0xFF);
+    if (diff & 0x000000FF)
+        len += sprintf(suffix + len, "_SA%02X", (unsigned) id & 0xFF);
+    if (!len)
+        return strdup(spec->name);
+
+    char *name = malloc(strlen(spec->name) + len + 1);
+    sprintf(name, "%s%s", spec->name, suffix);
+    return name;
+}
 
-    // else find match in dbc that are used for any bus.
-    return get_msg_spec(bus_lib, key->id, -1, dbcname_loc);
+
+/*
+  Claims the name of a decoded series in names, keyed by bus and name.
+  Series of one bus with the same name could not be told apart in the
+  output, so a second one is an error.
+  Returns -1 on a clash, 0 otherwise.
+*/
+static int claim_name(struct hashtable *names, const frame_key_t *key,
+                      const msg_series_t *msg)
+{
+    size_t len = strlen(msg->name) + sizeof("255/");
+    char *name = malloc(len);
+    snprintf(name, len, "%u/%s", key->bus, msg->name);
+
+    const frame_key_t *other = hashtable_search(names, name);
+    if (other) {
+        fprintf(stderr, "error: 0x%X and 0x%X on bus %u are both decoded "
+                "as %s.\n", other->id, key->id, key->bus, msg->name);
+        free(name);
+        return -1;
+    }
+    frame_key_t *claimed = malloc(sizeof(frame_key_t));
+    *claimed = *key;
+    hashtable_insert(names, name, claimed);
+    return 0;
+}
+
+
+/*
+  Warns, once per run, about a signal name used twice in spec.
+  decode_series keeps the first of them. Called from the reading
+  thread only, decoders may run on several.
+*/
+static void warn_duplicate_signals(const message_t *spec)
+{
+    static int already_defined_warn = 0;
+
+    for (signal_list_t *sl = spec->signal_list;
+         sl && !already_defined_warn; sl = sl->next) {
+        for (signal_list_t *prev = spec->signal_list; prev != sl;
+             prev = prev->next) {
+            if (strcmp(prev->signal->name, sl->signal->name) == 0) {
+                fprintf(stderr, "WARNING! Signal %s already exists!\n"
+                        "Signalname used more than once in the same msg?\n"
+                        "Skipping this and all future duplicates!\n",
+                        sl->signal->name);
+                already_defined_warn = 1;
+                break;
+            }
+        }
+    }
+}
+
+
+/*
+  Decodes all signals of msg according to spec into a new ts_hash.
+  Returns the number of signals decoded.
+*/
+static int decode_series(msg_series_t *msg, const message_t *spec,
+                         const selection_t *selection)
+{
+    int count = 0;
+    STATS_START(t);
+
+    msg->ts_hash = create_hashtable(16, string_hash, string_equal);
+
+    signal_list_t *sl;
+    for (sl = spec->signal_list; sl != NULL; sl = sl->next) {
+        const signal_t *const sig = sl->signal;
+
+        if (hashtable_search(msg->ts_hash, sig->name))
+            continue; // see warn_duplicate_signals
+        if (!selection_signal(selection, spec, sig->name))
+            continue;
+
+        double *data = signal_decode(sig, msg->data, msg->dlc, msg->n);
+        if (data) {
+            hashtable_insert(msg->ts_hash,
+                             (void *) strdup(sig->name),
+                             (void *) data);
+            count++;
+        }
+    }
+    STATS_STOP(stat_decode, t);
+    STATS_ADD(stat_signals, count);
+    STATS_ADD(stat_values, (uint64_t) count * msg->n);
+    return count;
 }
 
 
@@ -195,53 +548,465 @@ static message_t *find_msg_spec(frame_key_t *key,
   Populates the dbcname and ts_hash fields of each member.
   Returns -1 on failure, otherwise the number of signals decoded.
 */
-int can_decode(struct hashtable *msg_hashmap, busAssignment_t *bus_lib)
+int can_decode(struct hashtable *msg_hashmap, busAssignment_t *bus_lib,
+               const selection_t *selection)
 {
     int count = 0;
-    static int already_defined_warn = 0;
     if (!msg_hashmap || !hashtable_count(msg_hashmap))
         return -1;
 
+    struct hashtable *names = create_hashtable(16, string_hash, string_equal);
     struct hashtable_itr *itr = hashtable_iterator(msg_hashmap);
     do {
         frame_key_t *frame_key = hashtable_iterator_key(itr);
         msg_series_t *msg = hashtable_iterator_value(itr);
+        if (msg->skip)
+            continue;
 
-
-        message_t *msg_spec = find_msg_spec(frame_key,
-                                            bus_lib,
-                                            &msg->dbcname);
-        if (!msg_spec)
+        msg->spec = find_msg_spec(frame_key, bus_lib, &msg->dbcname);
+        if (!msg->spec) {
+            msg->unknown = 1;
             continue; // Decode not possible
+        }
 
-        msg->name = msg_spec->name;
-        msg->ts_hash = create_hashtable(16, string_hash, string_equal);
+        msg->name = series_name(msg->spec, frame_key->id);
+        if (claim_name(names, frame_key, msg)) {
+            count = -1;
+            break;
+        }
+        warn_duplicate_signals(msg->spec);
+        count += decode_series(msg, msg->spec, selection);
+    } while (hashtable_iterator_advance(itr));
+    free(itr);
+    hashtable_destroy(names, 1);
+
+    return count;
+}
 
-        signal_list_t *sl;
-        for (sl = msg_spec->signal_list; sl != NULL; sl = sl->next) {
-            const signal_t *const spec = sl->signal;
 
-            if (hashtable_search(msg->ts_hash, spec->name)) {
-                if (!already_defined_warn) {
-                    fprintf(stderr, "WARNING! Signal %s already exists!\n"
-                            "Signalname used more than once in the same msg?\n"
-                            "Skipping this and all future duplicates!",
-                            spec->name);
-                    already_defined_warn = 1;
-                }
-                continue;
+/*
+  Streaming conversion runs as a pipeline of three stages:
+
+    reader --> decoders --> writer
+
+  The parser runs on the calling thread and cuts the frames of every
+  message into blocks of writer_opts.chunk frames. Full blocks are
+  decoded on a pool of threads and appended in the order they were cut
+  by a single writer thread, so reading, decoding and writing overlap.
+  At most window blocks are in flight, a full pipeline stalls the
+  reader, which bounds memory.
+*/
+
+/* a block of one message on its way from reader to writer */
+typedef struct stream_block_t {
+    frame_key_t key;
+    msg_series_t msg;    // owns data, time and ts_hash of the block
+    int decoded;
+    struct stream_block_t *next;
+} stream_block_t;
+
+/* state of a streaming conversion */
+typedef struct {
+    struct hashtable *msg_hashmap;
+    busAssignment_t *bus_lib;
+    const selection_t *selection;
+    can_writer_t *writer;
+    void *stream;
+    unsigned int block;
+    int failed;
+    struct hashtable *names;    // of decoded series, see claim_name
+
+    stream_block_t *queue;      // cut, waiting for a decoder
+    stream_block_t *queue_tail;
+    stream_block_t **slots;     // in flight, by sequence number
+    size_t window;
+    unsigned long cut;          // blocks handed over by the reader
+    unsigned long written;      // blocks done by the writer
+    int reading;
+    resampler_t *resamplers[RESAMPLE_MAX_GRIDS];
+    int n_resamplers;
+    change_state_t *changes;    // change-only output, writer thread only
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} stream_state_t;
+
+
+/* Pass a block on to the decoders, waiting while the pipeline is full. */
+static void queue_block(stream_state_t *state, stream_block_t *b)
+{
+    pthread_mutex_lock(&state->lock);
+    while (state->cut - state->written >= state->window)
+        pthread_cond_wait(&state->cond, &state->lock);
+    state->slots[state->cut++ % state->window] = b;
+    if (state->queue_tail)
+        state->queue_tail->next = b;
+    else
+        state->queue = b;
+    state->queue_tail = b;
+    pthread_cond_broadcast(&state->cond);
+    pthread_mutex_unlock(&state->lock);
+}
+
+
+static stream_block_t *new_block(stream_state_t *state,
+                                 const frame_key_t *frame_key,
+                                 const msg_series_t *msg)
+{
+    stream_block_t *b = malloc(sizeof(stream_block_t));
+    if (!b) {
+        pthread_mutex_lock(&state->lock);
+        state->failed = 1;
+        pthread_mutex_unlock(&state->lock);
+        return NULL;
+    }
+    b->key = *frame_key;
+    b->msg = *msg;
+    b->decoded = 0;
+    b->next = NULL;
+    return b;
+}
+
+
+/*
+  Hand the buffered frames of msg to the decoders.
+  The series gets fresh buffers for its next block. With keep_last
+  its last frame stays behind, later frames of the same time step
+  can still replace it.
+*/
+static void flush_series(stream_state_t *state,
+                         const frame_key_t *frame_key,
+                         msg_series_t *msg, int keep_last)
+{
+    if (msg->n <= (keep_last ? 1u : 0u))
+        return;
+
+    stream_block_t *b = new_block(state, frame_key, msg);
+    msg->n = 0;
+    if (!b)
+        return;
+
+    msg->cap = state->block + 1;
+    msg->data = malloc(msg->dlc * msg->cap + 1);
+    msg->time = malloc(sizeof(double) * msg->cap);
+    if (!msg->data || !msg->time) {
+        msg->cap = 0; // append_frame grows them again
+    } else if (keep_last) {
+        b->msg.n--;
+        memcpy(msg->data, b->msg.data + b->msg.n * msg->dlc, msg->dlc);
+        msg->time[0] = b->msg.time[b->msg.n];
+        msg->n = 1;
+    }
+
+    queue_block(state, b);
+}
+
+
+/*
+  Tell the resamplers about a new message with an empty block,
+  so they wait for its first samples before starting output.
+*/
+static void announce_series(stream_state_t *state,
+                            const frame_key_t *frame_key,
+                            const msg_series_t *msg)
+{
+    stream_block_t *b = new_block(state, frame_key, msg);
+    if (!b)
+        return;
+    b->msg.n = 0;
+    b->msg.cap = 0;
+    b->msg.data = NULL;
+    b->msg.time = NULL;
+    queue_block(state, b);
+}
+
+
+/*
+  Feed a decoded block to the resamplers and write the grid rows
+  it completes, all remaining rows for a NULL block.
+  Returns non-zero on failure.
+*/
+static int resample_block(stream_state_t *state, const stream_block_t *b)
+{
+    for (int g = 0; g < state->n_resamplers; g++) {
+        resampler_t *r = state->resamplers[g];
+        if (b && resampler_push(r, &b->key, &b->msg))
+            return 1;
+
+        frame_key_t key;
+        const msg_series_t *out;
+        while ((out = resampler_pull(r, b == NULL, state->block, &key))) {
+            if (state->writer->append_fcn(state->stream, &key, out) != 0) {
+                fprintf(stderr, "Writing block of %s failed.\n", out->name);
+                return 1;
             }
+        }
+        if (resampler_failed(r))
+            return 1;
+    }
+    return 0;
+}
+
 
-            double *data = signal_decode(spec, msg->data, msg->dlc, msg->n);
-            if (data) {
-                hashtable_insert(msg->ts_hash,
-                                 (void *) strdup(spec->name),
-                                 (void *) data);
-                count++;
+static void free_block(stream_block_t *b)
+{
+    if (b->msg.ts_hash)
+        hashtable_destroy(b->msg.ts_hash, 1);
+    free(b->msg.data);
+    free(b->msg.time);
+    free(b);
+}
+
+
+static void *decode_worker(void *arg)
+{
+    stream_state_t *state = (stream_state_t *) arg;
+
+    pthread_mutex_lock(&state->lock);
+    while (state->queue || state->reading) {
+        stream_block_t *b = state->queue;
+        if (!b) {
+            pthread_cond_wait(&state->cond, &state->lock);
+            continue;
+        }
+        state->queue = b->next;
+        if (!state->queue)
+            state->queue_tail = NULL;
+        pthread_mutex_unlock(&state->lock);
+
+        if (!state->writer->raw && b->msg.n > 0)
+            decode_series(&b->msg, b->msg.spec, state->selection);
+
+        pthread_mutex_lock(&state->lock);
+        b->decoded = 1;
+        pthread_cond_broadcast(&state->cond);
+    }
+    pthread_mutex_unlock(&state->lock);
+    return NULL;
+}
+
+
+static void *write_worker(void *arg)
+{
+    stream_state_t *state = (stream_state_t *) arg;
+
+    pthread_mutex_lock(&state->lock);
+    while (state->written < state->cut || state->reading) {
+        stream_block_t *b = state->written < state->cut
+            ? state->slots[state->written % state->window] : NULL;
+        if (!b || !b->decoded) {
+            pthread_cond_wait(&state->cond, &state->lock);
+            continue;
+        }
+        int failed = state->failed;
+        pthread_mutex_unlock(&state->lock);
+        STATS_START(t);
+
+        // Blocks without any decoded signal are dropped.
+        if (!failed && state->n_resamplers) {
+            failed = resample_block(state, b);
+        } else if (!failed && state->changes) {
+            failed = change_block(state->changes, &b->key, &b->msg,
+                                  state->writer->append_fcn, state->stream);
+            if (failed)
+                fprintf(stderr, "Writing block of 0x%X failed.\n", b->key.id);
+        } else if (!failed && (state->writer->raw
+                        || (b->msg.ts_hash && hashtable_count(b->msg.ts_hash)))
+            && state->writer->append_fcn(state->stream, &b->key, &b->msg) != 0) {
+            fprintf(stderr, "Writing block of 0x%X failed.\n", b->key.id);
+            failed = 1;
+        }
+        STATS_STOP(stat_write, t);
+        free_block(b);
+
+        pthread_mutex_lock(&state->lock);
+        if (failed)
+            state->failed = 1;
+        state->written++;
+        pthread_cond_broadcast(&state->cond);
+    }
+    pthread_mutex_unlock(&state->lock);
+    return NULL;
+}
+
+
+/*
+ * callback function for streaming a CAN message
+ *
+ * Frames are resolved against the DBCs when first seen, so frames
+ * that can not be decoded or are not selected are never buffered.
+ * Raw writers get all selected frames.
+ */
+static void stream_callback(canMessage_t *canMessage, void *cb_data)
+{
+    stream_state_t *state = (stream_state_t *) cb_data;
+    frame_key_t frame_key = {.id = canMessage->id, .bus = canMessage->bus, .signal = 0};
+    int created;
+
+    STATS_ADD(stat_frames, 1);
+    msg_series_t *msg = find_series(state->msg_hashmap, canMessage, &created);
+    if (created) {
+        if (!state->writer->raw) {
+            msg->spec = find_msg_spec(&frame_key, state->bus_lib, &msg->dbcname);
+            if (msg->spec) {
+                msg->name = series_name(msg->spec, frame_key.id);
+                if (claim_name(state->names, &frame_key, msg)) {
+                    pthread_mutex_lock(&state->lock);
+                    state->failed = 1;
+                    pthread_mutex_unlock(&state->lock);
+                    msg->spec = NULL;
+                } else {
+                    warn_duplicate_signals(msg->spec);
+                }
+            } else {
+                msg->unknown = 1;
             }
         }
-    } while (hashtable_iterator_advance(itr));
-    free(itr);
+        select_series(msg, &frame_key, state->bus_lib, state->selection);
+        if (state->n_resamplers && msg->spec && !msg->skip)
+            announce_series(state, &frame_key, msg);
+    }
+    if (msg->skip || (!msg->spec && !state->writer->raw)) {
+        msg->n_dropped++;
+        return;
+    }
 
-    return count;
+    append_frame(msg, canMessage);
+    if (time_resolution > 0 ? msg->n > state->block : msg->n >= state->block)
+        flush_series(state, &frame_key, msg, time_resolution > 0);
+}
+
+
+/*
+  Reads, decodes and writes a CAN trace file in blocks of
+  writer_opts.chunk frames per message, so the whole measurement
+  never has to fit in memory. Decoding runs on writer_opts.threads
+  threads, writing on one more. With resample_opts set, only the
+  grids are written.
+  Returns -1 on failure, 0 otherwise.
+*/
+int stream_messages(const char *filename,
+                    parserFunction_t parserFunction,
+                    busAssignment_t *bus_lib,
+                    const selection_t *selection,
+                    can_writer_t *writer,
+                    const char *outfile)
+{
+    if (!writer->open_fcn) {
+        fprintf(stderr, "Output format %s cannot be streamed.\n",
+                writer->name);
+        return -1;
+    }
+
+    FILE *fp = filename ? fopen(filename, "rb") : stdin;
+    if (!fp) {
+        fprintf(stderr, "Opening input file failed.\n");
+        return -1;
+    }
+
+    const int n_decoders = writer_opts.threads > 1 ? writer_opts.threads : 1;
+    pthread_t *decoders = malloc(n_decoders * sizeof(pthread_t));
+    pthread_t writer_thread;
+    int n_started = 0;
+    int writing = 0;
+
+    stream_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.msg_hashmap = create_hashtable(16, frame_key_hash, frame_key_equal);
+    state.names = create_hashtable(16, string_hash, string_equal);
+    state.bus_lib = bus_lib;
+    state.selection = selection;
+    state.writer = writer;
+    state.block = writer_opts.chunk;
+    state.window = 4 * n_decoders + 4;
+    state.slots = malloc(state.window * sizeof(stream_block_t *));
+    state.reading = 1;
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.cond, NULL);
+    if (!decoders || !state.slots) {
+        state.failed = 1;
+        goto exit;
+    }
+    for (int g = 0; g < resample_opts.n_grids && !writer->raw; g++) {
+        state.resamplers[g] = resampler_create(&resample_opts.grids[g], g);
+        if (!state.resamplers[g]) {
+            state.failed = 1;
+            goto exit;
+        }
+        state.n_resamplers++;
+    }
+    if (change_opts.enabled && !writer->raw) {
+        state.changes = change_state_create();
+        if (!state.changes) {
+            state.failed = 1;
+            goto exit;
+        }
+    }
+
+    state.stream = writer->open_fcn(outfile);
+    if (!state.stream) {
+        fprintf(stderr, "Opening output file failed.\n");
+        state.failed = 1;
+        goto exit;
+    }
+
+    for (int i = 0; i < n_decoders; i++) {
+        if (pthread_create(&decoders[i], NULL, decode_worker, &state) == 0)
+            n_started++;
+    }
+    writing = pthread_create(&writer_thread, NULL, write_worker, &state) == 0;
+    if (n_started == 0 || !writing) {
+        fprintf(stderr, "Starting the pipeline failed.\n");
+        state.failed = 1;
+    } else {
+        STATS_START(t);
+        parserFunction(fp, stream_callback, &state);
+        STATS_STOP(stat_read, t);
+
+        /* flush remaining partial blocks */
+        if (hashtable_count(state.msg_hashmap)) {
+            struct hashtable_itr *itr = hashtable_iterator(state.msg_hashmap);
+            do {
+                flush_series(&state,
+                             hashtable_iterator_key(itr),
+                             hashtable_iterator_value(itr), 0);
+            } while (hashtable_iterator_advance(itr));
+            free(itr);
+        }
+    }
+
+    pthread_mutex_lock(&state.lock);
+    state.reading = 0;
+    pthread_cond_broadcast(&state.cond);
+    pthread_mutex_unlock(&state.lock);
+
+    for (int i = 0; i < n_started; i++)
+        pthread_join(decoders[i], NULL);
+    if (writing)
+        pthread_join(writer_thread, NULL);
+
+    STATS_START(t);
+    if (!state.failed && state.n_resamplers && resample_block(&state, NULL))
+        state.failed = 1;
+    if (!state.failed && state.changes
+        && change_flush(state.changes, writer->append_fcn, state.stream))
+        state.failed = 1;
+
+    if (writer->close_fcn(state.stream) != 0)
+        state.failed = 1;
+    STATS_STOP(stat_write, t);
+
+exit:
+    if (filename != NULL)
+        fclose(fp);
+    account_frames(state.msg_hashmap, filename);
+    destroy_messages(state.msg_hashmap);
+    hashtable_destroy(state.names, 1);
+    pthread_mutex_destroy(&state.lock);
+    pthread_cond_destroy(&state.cond);
+    for (int g = 0; g < state.n_resamplers; g++)
+        resampler_free(state.resamplers[g]);
+    change_state_free(state.changes);
+    free(state.slots);
+    free(decoders);
+    return state.failed ? -1 : 0;
 }
@@ -43,6 +43,7 @@ typedef struct {
 typedef struct {
     uint32_t id;
     uint8_t bus;
+    uint16_t signal; // 1 based, for series of one signal split off a frame
 } frame_key_t;
 
 typedef struct {
@@ -53,9 +54,23 @@ typedef struct {
     unsigned int dlc;
     char *name;
     char *dbcname;
+    message_t *spec; // DBC message, NULL until resolved
     struct hashtable *ts_hash; // name -> double * of n values
+    int skip; // not selected, its frames are dropped
+    int unknown; // no DBC message matches
+    unsigned int n_dropped; // frames not stored, skipped or unknown
+    unsigned int n_mismatch; // frames dropped, DLC differs from the first
 } msg_series_t;
 
+struct can_writer_t;
+struct selection_s;
+
+
+/* time stamps are truncated to multiples of this many ns, 0 keeps them */
+extern int64_t time_resolution;
+
+/* frames without a DBC message are dropped as they are read */
+extern int drop_unknown;
 
 /* message received callback function */
 typedef void (* msgRxCb_t)(canMessage_t *message, void *cbData);
@@ -63,10 +78,39 @@ typedef void (* msgRxCb_t)(canMessage_t *message, void *cbData);
 /* parsing callback function */
 typedef void (* parserFunction_t)(FILE *fp, msgRxCb_t msgRxCb, void *cbData);
 
+/*
+ * The selection, NULL for all, is applied as frames come in,
+ * frames not selected are never stored and signals not selected
+ * never decoded. bus_lib is needed when it matches message names.
+ */
 struct hashtable *read_messages(const char *filename,
-                                parserFunction_t parserFunction);
+                                parserFunction_t parserFunction,
+                                busAssignment_t *bus_lib,
+                                const struct selection_s *selection);
+struct hashtable *read_frame_archive(const char *filename,
+                                     busAssignment_t *bus_lib,
+                                     const struct selection_s *selection);
 void destroy_messages(struct hashtable *can_hashmap);
 
-int can_decode(struct hashtable *can_hashmap, busAssignment_t *bus_lib);
+/*
+ * Account the frames of unknown IDs and with a mismatching DLC per bus
+ * and ID, to the statistics or as a single warning without them.
+ * The warning names filename, the input, unless NULL.
+ */
+void account_frames(struct hashtable *can_hashmap, const char *filename);
+
+int can_decode(struct hashtable *can_hashmap, busAssignment_t *bus_lib,
+               const struct selection_s *selection);
+
+int stream_messages(const char *filename,
+                    parserFunction_t parserFunction,
+                    busAssignment_t *bus_lib,
+                    const struct selection_s *selection,
+                    struct can_writer_t *writer,
+                    const char *outfile);
+
+/* hashtable functions for frame_key_t keys */
+unsigned int frame_key_hash(void *key);
+int frame_key_equal(void *key1, void *key2);
 
 #endif
@@ -62,6 +62,31 @@ static int canids_equal(void *key1p, void *key2p)
     return eq;
 }
 
+/*
+ * J1939 Parameter Group Number of an extended CAN ID.
+ * For PDU1 formats (PF < 240) the PDU specific field holds the
+ * destination address, which is not part of the PGN either.
+ */
+uint32 messageHash_pgn(uint32 canid)
+{
+    uint32 pgn = (canid & mask_pgn) >> 8;
+    if (((canid & mask_pf) >> 16) < 240) {
+        pgn &= (mask_res | mask_dp | mask_pf) >> 8;
+    }
+    return pgn;
+}
+
+/* hash function for PGNs, which already are small and unique */
+static unsigned int hash_from_pgn(void *keyp)
+{
+    return *(messageHashKey_t *)keyp;
+}
+
+static int pgns_equal(void *key1p, void *key2p)
+{
+    return *(messageHashKey_t *)key1p == *(messageHashKey_t *)key2p;
+}
+
 struct hashtable *messageHash_create(message_list_t *message_list)
 {
     struct hashtable *h;
@@ -89,6 +114,64 @@ struct hashtable *messageHash_create(message_list_t *message_list)
     return h;
 }
 
+/*
+ * Index the extended messages of a message hash by J1939 PGN.
+ *
+ * The returned hash borrows its messages from h, which was created
+ * from message_list, and must be released with messageHash_freePGN
+ * before h is freed. If the DBC defines the same PGN for several
+ * source addresses, the first definition in message_list becomes the
+ * default for all other source addresses.
+ */
+struct hashtable *messageHash_createPGN(messageHash_t *const h,
+                                        message_list_t *message_list)
+{
+    struct hashtable *pgnHash;
+
+    pgnHash = create_hashtable(16, hash_from_pgn, pgns_equal);
+    if(pgnHash == NULL) {
+        fprintf(stderr, "error: could not create PGN hash.\n");
+        return NULL;
+    }
+
+    for(; message_list != NULL; message_list = message_list->next) {
+        messageHashKey_t id = message_list->message->id;
+        message_t *m;
+        if (!(id & mask_ext) || !(m = hashtable_search(h, &id)))
+            continue;
+
+        messageHashKey_t *key = malloc(sizeof(messageHashKey_t));
+        *key = messageHash_pgn(id);
+        if (hashtable_search(pgnHash, key)) {
+            free(key);
+            continue;
+        }
+        hashtable_insert(pgnHash, key, m);
+    }
+
+    return pgnHash;
+}
+
+/*
+ * Find the message for the PGN of an extended CAN ID.
+ * Returns NULL for standard IDs and unknown PGNs.
+ */
+message_t *messageHash_searchPGN(messageHash_t *const pgnHash, uint32 canid)
+{
+    if (pgnHash == NULL || !(canid & mask_ext))
+        return NULL;
+
+    messageHashKey_t key = messageHash_pgn(canid);
+    return hashtable_search(pgnHash, &key);
+}
+
+/* Messages are owned by the message hash, only the keys are freed. */
+void messageHash_freePGN(messageHash_t *const pgnHash)
+{
+    if(pgnHash != NULL)
+        hashtable_destroy(pgnHash, 0);
+}
+
 void messageHash_free(struct hashtable *const h)
 {
     if(h != NULL) {
@@ -27,4 +27,11 @@ typedef struct hashtable messageHash_t;
 struct hashtable *messageHash_create(message_list_t *ml);
 void messageHash_free(messageHash_t *const h);
 
+/* J1939 lookup by Parameter Group Number */
+uint32 messageHash_pgn(uint32 canid);
+messageHash_t *messageHash_createPGN(messageHash_t *const h,
+                                     message_list_t *message_list);
+message_t *messageHash_searchPGN(messageHash_t *const pgnHash, uint32 canid);
+void messageHash_freePGN(messageHash_t *const pgnHash);
+
 #endif
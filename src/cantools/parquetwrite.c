@@ -0,0 +1,929 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "measurement.h"
+#include "hashtable_itr.h"
+#include "writer.h"
+#include "stats.h"
+
+// Apache Parquet file format.
+// https://parquet.apache.org/docs/file-format/
+//
+// Like the Arrow writer, every message goes to a file of its own in the
+// output directory, as a Parquet file has a single schema. The columns
+// are "time" in integer nanoseconds followed by the signals in DBC order.
+//
+// Time is DELTA_BINARY_PACKED, a near-constant sample period costs a
+// few bits per row. Signals with few distinct values in a row group are
+// dictionary encoded with RLE/bit-packed indices, others are stored
+// BYTE_STREAM_SPLIT when compressed, the Parquet take on HDF5 shuffle.
+// Pages hold --chunk rows. Row groups are cut at PQ_ROW_GROUP_BYTES of
+// plain values so that readers can spread a file over threads.
+//
+// The metadata is Thrift compact protocol, written by the encoder below.
+// https://github.com/apache/thrift/blob/master/doc/specs/thrift-compact-protocol.md
+
+#define PQ_ROW_GROUP_BYTES (16 << 20)
+#define PQ_DICT_MAX (1 << 16)      // most distinct values in a dictionary
+#define PQ_RLE_GROUPS 63           // most bit-packed groups of 8 per run
+#define PQ_DELTA_BLOCK 128         // values per delta block
+#define PQ_DELTA_MINIBLOCKS 4
+#define PQ_DELTA_MINIBLOCK (PQ_DELTA_BLOCK / PQ_DELTA_MINIBLOCKS)
+
+// parquet.thrift enums
+#define PQ_INT64 2                 // Type
+#define PQ_FLOAT 4
+#define PQ_DOUBLE 5
+#define PQ_REQUIRED 0              // FieldRepetitionType
+#define PQ_PLAIN 0                 // Encoding
+#define PQ_RLE 3
+#define PQ_DELTA_BINARY_PACKED 5
+#define PQ_RLE_DICTIONARY 8
+#define PQ_BYTE_STREAM_SPLIT 9
+#define PQ_UNCOMPRESSED 0          // CompressionCodec
+#define PQ_GZIP 2
+#define PQ_DATA_PAGE 0             // PageType
+#define PQ_DICTIONARY_PAGE 2
+
+// Thrift compact protocol types
+#define TC_I32 5
+#define TC_I64 6
+#define TC_BINARY 8
+#define TC_LIST 9
+#define TC_STRUCT 12
+#define TC_MAX_DEPTH 8
+
+
+/*
+ * Growable byte buffer, for pages and metadata.
+ */
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t cap;
+    int failed;
+} pq_buf_t;
+
+
+/* Room for n more bytes, NULL if out of memory. Size is not changed. */
+static unsigned char *buf_reserve(pq_buf_t *b, size_t n)
+{
+    if (b->size + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->size + n)
+            cap *= 2;
+        unsigned char *data = realloc(b->data, cap);
+        if (!data) {
+            b->failed = 1;
+            return NULL;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    return b->data + b->size;
+}
+
+
+static void buf_push(pq_buf_t *b, const void *src, size_t n)
+{
+    if (n == 0)
+        return;
+    unsigned char *dst = buf_reserve(b, n);
+    if (dst) {
+        memcpy(dst, src, n);
+        b->size += n;
+    }
+}
+
+
+static void buf_varint(pq_buf_t *b, uint64_t v)
+{
+    unsigned char tmp[10];
+    size_t n = 0;
+    do {
+        tmp[n] = v & 0x7f;
+        v >>= 7;
+        if (v)
+            tmp[n] |= 0x80;
+        n++;
+    } while (v);
+    buf_push(b, tmp, n);
+}
+
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+
+/* Bits needed to store v. */
+static int bit_width(uint64_t v)
+{
+    int w = 0;
+    while (v) {
+        w++;
+        v >>= 1;
+    }
+    return w;
+}
+
+
+/* Pack n values of width bits each, least significant bit first. */
+static void bit_pack(pq_buf_t *b, const uint64_t *v, size_t n, int width)
+{
+    size_t bytes = (n * width + 7) / 8;
+    if (width == 0)
+        return;
+    unsigned char *dst = buf_reserve(b, bytes);
+    if (!dst)
+        return;
+    memset(dst, 0, bytes);
+
+    size_t bit = 0;
+    for (size_t i = 0; i < n; i++) {
+        for (int k = 0; k < width;) {
+            int off = bit % 8;
+            int take = 8 - off < width - k ? 8 - off : width - k;
+            dst[bit / 8] |= ((v[i] >> k) & ((1u << take) - 1)) << off;
+            k += take;
+            bit += take;
+        }
+    }
+    b->size += bytes;
+}
+
+
+/*
+ * Thrift compact protocol encoder.
+ * Structs track the last field id, as ids are delta coded.
+ */
+typedef struct {
+    pq_buf_t out;
+    int16_t last[TC_MAX_DEPTH];
+    int depth;
+} tc_t;
+
+
+static void tc_reset(tc_t *t)
+{
+    t->out.size = 0;
+    t->depth = 0;
+    t->last[0] = 0;
+}
+
+
+static void tc_field(tc_t *t, int16_t id, uint8_t type)
+{
+    int delta = id - t->last[t->depth];
+    if (delta > 0 && delta <= 15) {
+        uint8_t header = delta << 4 | type;
+        buf_push(&t->out, &header, 1);
+    } else {
+        buf_push(&t->out, &type, 1);
+        buf_varint(&t->out, zigzag(id));
+    }
+    t->last[t->depth] = id;
+}
+
+
+static void tc_i32(tc_t *t, int16_t id, int32_t v)
+{
+    tc_field(t, id, TC_I32);
+    buf_varint(&t->out, zigzag(v));
+}
+
+
+static void tc_i64(tc_t *t, int16_t id, int64_t v)
+{
+    tc_field(t, id, TC_I64);
+    buf_varint(&t->out, zigzag(v));
+}
+
+
+static void tc_binary(tc_t *t, int16_t id, const void *data, size_t n)
+{
+    tc_field(t, id, TC_BINARY);
+    buf_varint(&t->out, n);
+    buf_push(&t->out, data, n);
+}
+
+
+static void tc_string(tc_t *t, int16_t id, const char *s)
+{
+    tc_binary(t, id, s, strlen(s));
+}
+
+
+/* List header, the n elements follow without field headers. */
+static void tc_list(tc_t *t, int16_t id, uint8_t type, size_t n)
+{
+    tc_field(t, id, TC_LIST);
+    if (n < 15) {
+        uint8_t header = n << 4 | type;
+        buf_push(&t->out, &header, 1);
+    } else {
+        uint8_t header = 0xf0 | type;
+        buf_push(&t->out, &header, 1);
+        buf_varint(&t->out, n);
+    }
+}
+
+
+/* Open a struct field, id 0 for list elements and the root. */
+static void tc_struct_begin(tc_t *t, int16_t id)
+{
+    if (id)
+        tc_field(t, id, TC_STRUCT);
+    t->last[++t->depth] = 0;
+}
+
+
+static void tc_struct_end(tc_t *t)
+{
+    const uint8_t stop = 0;
+    buf_push(&t->out, &stop, 1);
+    t->depth--;
+}
+
+
+static void tc_key_value(tc_t *t, const char *key, const char *value)
+{
+    tc_struct_begin(t, 0);
+    tc_string(t, 1, key);
+    tc_string(t, 2, value);
+    tc_struct_end(t);
+}
+
+
+/*
+ * Parquet writer
+ */
+typedef struct {
+    const char *name;
+    const char *unit;
+    const double *data;
+    int type;
+    size_t width;             // bytes per plain value
+} pq_column_t;
+
+// A written column chunk, as needed for the footer.
+typedef struct {
+    int encoding;             // of the data pages
+    int64_t offset;           // first page
+    int64_t data_offset;      // first data page
+    int64_t compressed;
+    int64_t uncompressed;
+    int has_stats;
+    unsigned char min[8];
+    unsigned char max[8];
+} pq_chunk_t;
+
+typedef struct {
+    FILE *fp;
+    int64_t pos;
+    int codec;
+    z_stream zs;
+    pq_buf_t plain;           // row group values, plain encoded
+    pq_buf_t page;            // page before compression
+    pq_buf_t zpage;           // page after compression
+    tc_t meta;
+    uint32_t *indices;        // dictionary index of each row
+    uint64_t *dict;           // dictionary values, as bits
+    uint32_t *slots;          // hash slots, dictionary index + 1
+    int failed;
+} pq_writer_t;
+
+
+static void pq_write(pq_writer_t *pq, const void *data, size_t n)
+{
+    if (pq->failed || fwrite(data, 1, n, pq->fp) != n)
+        pq->failed = 1;
+    pq->pos += n;
+    STATS_ADD(stat_bytes_written, n);
+}
+
+
+static uint64_t plain_value(const unsigned char *plain, size_t i, size_t width)
+{
+    if (width == 8) {
+        uint64_t v;
+        memcpy(&v, plain + 8 * i, 8);
+        return v;
+    } else {
+        uint32_t v;
+        memcpy(&v, plain + 4 * i, 4);
+        return v;
+    }
+}
+
+
+/* Plain encode rows of the column into pq->plain. */
+static void plain_encode(pq_writer_t *pq, const pq_column_t *col,
+                         size_t start, size_t rows)
+{
+    const double *data = col->data + start;
+    pq->plain.size = 0;
+    unsigned char *dst = buf_reserve(&pq->plain, rows * col->width);
+    if (!dst)
+        return;
+
+    if (col->type == PQ_INT64) {
+        int64_t *ns = (int64_t *) dst;
+        for (size_t i = 0; i < rows; i++)
+            ns[i] = (int64_t) (data[i] * 1e9 + 0.5);
+    } else if (col->type == PQ_FLOAT) {
+        float *single = (float *) dst;
+        for (size_t i = 0; i < rows; i++)
+            single[i] = (float) data[i];
+    } else {
+        memcpy(dst, data, rows * sizeof(double));
+    }
+    pq->plain.size = rows * col->width;
+}
+
+
+/* Min and max of the plain values, NaN is left out. */
+static void chunk_stats(pq_chunk_t *chunk, const pq_column_t *col,
+                        const unsigned char *plain, size_t rows)
+{
+    size_t lo = 0, hi = 0;
+    chunk->has_stats = 0;
+
+    for (size_t i = 0; i < rows; i++) {
+        if (col->type == PQ_INT64) {
+            const int64_t *v = (const int64_t *) plain;
+            if (!chunk->has_stats || v[i] < v[lo])
+                lo = i;
+            if (!chunk->has_stats || v[i] > v[hi])
+                hi = i;
+        } else if (col->type == PQ_FLOAT) {
+            const float *v = (const float *) plain;
+            if (v[i] != v[i])
+                continue;
+            if (!chunk->has_stats || v[i] < v[lo])
+                lo = i;
+            if (!chunk->has_stats || v[i] > v[hi])
+                hi = i;
+        } else {
+            const double *v = (const double *) plain;
+            if (v[i] != v[i])
+                continue;
+            if (!chunk->has_stats || v[i] < v[lo])
+                lo = i;
+            if (!chunk->has_stats || v[i] > v[hi])
+                hi = i;
+        }
+        chunk->has_stats = 1;
+    }
+    memcpy(chunk->min, plain + lo * col->width, col->width);
+    memcpy(chunk->max, plain + hi * col->width, col->width);
+}
+
+
+/*
+ * Dictionary encode pq->plain into pq->dict and pq->indices.
+ * Returns the dictionary size, or 0 if there are too many distinct
+ * values for the dictionary to pay off.
+ */
+static size_t build_dictionary(pq_writer_t *pq, size_t rows, size_t width)
+{
+    size_t limit = rows < PQ_DICT_MAX ? rows : PQ_DICT_MAX;
+    int bits = 1;
+    while (((size_t) 1 << bits) < 2 * limit)
+        bits++;
+    size_t mask = ((size_t) 1 << bits) - 1;
+    memset(pq->slots, 0, (mask + 1) * sizeof(uint32_t));
+
+    size_t n_dict = 0;
+    for (size_t i = 0; i < rows; i++) {
+        uint64_t v = plain_value(pq->plain.data, i, width);
+        size_t s = (v * 0x9E3779B97F4A7C15ull) >> (64 - bits);
+        while (pq->slots[s] && pq->dict[pq->slots[s] - 1] != v)
+            s = (s + 1) & mask;
+        if (!pq->slots[s]) {
+            if (n_dict == limit)
+                return 0;
+            pq->dict[n_dict++] = v;
+            pq->slots[s] = n_dict;
+        }
+        pq->indices[i] = pq->slots[s] - 1;
+    }
+
+    int index_bits = bit_width(n_dict - 1);
+    size_t dict_bytes = n_dict * width + (rows * (index_bits ? index_bits : 1) + 7) / 8;
+    return dict_bytes < rows * width ? n_dict : 0;
+}
+
+
+static void flush_literals(pq_buf_t *b, const uint32_t *v, size_t n, int width)
+{
+    uint64_t tmp[8 * PQ_RLE_GROUPS] = {0};
+    size_t groups = (n + 7) / 8;
+    if (n == 0)
+        return;
+    for (size_t i = 0; i < n; i++)
+        tmp[i] = v[i];
+    buf_varint(b, groups << 1 | 1);
+    bit_pack(b, tmp, 8 * groups, width);
+}
+
+
+/*
+ * RLE/bit-packed hybrid. Repeats of 8 or more become RLE runs, the rest
+ * is bit-packed in groups of 8.
+ */
+static void rle_encode(pq_buf_t *b, const uint32_t *v, size_t n, int width)
+{
+    size_t lit = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        size_t run = 1;
+        while (i + run < n && v[i + run] == v[i])
+            run++;
+
+        if (run >= 8) {
+            flush_literals(b, v + lit, i - lit, width);
+            buf_varint(b, run << 1);
+            uint32_t value = v[i];
+            buf_push(b, &value, (width + 7) / 8);
+            i += run;
+            lit = i;
+        } else {
+            i = i + 8 < n ? i + 8 : n;
+            if (i - lit == 8 * PQ_RLE_GROUPS) {
+                flush_literals(b, v + lit, i - lit, width);
+                lit = i;
+            }
+        }
+    }
+    flush_literals(b, v + lit, i - lit, width);
+}
+
+
+/* DELTA_BINARY_PACKED, deltas wrap around as unsigned. */
+static void delta_encode(pq_buf_t *b, const int64_t *v, size_t n)
+{
+    uint64_t delta[PQ_DELTA_BLOCK];
+
+    buf_varint(b, PQ_DELTA_BLOCK);
+    buf_varint(b, PQ_DELTA_MINIBLOCKS);
+    buf_varint(b, n);
+    buf_varint(b, zigzag(n ? v[0] : 0));
+
+    for (size_t i = 1; i < n; i += PQ_DELTA_BLOCK) {
+        size_t m = n - i < PQ_DELTA_BLOCK ? n - i : PQ_DELTA_BLOCK;
+        int64_t min = INT64_MAX;
+        for (size_t j = 0; j < m; j++) {
+            int64_t d = (int64_t) ((uint64_t) v[i + j] - (uint64_t) v[i + j - 1]);
+            delta[j] = d;
+            if (d < min)
+                min = d;
+        }
+        for (size_t j = 0; j < PQ_DELTA_BLOCK; j++)
+            delta[j] = j < m ? delta[j] - (uint64_t) min : 0;
+
+        unsigned char widths[PQ_DELTA_MINIBLOCKS];
+        for (int k = 0; k < PQ_DELTA_MINIBLOCKS; k++) {
+            uint64_t bits = 0;
+            for (int j = 0; j < PQ_DELTA_MINIBLOCK; j++)
+                bits |= delta[k * PQ_DELTA_MINIBLOCK + j];
+            widths[k] = bit_width(bits);
+        }
+
+        buf_varint(b, zigzag(min));
+        buf_push(b, widths, sizeof(widths));
+        for (size_t k = 0; k * PQ_DELTA_MINIBLOCK < m; k++)
+            bit_pack(b, delta + k * PQ_DELTA_MINIBLOCK, PQ_DELTA_MINIBLOCK, widths[k]);
+    }
+}
+
+
+/* Bytes of each value side by side, all first bytes first. */
+static void byte_stream_split(pq_buf_t *b, const unsigned char *plain,
+                              size_t rows, size_t width)
+{
+    unsigned char *dst = buf_reserve(b, rows * width);
+    if (!dst)
+        return;
+    for (size_t k = 0; k < width; k++) {
+        for (size_t i = 0; i < rows; i++)
+            dst[k * rows + i] = plain[i * width + k];
+    }
+    b->size += rows * width;
+}
+
+
+/* Compress pq->page into pq->zpage as a gzip member. */
+static int gzip_page(pq_writer_t *pq)
+{
+    pq->zpage.size = 0;
+    if (deflateReset(&pq->zs) != Z_OK)
+        return 1;
+    size_t bound = deflateBound(&pq->zs, pq->page.size);
+    if (!buf_reserve(&pq->zpage, bound))
+        return 1;
+
+    pq->zs.next_in = pq->page.data;
+    pq->zs.avail_in = pq->page.size;
+    pq->zs.next_out = pq->zpage.data;
+    pq->zs.avail_out = bound;
+    if (deflate(&pq->zs, Z_FINISH) != Z_STREAM_END)
+        return 1;
+    pq->zpage.size = pq->zs.total_out;
+    return 0;
+}
+
+
+/* Write pq->page with its header, compressed if enabled. */
+static void write_page(pq_writer_t *pq, pq_chunk_t *chunk, int type,
+                       size_t n_values, int encoding)
+{
+    const pq_buf_t *body = &pq->page;
+    if (pq->page.failed) {
+        pq->failed = 1;
+        return;
+    }
+    if (pq->codec == PQ_GZIP) {
+        if (gzip_page(pq)) {
+            pq->failed = 1;
+            return;
+        }
+        body = &pq->zpage;
+    }
+
+    tc_t *t = &pq->meta;
+    tc_reset(t);
+    tc_struct_begin(t, 0);
+    tc_i32(t, 1, type);
+    tc_i32(t, 2, pq->page.size);
+    tc_i32(t, 3, body->size);
+    if (type == PQ_DATA_PAGE) {
+        tc_struct_begin(t, 5);
+        tc_i32(t, 1, n_values);
+        tc_i32(t, 2, encoding);
+        tc_i32(t, 3, PQ_RLE);
+        tc_i32(t, 4, PQ_RLE);
+        tc_struct_end(t);
+    } else {
+        tc_struct_begin(t, 7);
+        tc_i32(t, 1, n_values);
+        tc_i32(t, 2, PQ_PLAIN);
+        tc_struct_end(t);
+    }
+    tc_struct_end(t);
+    if (t->out.failed) {
+        pq->failed = 1;
+        return;
+    }
+
+    pq_write(pq, t->out.data, t->out.size);
+    pq_write(pq, body->data, body->size);
+    chunk->compressed += t->out.size + body->size;
+    chunk->uncompressed += t->out.size + pq->page.size;
+}
+
+
+/* Write rows [start, start + rows) of the column as one column chunk. */
+static void write_chunk(pq_writer_t *pq, pq_chunk_t *chunk,
+                        const pq_column_t *col, size_t start, size_t rows)
+{
+    const size_t page_rows = writer_opts.chunk;
+    size_t n_dict = 0;
+
+    plain_encode(pq, col, start, rows);
+    if (pq->plain.failed) {
+        pq->failed = 1;
+        return;
+    }
+    chunk_stats(chunk, col, pq->plain.data, rows);
+
+    if (col->type == PQ_INT64)
+        chunk->encoding = PQ_DELTA_BINARY_PACKED;
+    else if ((n_dict = build_dictionary(pq, rows, col->width)))
+        chunk->encoding = PQ_RLE_DICTIONARY;
+    else if (pq->codec != PQ_UNCOMPRESSED)
+        chunk->encoding = PQ_BYTE_STREAM_SPLIT;
+    else
+        chunk->encoding = PQ_PLAIN;
+
+    chunk->offset = pq->pos;
+    if (n_dict) {
+        pq->page.size = 0;
+        for (size_t i = 0; i < n_dict; i++)
+            buf_push(&pq->page, &pq->dict[i], col->width);
+        write_page(pq, chunk, PQ_DICTIONARY_PAGE, n_dict, PQ_PLAIN);
+    }
+    chunk->data_offset = pq->pos;
+
+    int index_bits = n_dict ? bit_width(n_dict - 1) : 0;
+    if (index_bits == 0)
+        index_bits = 1;
+    for (size_t k = 0; k < rows && !pq->failed; k += page_rows) {
+        size_t m = rows - k < page_rows ? rows - k : page_rows;
+        const unsigned char *plain = pq->plain.data + k * col->width;
+
+        pq->page.size = 0;
+        switch (chunk->encoding) {
+        case PQ_DELTA_BINARY_PACKED:
+            delta_encode(&pq->page, (const int64_t *) plain, m);
+            break;
+        case PQ_RLE_DICTIONARY: {
+            uint8_t bw = index_bits;
+            buf_push(&pq->page, &bw, 1);
+            rle_encode(&pq->page, pq->indices + k, m, index_bits);
+            break;
+        }
+        case PQ_BYTE_STREAM_SPLIT:
+            byte_stream_split(&pq->page, plain, m, col->width);
+            break;
+        default:
+            buf_push(&pq->page, plain, m * col->width);
+        }
+        write_page(pq, chunk, PQ_DATA_PAGE, m, chunk->encoding);
+    }
+}
+
+
+static void write_footer(pq_writer_t *pq, const frame_key_t *key,
+                         const msg_series_t *msg,
+                         const pq_column_t *cols, size_t n_cols,
+                         const pq_chunk_t *chunks, size_t n_groups,
+                         size_t group_rows)
+{
+    tc_t *t = &pq->meta;
+    tc_reset(t);
+    tc_struct_begin(t, 0);
+    tc_i32(t, 1, 1);
+
+    tc_list(t, 2, TC_STRUCT, n_cols + 1);
+    tc_struct_begin(t, 0);
+    tc_string(t, 4, "schema");
+    tc_i32(t, 5, n_cols);
+    tc_struct_end(t);
+    for (size_t c = 0; c < n_cols; c++) {
+        tc_struct_begin(t, 0);
+        tc_i32(t, 1, cols[c].type);
+        tc_i32(t, 3, PQ_REQUIRED);
+        tc_string(t, 4, cols[c].name);
+        tc_struct_end(t);
+    }
+
+    tc_i64(t, 3, msg->n);
+
+    tc_list(t, 4, TC_STRUCT, n_groups);
+    for (size_t g = 0; g < n_groups; g++) {
+        size_t rows = msg->n - g * group_rows < group_rows
+            ? msg->n - g * group_rows : group_rows;
+        int64_t compressed = 0, uncompressed = 0;
+
+        tc_struct_begin(t, 0);
+        tc_list(t, 1, TC_STRUCT, n_cols);
+        for (size_t c = 0; c < n_cols; c++) {
+            const pq_chunk_t *chunk = &chunks[g * n_cols + c];
+            const pq_column_t *col = &cols[c];
+            compressed += chunk->compressed;
+            uncompressed += chunk->uncompressed;
+
+            tc_struct_begin(t, 0);
+            tc_i64(t, 2, chunk->offset);
+            tc_struct_begin(t, 3);
+            tc_i32(t, 1, col->type);
+            if (chunk->encoding == PQ_RLE_DICTIONARY) {
+                tc_list(t, 2, TC_I32, 3);
+                buf_varint(&t->out, zigzag(PQ_PLAIN));
+            } else {
+                tc_list(t, 2, TC_I32, 2);
+            }
+            buf_varint(&t->out, zigzag(PQ_RLE));
+            buf_varint(&t->out, zigzag(chunk->encoding));
+            tc_list(t, 3, TC_BINARY, 1);
+            buf_varint(&t->out, strlen(col->name));
+            buf_push(&t->out, col->name, strlen(col->name));
+            tc_i32(t, 4, pq->codec);
+            tc_i64(t, 5, rows);
+            tc_i64(t, 6, chunk->uncompressed);
+            tc_i64(t, 7, chunk->compressed);
+            if (col->unit && *col->unit) {
+                tc_list(t, 8, TC_STRUCT, 1);
+                tc_key_value(t, "unit", col->unit);
+            }
+            tc_i64(t, 9, chunk->data_offset);
+            if (chunk->encoding == PQ_RLE_DICTIONARY)
+                tc_i64(t, 11, chunk->offset);
+            if (chunk->has_stats) {
+                tc_struct_begin(t, 12);
+                tc_i64(t, 3, 0);
+                tc_binary(t, 5, chunk->max, col->width);
+                tc_binary(t, 6, chunk->min, col->width);
+                tc_struct_end(t);
+            }
+            tc_struct_end(t);
+            tc_struct_end(t);
+        }
+        tc_i64(t, 2, uncompressed);
+        tc_i64(t, 3, rows);
+        tc_i64(t, 4, chunks[g * n_cols].offset);
+        tc_i64(t, 5, compressed);
+        tc_struct_end(t);
+    }
+
+    char bus[8], id[16];
+    snprintf(bus, sizeof(bus), "%u", key->bus);
+    snprintf(id, sizeof(id), "0x%X", key->id);
+    tc_list(t, 5, TC_STRUCT, 5);
+    tc_key_value(t, "message", msg->name);
+    tc_key_value(t, "dbc", msg->dbcname);
+    tc_key_value(t, "bus", bus);
+    tc_key_value(t, "id", id);
+    tc_key_value(t, "time_unit", "ns");
+    tc_string(t, 6, "cantools");
+
+    // TypeDefinedOrder for every column, so min/max stats are trusted.
+    tc_list(t, 7, TC_STRUCT, n_cols);
+    for (size_t c = 0; c < n_cols; c++) {
+        tc_struct_begin(t, 0);
+        tc_struct_begin(t, 1);
+        tc_struct_end(t);
+        tc_struct_end(t);
+    }
+    tc_struct_end(t);
+}
+
+
+/* Columns of a message: time, then its decoded signals in DBC order. */
+static pq_column_t *message_columns(const msg_series_t *msg, size_t *n_cols)
+{
+    pq_column_t *cols = malloc((1 + hashtable_count(msg->ts_hash))
+                               * sizeof(pq_column_t));
+    if (!cols)
+        return NULL;
+
+    cols[0].name = "time";
+    cols[0].unit = "ns";
+    cols[0].data = msg->time;
+    cols[0].type = PQ_INT64;
+    cols[0].width = sizeof(int64_t);
+    *n_cols = 1;
+
+    signal_list_t *sl;
+    for (sl = msg->spec->signal_list; sl != NULL; sl = sl->next) {
+        const signal_t *const sig = sl->signal;
+        const double *data = hashtable_search(msg->ts_hash, sig->name);
+        int seen = 0;
+        for (size_t i = 1; i < *n_cols; i++)
+            seen |= cols[i].data == data;
+        if (!data || seen)
+            continue;
+
+        pq_column_t *col = &cols[(*n_cols)++];
+        col->name = sig->name;
+        col->unit = sig->unit;
+        col->data = data;
+        col->type = writer_opts.single ? PQ_FLOAT : PQ_DOUBLE;
+        col->width = writer_opts.single ? sizeof(float) : sizeof(double);
+    }
+    return cols;
+}
+
+
+static int write_message_file(pq_writer_t *pq, const char *path,
+                              const frame_key_t *key, const msg_series_t *msg)
+{
+    static const char magic[4] = "PAR1";
+    size_t n_cols;
+    pq_column_t *cols = message_columns(msg, &n_cols);
+    if (!cols)
+        return 1;
+
+    // Whole pages per row group, at least one.
+    size_t row_bytes = 0;
+    for (size_t c = 0; c < n_cols; c++)
+        row_bytes += cols[c].width;
+    size_t group_rows = PQ_ROW_GROUP_BYTES / row_bytes;
+    group_rows -= group_rows % writer_opts.chunk;
+    if (group_rows == 0)
+        group_rows = writer_opts.chunk;
+    size_t n_groups = (msg->n + group_rows - 1) / group_rows;
+    size_t max_rows = msg->n < group_rows ? msg->n : group_rows;
+
+    pq_chunk_t *chunks = calloc(n_groups * n_cols + 1, sizeof(pq_chunk_t));
+    uint32_t *indices = realloc(pq->indices, (max_rows + 1) * sizeof(uint32_t));
+    if (indices)
+        pq->indices = indices;
+    pq->fp = fopen(path, "wb");
+    pq->pos = 0;
+    pq->failed = !chunks || !indices || !pq->fp;
+
+    pq_write(pq, magic, sizeof(magic));
+    for (size_t g = 0; g < n_groups && !pq->failed; g++) {
+        size_t start = g * group_rows;
+        size_t rows = msg->n - start < group_rows ? msg->n - start : group_rows;
+        for (size_t c = 0; c < n_cols && !pq->failed; c++)
+            write_chunk(pq, &chunks[g * n_cols + c], &cols[c], start, rows);
+    }
+
+    if (!pq->failed) {
+        write_footer(pq, key, msg, cols, n_cols, chunks, n_groups, group_rows);
+        uint32_t footer_len = pq->meta.out.size;
+        pq->failed |= pq->meta.out.failed;
+        pq_write(pq, pq->meta.out.data, footer_len);
+        pq_write(pq, &footer_len, sizeof(footer_len));
+        pq_write(pq, magic, sizeof(magic));
+    }
+
+    if (pq->fp && fclose(pq->fp) != 0)
+        pq->failed = 1;
+    free(chunks);
+    free(cols);
+    return pq->failed;
+}
+
+
+/*
+ * write_parquet - write one Parquet file per message into outdir
+ */
+int write_parquet(struct hashtable *msg_hash, const char *outdir)
+{
+    static int warned = 0;
+    int ret = 1;
+    if (hashtable_count(msg_hash) == 0) {
+        fprintf(stderr, "error: measurement empty, nothing to write\n");
+        return 1;
+    }
+
+#ifdef _WIN32
+    int err = mkdir(outdir);
+#else
+    int err = mkdir(outdir, 0777);
+#endif
+    if (err && errno != EEXIST) {
+        fprintf(stderr, "error: could not create directory %s\n", outdir);
+        return 1;
+    }
+
+    // Only GZIP needs nothing beyond zlib.
+    if (writer_opts.level > 0 && writer_opts.codec != codec_deflate && !warned) {
+        fprintf(stderr, "warning: parquet supports deflate only, using it instead\n");
+        warned = 1;
+    }
+
+    pq_writer_t pq = {0};
+    pq.codec = writer_opts.level > 0 ? PQ_GZIP : PQ_UNCOMPRESSED;
+    pq.dict = malloc(PQ_DICT_MAX * sizeof(uint64_t));
+    pq.slots = malloc(2 * PQ_DICT_MAX * sizeof(uint32_t));
+    if (!pq.dict || !pq.slots
+        || deflateInit2(&pq.zs, writer_opts.level > 0 ? writer_opts.level : 1,
+                        Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "error: out of memory\n");
+        free(pq.dict);
+        free(pq.slots);
+        return 1;
+    }
+
+    char *path = NULL;
+
+    struct hashtable_itr *msg_itr = hashtable_iterator(msg_hash);
+    do {
+        frame_key_t *msg_key = hashtable_iterator_key(msg_itr);
+        msg_series_t *msg = hashtable_iterator_value(msg_itr);
+        if (!msg->ts_hash || hashtable_count(msg->ts_hash) == 0)
+            continue;
+
+        free(path);
+        path = message_path(msg_hash, outdir, msg_key, msg, "parquet");
+        if (!path || write_message_file(&pq, path, msg_key, msg)) {
+            fprintf(stderr, "error: could not write %s\n",
+                    path ? path : msg->name);
+            goto exit;
+        }
+    } while (hashtable_iterator_advance(msg_itr));
+
+    ret = 0;
+exit:
+    deflateEnd(&pq.zs);
+    free(msg_itr);
+    free(path);
+    free(pq.plain.data);
+    free(pq.page.data);
+    free(pq.zpage.data);
+    free(pq.meta.out.data);
+    free(pq.indices);
+    free(pq.dict);
+    free(pq.slots);
+    return ret;
+}
+
+
+// Export this format so writer.c can use it.
+can_writer_t parquet_writer = {
+    .name="parquet",
+    .ext="parquet",
+    .write_fcn=write_parquet
+};
@@ -0,0 +1,8 @@
+#ifndef PARQUETWRITE_H
+#define PARQUETWRITE_H
+
+#include "measurement.h"
+
+int write_parquet(struct hashtable *msg_hash, const char *outdir);
+
+#endif /* PARQUETWRITE_H */
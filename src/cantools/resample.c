@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "resample.h"
+#include "hashtable_itr.h"
+#include "writer.h"
+
+resample_opts_t resample_opts = {
+    .n_grids = 0,
+    .mode = resample_mode_zoh,
+};
+
+
+/* simple string hash function for signal names */
+static unsigned int string_hash(void *k)
+{
+    unsigned int hash = 0;
+    int c;
+    while ((c = *(unsigned char *)k++))
+        hash = c + (hash << 6) + (hash << 16) - hash;
+    return hash;
+}
+
+
+static int string_equal(void *key1, void *key2)
+{
+    return strcmp((char *)key1, (char *)key2) == 0;
+}
+
+
+int resample_parse_grid(const char *arg, resample_grid_t *grid)
+{
+    static const struct { const char *unit; double scale; int rate; } units[] = {
+        {"Hz", 1, 1}, {"ms", 1e-3, 0}, {"us", 1e-6, 0}, {"s", 1, 0},
+    };
+    char *end;
+    double value = strtod(arg, &end);
+
+    grid->period = 0;
+    grid->reference = NULL;
+    if (end != arg) {
+        for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+            if (strcmp(end, units[i].unit) != 0)
+                continue;
+            if (!(value > 0)) {
+                fprintf(stderr, "error: resampling grid %s is not positive\n", arg);
+                return 1;
+            }
+            grid->period = units[i].rate ? 1 / value : value * units[i].scale;
+            return 0;
+        }
+    }
+    grid->reference = (char *) arg;
+    return 0;
+}
+
+
+// A message feeding the grid.
+typedef struct {
+    frame_key_t key;
+    char *name;
+    const signal_t **signals;   // decoded signals, in DBC order
+    size_t n_signals;
+    int registered;             // signals known, from its first samples
+    int ignored;                // first seen after output started
+    double last;                // time of the last sample, -inf before any
+    size_t n, cap;              // buffered samples
+    double *time;
+    double **values;            // per signal
+} rs_source_t;
+
+struct resampler_s {
+    resample_grid_t grid;
+    unsigned int group;
+    char *name;
+
+    rs_source_t *sources;
+    size_t n_sources, cap_sources;
+    long reference;             // source of the reference message, or -1
+    double *ref_time;           // its time stamps not yet output
+    size_t ref_n, ref_cap;
+
+    int started;                // output columns are fixed
+    int failed;                 // a pull failed, not merely nothing ready
+    size_t rows;                // rows output so far
+    double next_k;              // fixed rate, next grid point next_k * period
+    message_t *spec;            // the output columns, as a message
+
+    msg_series_t out;
+    long *index;
+    double *weight;
+    size_t out_cap;
+};
+
+
+resampler_t *resampler_create(const resample_grid_t *grid, unsigned int group)
+{
+    resampler_t *r = calloc(1, sizeof(resampler_t));
+    if (!r)
+        return NULL;
+    r->grid = *grid;
+    r->group = group;
+    r->reference = -1;
+
+    // Output name, usable as MAT variable.
+    char name[64];
+    if (grid->reference)
+        snprintf(name, sizeof(name), "grid_%s", grid->reference);
+    else if (grid->period >= 1)
+        snprintf(name, sizeof(name), "grid_%gs", grid->period);
+    else
+        snprintf(name, sizeof(name), "grid_%gHz", 1 / grid->period);
+    for (char *c = name; *c; c++) {
+        if (*c == '.' || *c == '-' || *c == '+')
+            *c = '_';
+    }
+    r->name = strdup(name);
+    return r;
+}
+
+
+static void free_output(resampler_t *r)
+{
+    if (r->out.ts_hash)
+        hashtable_destroy(r->out.ts_hash, 1);
+    r->out.ts_hash = NULL;
+    free(r->out.time);
+    r->out.time = NULL;
+    r->out.n = 0;
+}
+
+
+void resampler_free(resampler_t *r)
+{
+    if (!r)
+        return;
+    for (size_t i = 0; i < r->n_sources; i++) {
+        rs_source_t *s = &r->sources[i];
+        for (size_t c = 0; c < s->n_signals; c++)
+            free(s->values[c]);
+        free(s->values);
+        free(s->signals);
+        free(s->time);
+        free(s->name);
+    }
+    free(r->sources);
+    free(r->ref_time);
+    free_output(r);
+    free(r->index);
+    free(r->weight);
+    message_free(r->spec);
+    free(r->name);
+    free(r);
+}
+
+
+static rs_source_t *find_source(resampler_t *r, const frame_key_t *key)
+{
+    for (size_t i = 0; i < r->n_sources; i++) {
+        if (frame_key_equal(&r->sources[i].key, (void *) key))
+            return &r->sources[i];
+    }
+
+    if (r->n_sources == r->cap_sources) {
+        size_t cap = r->cap_sources ? 2 * r->cap_sources : 16;
+        rs_source_t *sources = realloc(r->sources, cap * sizeof(rs_source_t));
+        if (!sources)
+            return NULL;
+        r->sources = sources;
+        r->cap_sources = cap;
+    }
+    rs_source_t *s = &r->sources[r->n_sources++];
+    memset(s, 0, sizeof(rs_source_t));
+    s->key = *key;
+    s->last = -HUGE_VAL;
+    s->ignored = r->started;
+    return s;
+}
+
+
+/* Take the decoded signals of a message from its first block. */
+static int register_source(resampler_t *r, rs_source_t *s,
+                           const msg_series_t *block)
+{
+    s->name = strdup(block->name ? block->name : "");
+    s->signals = malloc((block->ts_hash ? hashtable_count(block->ts_hash) : 0)
+                        * sizeof(signal_t *) + 1);
+    if (!s->name || !s->signals)
+        return 1;
+
+    signal_list_t *sl;
+    for (sl = block->spec ? block->spec->signal_list : NULL; sl; sl = sl->next) {
+        int seen = 0;
+        for (size_t c = 0; c < s->n_signals; c++)
+            seen |= 0 == strcmp(s->signals[c]->name, sl->signal->name);
+        if (!seen && block->ts_hash
+            && hashtable_search(block->ts_hash, sl->signal->name))
+            s->signals[s->n_signals++] = sl->signal;
+    }
+    s->values = calloc(s->n_signals + 1, sizeof(double *));
+    if (!s->values)
+        return 1;
+
+    if (r->grid.reference && r->reference < 0
+        && 0 == strcmp(s->name, r->grid.reference))
+        r->reference = s - r->sources;
+    s->registered = 1;
+    return 0;
+}
+
+
+int resampler_push(resampler_t *r, const frame_key_t *key,
+                   const msg_series_t *block)
+{
+    rs_source_t *s = find_source(r, key);
+    if (!s)
+        return 1;
+    if (s->ignored) {
+        if (block->n > 0 && !s->registered) {
+            fprintf(stderr, "warning: %s first seen after resampling "
+                    "started, left out of %s\n",
+                    block->name ? block->name : "message", r->name);
+            s->registered = 1;
+        }
+        return 0;
+    }
+    if (block->n == 0)
+        return 0;
+    if (!s->registered && register_source(r, s, block))
+        return 1;
+
+    if (s->n + block->n > s->cap) {
+        s->cap = 2 * (s->n + block->n);
+        s->time = realloc(s->time, s->cap * sizeof(double));
+        if (!s->time)
+            return 1;
+        for (size_t c = 0; c < s->n_signals; c++) {
+            s->values[c] = realloc(s->values[c], s->cap * sizeof(double));
+            if (!s->values[c])
+                return 1;
+        }
+    }
+    memcpy(s->time + s->n, block->time, block->n * sizeof(double));
+    for (size_t c = 0; c < s->n_signals; c++) {
+        const double *values = hashtable_search(block->ts_hash,
+                                                (void *) s->signals[c]->name);
+        if (!values)
+            return 1;
+        memcpy(s->values[c] + s->n, values, block->n * sizeof(double));
+    }
+    s->n += block->n;
+    s->last = block->time[block->n - 1];
+
+    if (r->reference == s - r->sources) {
+        if (r->ref_n + block->n > r->ref_cap) {
+            r->ref_cap = 2 * (r->ref_n + block->n);
+            r->ref_time = realloc(r->ref_time, r->ref_cap * sizeof(double));
+            if (!r->ref_time)
+                return 1;
+        }
+        memcpy(r->ref_time + r->ref_n, block->time, block->n * sizeof(double));
+        r->ref_n += block->n;
+    }
+    return 0;
+}
+
+
+/*
+ * Fix the output columns: the signals of every message with samples.
+ * Later messages are left out, the writers need all columns at once.
+ */
+static int start_output(resampler_t *r, double first)
+{
+    r->spec = calloc(1, sizeof(message_t));
+    if (!r->spec)
+        return 1;
+    r->spec->id = r->group;
+    r->spec->name = strdup(r->name);
+
+    signal_list_t **tail = &r->spec->signal_list;
+    for (size_t i = 0; i < r->n_sources; i++) {
+        rs_source_t *s = &r->sources[i];
+        s->ignored |= !s->registered;
+        for (size_t c = 0; !s->ignored && c < s->n_signals; c++) {
+            const signal_t *orig = s->signals[c];
+            signal_t *sig = calloc(1, sizeof(signal_t));
+            signal_list_t *node = calloc(1, sizeof(signal_list_t));
+            if (!sig || !node) {
+                free(sig);
+                free(node);
+                return 1;
+            }
+            size_t len = strlen(s->name) + strlen(orig->name) + 2;
+            sig->name = malloc(len);
+            snprintf(sig->name, len, "%s_%s", s->name, orig->name);
+            sig->unit = strdup(orig->unit ? orig->unit : "");
+            sig->scale = 1;
+            node->signal = sig;
+            *tail = node;
+            tail = &node->next;
+        }
+    }
+
+    r->next_k = r->grid.reference ? 0 : ceil(first / r->grid.period);
+    r->out.name = r->name;
+    r->out.dbcname = "";
+    r->out.spec = r->spec;
+    r->started = 1;
+    return 0;
+}
+
+
+/* Drop the first n samples of a source. */
+static void trim_source(rs_source_t *s, size_t n)
+{
+    s->n -= n;
+    memmove(s->time, s->time + n, s->n * sizeof(double));
+    for (size_t c = 0; c < s->n_signals; c++)
+        memmove(s->values[c], s->values[c] + n, s->n * sizeof(double));
+}
+
+
+const msg_series_t *resampler_pull(resampler_t *r, int flush,
+                                   size_t max_rows, frame_key_t *key)
+{
+    free_output(r);
+
+    // Rows up to the last sample of the message that is furthest behind.
+    double until = HUGE_VAL, end = -HUGE_VAL, first = HUGE_VAL;
+    int any = 0;
+    for (size_t i = 0; i < r->n_sources; i++) {
+        const rs_source_t *s = &r->sources[i];
+        if (s->ignored || (flush && !s->registered))
+            continue;
+        if (!s->registered)
+            return NULL; // announced, waiting for its samples
+        if (s->last < until)
+            until = s->last;
+        if (s->last > end)
+            end = s->last;
+        if (s->n > 0 && s->time[0] < first)
+            first = s->time[0];
+        any = 1;
+    }
+    if (!any) {
+        if (flush) {
+            fprintf(stderr, "error: no decoded signals for grid %s\n", r->name);
+            r->failed = 1;
+        }
+        return NULL;
+    }
+    if (flush)
+        until = end;
+    if (r->grid.reference && r->reference < 0) {
+        if (flush) {
+            fprintf(stderr, "error: reference message %s not found\n",
+                    r->grid.reference);
+            r->failed = 1;
+        }
+        return NULL;
+    }
+    if (!r->started && start_output(r, first)) {
+        r->failed = 1;
+        return NULL;
+    }
+
+    // The grid points ready.
+    size_t m = 0;
+    if (r->grid.reference) {
+        while (m < r->ref_n && m < max_rows && r->ref_time[m] <= until)
+            m++;
+    } else {
+        while (m < max_rows && (r->next_k + m) * r->grid.period <= until)
+            m++;
+    }
+    if (m == 0) {
+        if (flush && r->rows == 0) {
+            fprintf(stderr, "error: no rows in grid %s\n", r->name);
+            r->failed = 1;
+        }
+        return NULL;
+    }
+
+    if (m > r->out_cap) {
+        r->out_cap = m;
+        free(r->index);
+        free(r->weight);
+        r->index = malloc(m * sizeof(long));
+        r->weight = malloc(m * sizeof(double));
+        if (!r->index || !r->weight) {
+            r->out_cap = 0;
+            r->failed = 1;
+            return NULL;
+        }
+    }
+    r->out.time = malloc(m * sizeof(double));
+    r->out.ts_hash = create_hashtable(16, string_hash, string_equal);
+    if (!r->out.time || !r->out.ts_hash) {
+        r->failed = 1;
+        return NULL;
+    }
+    double *grid = r->out.time;
+    if (r->grid.reference) {
+        memcpy(grid, r->ref_time, m * sizeof(double));
+        r->ref_n -= m;
+        memmove(r->ref_time, r->ref_time + m, r->ref_n * sizeof(double));
+    } else {
+        for (size_t k = 0; k < m; k++)
+            grid[k] = (r->next_k + k) * r->grid.period;
+        r->next_k += m;
+    }
+    r->out.n = m;
+    r->rows += m;
+
+    signal_list_t *sl = r->spec->signal_list;
+    for (size_t i = 0; i < r->n_sources; i++) {
+        rs_source_t *s = &r->sources[i];
+        if (s->ignored)
+            continue;
+
+        resample_index(s->time, s->n, grid, m, r->index);
+        if (resample_opts.mode == resample_mode_linear)
+            resample_weights(s->time, s->n, grid, r->index, m, r->weight);
+
+        for (size_t c = 0; c < s->n_signals; c++, sl = sl->next) {
+            double *out = malloc(m * sizeof(double));
+            if (!out) {
+                r->failed = 1;
+                return NULL;
+            }
+            if (resample_opts.mode == resample_mode_linear)
+                resample_linear(s->values[c], s->n, r->index, r->weight, m, out);
+            else
+                resample_zoh(s->values[c], r->index, m, out);
+            hashtable_insert(r->out.ts_hash, strdup(sl->signal->name), out);
+        }
+
+        // Keep the samples around the last grid point for the next rows.
+        if (r->index[m - 1] > 0)
+            trim_source(s, r->index[m - 1]);
+    }
+
+    key->id = r->group;
+    key->bus = 0;
+    key->signal = 0;
+    return &r->out;
+}
+
+
+int resampler_failed(const resampler_t *r)
+{
+    return r->failed;
+}
+
+
+int resample_write(struct hashtable *msg_hashmap,
+                   struct can_writer_t *writer, const char *outfile)
+{
+    resampler_t *resamplers[RESAMPLE_MAX_GRIDS] = {NULL};
+    struct hashtable *grids = create_hashtable(16, frame_key_hash, frame_key_equal);
+    int ret = 1;
+
+    for (int g = 0; g < resample_opts.n_grids; g++) {
+        resamplers[g] = resampler_create(&resample_opts.grids[g], g);
+        if (!resamplers[g])
+            goto exit;
+    }
+
+    if (hashtable_count(msg_hashmap)) {
+        struct hashtable_itr *itr = hashtable_iterator(msg_hashmap);
+        do {
+            frame_key_t *key = hashtable_iterator_key(itr);
+            msg_series_t *msg = hashtable_iterator_value(itr);
+            if (!msg->spec || msg->n == 0)
+                continue;
+            for (int g = 0; g < resample_opts.n_grids; g++) {
+                if (resampler_push(resamplers[g], key, msg)) {
+                    free(itr);
+                    goto exit;
+                }
+            }
+        } while (hashtable_iterator_advance(itr));
+        free(itr);
+    }
+
+    // The whole grid at once, the writer gets one block per grid.
+    for (int g = 0; g < resample_opts.n_grids; g++) {
+        frame_key_t key;
+        const msg_series_t *out = resampler_pull(resamplers[g], 1,
+                                                 (size_t) -1, &key);
+        if (!out)
+            goto exit;
+        frame_key_t *grid_key = malloc(sizeof(frame_key_t));
+        *grid_key = key;
+        hashtable_insert(grids, grid_key, (void *) out);
+    }
+    ret = writer->write_fcn(grids, outfile);
+
+exit:
+    hashtable_destroy(grids, 0);
+    for (int g = 0; g < resample_opts.n_grids; g++)
+        resampler_free(resamplers[g]);
+    return ret;
+}
+
+
+void resample_index(const double *time, size_t n,
+                    const double *grid, size_t m, long *index)
+{
+    size_t j = 0;
+    for (size_t k = 0; k < m; k++) {
+        while (j < n && time[j] <= grid[k])
+            j++;
+        index[k] = (long) j - 1;
+    }
+}
+
+
+void resample_weights(const double *time, size_t n,
+                      const double *grid, const long *index, size_t m,
+                      double *weight)
+{
+    for (size_t k = 0; k < m; k++) {
+        long i = index[k];
+        if (i < 0 || (size_t) i + 1 >= n) {
+            weight[k] = 0;
+            continue;
+        }
+        double dt = time[i + 1] - time[i];
+        weight[k] = dt > 0 ? (grid[k] - time[i]) / dt : 0;
+    }
+}
+
+
+void resample_zoh(const double *restrict values, const long *restrict index,
+                  size_t m, double *restrict out)
+{
+    for (size_t k = 0; k < m; k++) {
+        long i = index[k];
+        double v = values[i < 0 ? 0 : i];
+        out[k] = i < 0 ? NAN : v;
+    }
+}
+
+
+void resample_linear(const double *restrict values, size_t n,
+                     const long *restrict index,
+                     const double *restrict weight, size_t m,
+                     double *restrict out)
+{
+    const long last = (long) n - 1;
+    for (size_t k = 0; k < m; k++) {
+        long i = index[k];
+        double lo = values[i < 0 ? 0 : i];
+        double hi = values[i < last ? i + 1 : last];
+        double v = lo + weight[k] * (hi - lo);
+        out[k] = i < 0 ? NAN : v;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stddef.h>
+#include "hashtable.h"
+#include "measurement.h"
+
+// Resampling of decoded signals onto a common time grid.
+//
+// Every grid gives one output message, a dense matrix of all decoded
+// signals named Message_Signal with one row per grid point. Before the
+// first sample of a signal its values are NaN, after the last they hold.
+typedef enum {
+    resample_mode_zoh = 0,  // last sample at or before the grid point
+    resample_mode_linear,   // between the samples around the grid point
+} resample_mode_t;
+
+typedef struct {
+    double period;          // seconds between grid points, 0 for reference
+    char *reference;        // message whose time stamps are the grid
+} resample_grid_t;
+
+#define RESAMPLE_MAX_GRIDS 8
+
+typedef struct {
+    resample_grid_t grids[RESAMPLE_MAX_GRIDS];
+    int n_grids;            // 0 disables resampling
+    resample_mode_t mode;
+} resample_opts_t;
+
+extern resample_opts_t resample_opts;
+
+// Parse a grid: a rate like 100Hz, a period like 10ms, 500us or 0.1s,
+// or otherwise the name of the reference message. Returns 0 on success.
+int resample_parse_grid(const char *arg, resample_grid_t *grid);
+
+typedef struct resampler_s resampler_t;
+
+resampler_t *resampler_create(const resample_grid_t *grid, unsigned int group);
+void resampler_free(resampler_t *r);
+
+/*
+ * Add a decoded block of a message, blocks of a message in time order.
+ * A block of no samples announces a message, output then waits for it.
+ * Returns 0 on success.
+ */
+int resampler_push(resampler_t *r, const frame_key_t *key,
+                   const msg_series_t *block);
+
+/*
+ * Next block of at most max_rows output rows, NULL if none is ready.
+ * Rows are ready once every message has samples past them, flush
+ * takes all that is left. The block stays valid until the next call.
+ * key gets the group key.
+ */
+const msg_series_t *resampler_pull(resampler_t *r, int flush,
+                                   size_t max_rows, frame_key_t *key);
+
+/*
+ * Whether a pull returned NULL on an error rather than for no rows
+ * ready, e.g. a flush of a grid without any decoded signals.
+ */
+int resampler_failed(const resampler_t *r);
+
+/* Resample a decoded measurement and write only the grids to outfile. */
+int resample_write(struct hashtable *msg_hashmap,
+                   struct can_writer_t *writer, const char *outfile);
+
+// Kernels over contiguous arrays. The index is a merge of the two time
+// vectors, the interpolation loops are branch free and vectorize.
+
+/* Index of the last sample at or before each grid point, -1 for none. */
+void resample_index(const double *time, size_t n,
+                    const double *grid, size_t m, long *index);
+
+/* Weight of the sample after index[k] for grid point k, 0 for none. */
+void resample_weights(const double *time, size_t n,
+                      const double *grid, const long *index, size_t m,
+                      double *weight);
+
+void resample_zoh(const double *values, const long *index, size_t m,
+                  double *out);
+void resample_linear(const double *values, size_t n,
+                     const long *index, const double *weight, size_t m,
+                     double *out);
+
+#endif /* RESAMPLE_H */
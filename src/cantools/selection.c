@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <regex.h>
+#endif
+
+#include "selection.h"
+
+typedef struct {
+    char *glob;         // NULL for a regular expression
+#ifndef _WIN32
+    regex_t re;
+#endif
+    int is_id;          // message pattern that is a CAN ID
+    uint32_t id;
+    int qualified;      // signal glob of the form Message.Signal
+} pattern_t;
+
+typedef struct {
+    pattern_t *patterns;
+    size_t n;
+    size_t cap;
+} pattern_list_t;
+
+struct selection_s {
+    pattern_list_t lists[n_select_kinds][2]; // keep, drop
+};
+
+
+selection_t *selection_create(void)
+{
+    return calloc(1, sizeof(selection_t));
+}
+
+
+void selection_free(selection_t *selection)
+{
+    if (!selection)
+        return;
+    for (int k = 0; k < n_select_kinds; k++) {
+        for (int d = 0; d < 2; d++) {
+            pattern_list_t *list = &selection->lists[k][d];
+            for (size_t i = 0; i < list->n; i++) {
+                if (list->patterns[i].glob)
+                    free(list->patterns[i].glob);
+#ifndef _WIN32
+                else
+                    regfree(&list->patterns[i].re);
+#endif
+            }
+            free(list->patterns);
+        }
+    }
+    free(selection);
+}
+
+
+/* Match a shell glob with *, ? and [...] against all of s. */
+static int glob_match(const char *glob, const char *s)
+{
+    const char *star = NULL, *resume = NULL;
+
+    while (*s) {
+        if (*glob == '*') {
+            star = ++glob;
+            resume = s;
+            continue;
+        }
+        if (*glob == '[') {
+            const char *p = glob + 1;
+            int negate = *p == '!' || *p == '^';
+            int found = 0;
+            if (negate)
+                p++;
+            do {
+                if (p[1] == '-' && p[2] && p[2] != ']') {
+                    found |= *s >= p[0] && *s <= p[2];
+                    p += 3;
+                } else {
+                    found |= *s == *p++;
+                }
+            } while (*p && *p != ']');
+            if (*p == ']' && found != negate) {
+                glob = p + 1;
+                s++;
+                continue;
+            }
+        } else if (*glob && (*glob == '?' || *glob == *s)) {
+            glob++;
+            s++;
+            continue;
+        }
+        // Mismatch, let the last star eat one more character.
+        if (!star)
+            return 0;
+        glob = star;
+        s = ++resume;
+    }
+    while (*glob == '*')
+        glob++;
+    return *glob == '\0';
+}
+
+
+static int pattern_match(const pattern_t *p, const char *s)
+{
+    if (p->glob)
+        return glob_match(p->glob, s);
+#ifndef _WIN32
+    return regexec(&p->re, s, 0, NULL, 0) == 0;
+#else
+    return 0;
+#endif
+}
+
+
+static int add_pattern(pattern_list_t *list, select_kind_t kind,
+                       const char *pattern)
+{
+    if (list->n == list->cap) {
+        list->cap = list->cap ? 2 * list->cap : 8;
+        list->patterns = realloc(list->patterns,
+                                 list->cap * sizeof(pattern_t));
+        if (!list->patterns)
+            return 1;
+    }
+    pattern_t *p = &list->patterns[list->n];
+    memset(p, 0, sizeof(pattern_t));
+
+    if (0 == strncmp(pattern, "re:", 3)) {
+#ifndef _WIN32
+        // Anchored, like globs.
+        size_t len = strlen(pattern + 3) + 5;
+        char *anchored = malloc(len);
+        snprintf(anchored, len, "^(%s)$", pattern + 3);
+        int err = regcomp(&p->re, anchored, REG_EXTENDED | REG_NOSUB);
+        free(anchored);
+        if (err) {
+            fprintf(stderr, "error: invalid regular expression %s\n",
+                    pattern + 3);
+            return 1;
+        }
+#else
+        fprintf(stderr, "error: regular expressions are not supported\n");
+        return 1;
+#endif
+    } else {
+        p->glob = strdup(pattern);
+    }
+
+    if (kind == select_message) {
+        char *end;
+        unsigned long id = strtoul(pattern, &end, 0);
+        p->is_id = *pattern >= '0' && *pattern <= '9' && *end == '\0';
+        p->id = id;
+    }
+    // A dot in a regular expression is most likely a wildcard, those
+    // are tried against both forms instead.
+    p->qualified = kind == select_signal && p->glob
+        && strchr(pattern, '.') != NULL;
+    list->n++;
+    return 0;
+}
+
+
+/* Add the patterns of filename, one per line. */
+static int add_pattern_file(pattern_list_t *list, select_kind_t kind,
+                            const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "error: cannot open %s\n", filename);
+        return 1;
+    }
+
+    char line[1024];
+    int err = 0;
+    while (!err && fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0' && line[0] != '#')
+            err = add_pattern(list, kind, line);
+    }
+    fclose(fp);
+    return err;
+}
+
+
+int selection_add(selection_t *selection, select_kind_t kind,
+                  int drop, const char *pattern)
+{
+    pattern_list_t *list = &selection->lists[kind][drop ? 1 : 0];
+    if (pattern[0] == '@')
+        return add_pattern_file(list, kind, pattern + 1);
+    return add_pattern(list, kind, pattern);
+}
+
+
+/* Signal patterns given, the signals of a message decide on its frames. */
+static int has_signal_patterns(const selection_t *selection)
+{
+    return selection->lists[select_signal][0].n
+        || selection->lists[select_signal][1].n;
+}
+
+
+int selection_needs_spec(const selection_t *selection)
+{
+    if (!selection)
+        return 0;
+    if (has_signal_patterns(selection))
+        return 1;
+    for (int d = 0; d < 2; d++) {
+        const pattern_list_t *list = &selection->lists[select_message][d];
+        for (size_t i = 0; i < list->n; i++) {
+            if (!list->patterns[i].is_id)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+
+/* Any pattern of list matching the frame, by ID or by name. */
+static int match_message(const pattern_list_t *list,
+                         uint32_t id, const message_t *spec)
+{
+    for (size_t i = 0; i < list->n; i++) {
+        const pattern_t *p = &list->patterns[i];
+        if (p->is_id ? p->id == id || p->id == (id & 0x1FFFFFFF)
+            : spec && pattern_match(p, spec->name))
+            return 1;
+    }
+    return 0;
+}
+
+
+static int match_bus(const pattern_list_t *list, unsigned int bus)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%u", bus);
+    for (size_t i = 0; i < list->n; i++) {
+        if (pattern_match(&list->patterns[i], name))
+            return 1;
+    }
+    return 0;
+}
+
+
+int selection_frame(const selection_t *selection,
+                    unsigned int bus, uint32_t id, const message_t *spec)
+{
+    if (!selection)
+        return 1;
+
+    const pattern_list_t *keep = selection->lists[select_bus];
+    if ((keep[0].n && !match_bus(&keep[0], bus)) || match_bus(&keep[1], bus))
+        return 0;
+
+    keep = selection->lists[select_message];
+    return (!keep[0].n || match_message(&keep[0], id, spec))
+        && !match_message(&keep[1], id, spec);
+}
+
+
+static int match_signal(const pattern_list_t *list,
+                        const message_t *spec, const char *signal)
+{
+    char *qualified = NULL;
+    int found = 0;
+
+    for (size_t i = 0; i < list->n && !found; i++) {
+        const pattern_t *p = &list->patterns[i];
+        if (p->glob && !p->qualified) {
+            found = pattern_match(p, signal);
+            continue;
+        }
+        if (!qualified) {
+            size_t len = strlen(spec->name) + strlen(signal) + 2;
+            qualified = malloc(len);
+            snprintf(qualified, len, "%s.%s", spec->name, signal);
+        }
+        found = pattern_match(p, qualified)
+            || (!p->glob && pattern_match(p, signal));
+    }
+    free(qualified);
+    return found;
+}
+
+
+int selection_signal(const selection_t *selection,
+                     const message_t *spec, const char *signal)
+{
+    if (!selection)
+        return 1;
+
+    const pattern_list_t *keep = selection->lists[select_signal];
+    return (!keep[0].n || match_signal(&keep[0], spec, signal))
+        && !match_signal(&keep[1], spec, signal);
+}
+
+
+int selection_signals(const selection_t *selection, const message_t *spec)
+{
+    if (!selection || !has_signal_patterns(selection))
+        return 1;
+    if (!spec)
+        return 0;
+
+    for (signal_list_t *sl = spec->signal_list; sl; sl = sl->next) {
+        if (selection_signal(selection, spec, sl->signal->name))
+            return 1;
+    }
+    return 0;
+}
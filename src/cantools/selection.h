@@ -0,0 +1,47 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <stdint.h>
+#include "dbcmodel.h"
+
+// What to keep of a measurement.
+//
+// An item is kept when no keep pattern of its kind is given or one of
+// them matches, and no drop pattern matches. Patterns are shell globs,
+// or POSIX extended regular expressions when prefixed with "re:".
+// "@file" adds the patterns of file, one per line.
+typedef enum {
+    select_bus = 0,     // bus number
+    select_message,     // message name, or CAN ID in decimal or 0x hex
+    select_signal,      // Signal, or Message.Signal for a glob with a
+                        // dot, regular expressions are tried on both
+    n_select_kinds
+} select_kind_t;
+
+typedef struct selection_s selection_t;
+
+selection_t *selection_create(void);
+void selection_free(selection_t *selection);
+
+// Returns 0 on success, prints why and returns 1 otherwise.
+int selection_add(selection_t *selection, select_kind_t kind,
+                  int drop, const char *pattern);
+
+// Functions below take NULL for a selection that keeps everything.
+
+// Message or signal names are matched, frames must be looked up in
+// the DBCs.
+int selection_needs_spec(const selection_t *selection);
+
+// Frame of bus and id, spec is its DBC message or NULL.
+int selection_frame(const selection_t *selection,
+                    unsigned int bus, uint32_t id, const message_t *spec);
+
+int selection_signal(const selection_t *selection,
+                     const message_t *spec, const char *signal);
+
+// Any signal of spec kept, so its frames are worth storing. With signal
+// patterns given, frames without a spec have no signal to keep.
+int selection_signals(const selection_t *selection, const message_t *spec);
+
+#endif /* SELECTION_H */
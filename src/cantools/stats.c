@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "stats.h"
+
+stats_t stats;
+
+// Frame accounting per bus and ID, for the report.
+typedef struct {
+    unsigned int bus;
+    uint32_t id;
+    uint64_t unknown;
+    uint64_t mismatched;
+} stats_id_t;
+
+static stats_id_t *ids;
+static size_t n_ids, cap_ids;
+
+// Rows of the text report, JSON lists all.
+#define STATS_MAX_ROWS 20
+
+
+uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+void stats_frames(unsigned int bus, uint32_t id,
+                  uint64_t unknown, uint64_t mismatched)
+{
+    if (n_ids == cap_ids) {
+        size_t cap = cap_ids ? 2 * cap_ids : 64;
+        stats_id_t *grown = realloc(ids, cap * sizeof(stats_id_t));
+        if (!grown)
+            return;
+        ids = grown;
+        cap_ids = cap;
+    }
+    stats_id_t *s = &ids[n_ids++];
+    s->bus = bus;
+    s->id = id;
+    s->unknown = unknown;
+    s->mismatched = mismatched;
+}
+
+
+static int compare_ids(const void *a, const void *b)
+{
+    const stats_id_t *x = a, *y = b;
+    if (x->bus != y->bus)
+        return x->bus < y->bus ? -1 : 1;
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+
+uint64_t stats_file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t) st.st_size : 0;
+}
+
+
+uint64_t stats_peak_rss(void)
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return (uint64_t) usage.ru_maxrss * 1024; // kB on Linux
+#endif
+    return 0;
+}
+
+
+static const char *counter_names[n_stat_counters] = {
+    "containers",
+    "compressed_bytes",
+    "uncompressed_bytes",
+    "frames",
+    "unknown_ids",
+    "unknown_frames",
+    "dlc_mismatch",
+    "signals",
+    "values",
+    "bytes_written",
+};
+
+static const char *timer_names[n_stat_timers] = {
+    "read",
+    "inflate",
+    "wait",
+    "decode",
+    "write",
+};
+
+// What each timer gets throughput of, n_stat_counters for none.
+static const stat_counter_t timer_counters[n_stat_timers] = {
+    stat_frames,
+    stat_uncompressed_bytes,
+    n_stat_counters,
+    stat_values,
+    stat_bytes_written,
+};
+
+
+/* s as a JSON string, control characters are dropped */
+static void json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', fp);
+        if ((unsigned char) *s >= 0x20)
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+
+void stats_report(FILE *fp, int json, const char *input, double wall)
+{
+    uint64_t rss = stats_peak_rss();
+
+    qsort(ids, n_ids, sizeof(stats_id_t), compare_ids);
+    if (json) {
+        fprintf(fp, "{\"input\": ");
+        json_string(fp, input ? input : "-");
+        fprintf(fp, ", \"wall_s\": %.6f, \"peak_rss_bytes\": %llu",
+                wall, (unsigned long long) rss);
+        for (int c = 0; c < n_stat_counters; c++)
+            fprintf(fp, ", \"%s\": %llu", counter_names[c],
+                    (unsigned long long) stats.counters[c]);
+        for (int t = 0; t < n_stat_timers; t++)
+            fprintf(fp, ", \"%s_s\": %.6f", timer_names[t], stats.ns[t] * 1e-9);
+        fprintf(fp, ", \"ids\": [");
+        for (size_t i = 0; i < n_ids; i++)
+            fprintf(fp, "%s{\"bus\": %u, \"id\": %lu, \"unknown\": %llu, "
+                    "\"dlc_mismatch\": %llu}", i ? ", " : "",
+                    ids[i].bus, (unsigned long) ids[i].id,
+                    (unsigned long long) ids[i].unknown,
+                    (unsigned long long) ids[i].mismatched);
+        fprintf(fp, "]}\n");
+        return;
+    }
+
+    fprintf(fp, "Statistics of %s\n", input ? input : "<stdin>");
+    fprintf(fp, "%-20s %14.3f s\n", "wall", wall);
+    fprintf(fp, "%-20s %14.1f MB\n", "peak rss", rss / 1e6);
+    for (int c = 0; c < n_stat_counters; c++)
+        fprintf(fp, "%-20s %14llu\n", counter_names[c],
+                (unsigned long long) stats.counters[c]);
+    if (stats.counters[stat_uncompressed_bytes])
+        fprintf(fp, "%-20s %14.2f\n", "compression ratio",
+                (double) stats.counters[stat_uncompressed_bytes]
+                / stats.counters[stat_compressed_bytes]);
+    for (int t = 0; t < n_stat_timers; t++) {
+        double s = stats.ns[t] * 1e-9;
+        fprintf(fp, "%-20s %14.3f s", timer_names[t], s);
+        if (s > 0 && timer_counters[t] != n_stat_counters)
+            fprintf(fp, "  %12.0f %s/s", stats.counters[timer_counters[t]] / s,
+                    counter_names[timer_counters[t]]);
+        fprintf(fp, "\n");
+    }
+    if (n_ids)
+        fprintf(fp, "%-4s %10s %14s %14s\n",
+                "bus", "id", "unknown", "dlc mismatch");
+    for (size_t i = 0; i < n_ids && i < STATS_MAX_ROWS; i++)
+        fprintf(fp, "%-4u %10lX %14llu %14llu\n", ids[i].bus,
+                (unsigned long) ids[i].id,
+                (unsigned long long) ids[i].unknown,
+                (unsigned long long) ids[i].mismatched);
+    if (n_ids > STATS_MAX_ROWS)
+        fprintf(fp, "... and %zu more IDs, all of them with --stats=json\n",
+                n_ids - STATS_MAX_ROWS);
+}
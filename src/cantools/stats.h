@@ -0,0 +1,83 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Counters and stage timers of a conversion, for cantomat --stats.
+//
+// The hooks are macros. Configured with -DCANTOOLS_STATS=OFF they
+// compile to nothing, otherwise they cost a branch until enabled.
+// Counters are added to atomically, timers sum over threads.
+typedef enum {
+    stat_containers = 0,        // BLF log containers read
+    stat_compressed_bytes,      // container bytes as stored
+    stat_uncompressed_bytes,    // container bytes inflated
+    stat_frames,                // CAN frames read
+    stat_unknown_ids,           // bus and ID pairs not in any DBC
+    stat_unknown_frames,        // frames of those
+    stat_dlc_mismatch,          // frames dropped, DLC differs from the first
+    stat_signals,               // signals decoded, per block streaming
+    stat_values,                // signal values decoded
+    stat_bytes_written,         // bytes of the output files, compressed
+    n_stat_counters
+} stat_counter_t;
+
+typedef enum {
+    stat_read = 0,              // parsing the input into frames
+    stat_inflate,               // of which inflating containers
+    stat_wait,                  // of which waiting for the file
+    stat_decode,
+    stat_write,
+    n_stat_timers
+} stat_timer_t;
+
+typedef struct {
+    int enabled;
+    uint64_t counters[n_stat_counters];
+    uint64_t ns[n_stat_timers];
+} stats_t;
+
+extern stats_t stats;
+
+/* Monotonic clock in ns. */
+uint64_t stats_now(void);
+
+/*
+ * Frames of bus and id that were unknown or had a mismatching DLC,
+ * listed in the report. Called once per ID, not thread safe.
+ */
+void stats_frames(unsigned int bus, uint32_t id,
+                  uint64_t unknown, uint64_t mismatched);
+
+/* Size of the file at path in bytes, 0 where unknown. */
+uint64_t stats_file_size(const char *path);
+
+/* Peak resident set size in bytes, 0 where unknown. */
+uint64_t stats_peak_rss(void);
+
+/*
+ * Report all counters and timers of converting input, NULL for stdin.
+ * wall is the total run time in s.
+ */
+void stats_report(FILE *fp, int json, const char *input, double wall);
+
+#ifndef CANTOOLS_NO_STATS
+#define STATS_ADD(counter, n) do { \
+        if (stats.enabled) \
+            __atomic_fetch_add(&stats.counters[counter], (uint64_t) (n), \
+                               __ATOMIC_RELAXED); \
+    } while (0)
+#define STATS_START(t) uint64_t t = stats.enabled ? stats_now() : 0
+#define STATS_STOP(timer, t) do { \
+        if (stats.enabled) \
+            __atomic_fetch_add(&stats.ns[timer], stats_now() - (t), \
+                               __ATOMIC_RELAXED); \
+    } while (0)
+#else
+#define STATS_ADD(counter, n) do { } while (0)
+#define STATS_START(t) do { } while (0)
+#define STATS_STOP(timer, t) do { } while (0)
+#endif
+
+#endif /* STATS_H */
@@ -1,15 +1,38 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include "writer.h"
+#include "hashtable_itr.h"
 
 
 // Collection of all available writers by pointer.
 extern can_writer_t matfile_writer;
 extern can_writer_t hdf5_writer;
+extern can_writer_t arrow_writer;
+extern can_writer_t feather_writer;
+extern can_writer_t parquet_writer;
+extern can_writer_t cta_writer;
+extern can_writer_t ctf_writer;
 static can_writer_t *all_writers[] = {
     &matfile_writer,
     &hdf5_writer,
+    &arrow_writer,
+    &feather_writer,
+    &parquet_writer,
+    &cta_writer,
+    &ctf_writer,
+};
+
+// Defaults, changed from the command line.
+writer_opts_t writer_opts = {
+    .level = 4,
+    .codec = codec_deflate,
+    .chunk = 16384,
+    .single = 0,
+    .threads = 1,
+    .per_message = 0,
+    .mat73 = 0,
 };
 
 
@@ -27,15 +50,74 @@ static int endswith(const char *str, const char *tail)
     return 0 == strcmp(needle, tail);
 }
 
-/* Finds the most suitable writer for writing the given file. */
-writer_f guess_writer(const char *outfile)
+/* Finds the writer format for the given file, NULL if unknown. */
+can_writer_t *find_writer(const char *outfile)
 {
     size_t n_formats = sizeof(all_writers)/sizeof(all_writers[0]);
 
     for (int i=0; i < n_formats; i++)
     {
         if (endswith(outfile, all_writers[i]->ext))
-            return all_writers[i]->write_fcn;
+            return all_writers[i];
     }
     return NULL;
 }
+
+/* Finds the most suitable writer for writing the given file. */
+writer_f guess_writer(const char *outfile)
+{
+    can_writer_t *writer = find_writer(outfile);
+    return writer ? writer->write_fcn : NULL;
+}
+
+
+/* Codec by name, -1 if unknown. */
+int writer_codec_from_name(const char *name)
+{
+    const char *names[] = {"deflate", "lz4", "zstd"};
+
+    for (size_t i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+    {
+        if (0 == strcmp(name, names[i]))
+            return (int) i;
+    }
+    return -1;
+}
+
+
+/* Check if another message written to msg_hash is named as msg. */
+static int name_shared(struct hashtable *msg_hash, const msg_series_t *msg)
+{
+    int shared = 0;
+    struct hashtable_itr *itr = hashtable_iterator(msg_hash);
+    do {
+        const msg_series_t *other = hashtable_iterator_value(itr);
+        shared = other != msg && other->ts_hash
+            && hashtable_count(other->ts_hash) > 0
+            && 0 == strcmp(other->name, msg->name);
+    } while (!shared && hashtable_iterator_advance(itr));
+    free(itr);
+    return shared;
+}
+
+/*
+ * Path of the file of a message in a directory of files, outdir/name.ext.
+ * Messages sharing a name, like the same DBC on several buses, get bus
+ * and ID added, outdir/name_1_0x200.ext, so no file replaces another.
+ * The path is malloced.
+ */
+char *message_path(struct hashtable *msg_hash, const char *outdir,
+                   const frame_key_t *key, const msg_series_t *msg,
+                   const char *ext)
+{
+    size_t len = strlen(outdir) + strlen(msg->name) + strlen(ext)
+        + sizeof("/_255_0x12345678.");
+    char *path = malloc(len);
+
+    if (path && name_shared(msg_hash, msg))
+        snprintf(path, len, "%s/%s_%u_0x%X.%s", outdir, msg->name,
+                 key->bus, key->id, ext);
+    else if (path)
+        snprintf(path, len, "%s/%s.%s", outdir, msg->name, ext);
+    return path;
+}
@@ -1,18 +1,61 @@
 #ifndef _WRITER_H_
 #define _WRITER_H_
 
+#include <stddef.h>
 #include "hashtable.h"
+#include "measurement.h"
 
 typedef int (* writer_f)(struct hashtable *msgs, const char *outfile);
 
+// Streaming writers get decoded blocks one message at a time.
+// The block holds msg->n samples in msg->time and msg->ts_hash,
+// consecutive blocks of the same message are appended.
+typedef void *(* stream_open_f)(const char *outfile);
+typedef int (* stream_append_f)(void *stream,
+                                const frame_key_t *key,
+                                const msg_series_t *msg);
+typedef int (* stream_close_f)(void *stream);
+
 // Instancer for a writer format.
 typedef struct can_writer_t
 {
     const char *name;
     const char *ext;
     writer_f write_fcn;
+    // Optional, NULL if the format cannot be written incrementally.
+    stream_open_f open_fcn;
+    stream_append_f append_fcn;
+    stream_close_f close_fcn;
+    // Writes the raw frames of every message, so nothing is decoded.
+    int raw;
 } can_writer_t;
 
+// Compression codecs, not all writers support all of them.
+typedef enum {
+    codec_deflate = 0,
+    codec_lz4,
+    codec_zstd,
+} writer_codec_t;
+
+// Output tunables, shared by all writers.
+typedef struct writer_opts_t
+{
+    int level;            // compression level, 0 disables compression
+    writer_codec_t codec;
+    size_t chunk;         // samples per chunk
+    int single;           // store signal values as float32
+    int threads;          // compression threads, where supported
+    int per_message;      // MAT: one variable per message
+    int mat73;            // MAT: write v7.3 (HDF5 based) files
+} writer_opts_t;
+
+extern writer_opts_t writer_opts;
+
+can_writer_t *find_writer(const char *outfile);
 writer_f guess_writer(const char *outfile);
+int writer_codec_from_name(const char *name);
+char *message_path(struct hashtable *msg_hash, const char *outdir,
+                   const frame_key_t *key, const msg_series_t *msg,
+                   const char *ext);
 
 #endif /* _WRITER_H_ */
@@ -0,0 +1,560 @@
+#define _GNU_SOURCE // memmem
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "ascreader.h"
+
+/*
+ * Lines look like
+ *
+ *    0.001234 1  100             Rx   d 8 01 02 03 04 05 06 07 08  ...
+ *    0.002000 2  18FEF100x       Rx   d 8 00 00 00 00 00 00 00 00  ...
+ *    0.003000 CANFD   1 Rx        100  Name  1 0 8  8 01 02 ...    ...
+ *
+ * after a header that says whether IDs and bytes are hex or decimal
+ * and time stamps absolute or relative to the line before. Any other
+ * line with a time stamp is an event without a frame.
+ *
+ * Time stamps and data bytes are parsed eight characters at a time in
+ * a 64 bit word (SWAR), so no instruction set extension is needed.
+ */
+
+#define ASC_CHUNK (4 << 20) // bytes of text per parsing job
+
+#define ASC_ONES 0x0101010101010101ULL
+#define ASC_HIGH (ASC_ONES * 0x80)
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ASC_SWAR 1
+#else
+#define ASC_SWAR 0
+#endif
+
+typedef struct {
+    int hex;            // IDs and bytes in hex, else decimal
+    int relative;       // time stamps relative to the line before
+} AscFormat;
+
+typedef struct {
+    const AscFormat *format;
+    const char *begin;  // whole lines
+    const char *end;
+    const char *limit;  // end of the text, words may be read up to it
+    canMessage_t *frames;
+    uint64_t *times;    // ns of the frames, from the chunk start if relative
+    size_t n, cap;
+    uint64_t span;      // ns, of all relative time stamps
+    unsigned long bigDlc; // frames skipped, more than 8 bytes
+    int failed;
+} AscChunk;
+
+typedef struct {
+    AscChunk *chunks;
+    int n;
+    int next;           // next chunk to parse, taken atomically
+} AscWave;
+
+static const signed char ascHex[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+}; // digit value + 1, 0 for no digit
+
+
+static int ascSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+static const char *ascSkipSpace(const char *p, const char *end)
+{
+    while (p < end && ascSpace(*p))
+        p++;
+    return p;
+}
+
+
+static const char *ascSkipToken(const char *p, const char *end)
+{
+    while (p < end && !ascSpace(*p))
+        p++;
+    return ascSkipSpace(p, end);
+}
+
+
+#if ASC_SWAR
+static uint64_t ascLoad(const char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+// Top bit of each byte of x that is above m and below n, m, n < 128.
+static uint64_t ascBetween(uint64_t x, unsigned m, unsigned n)
+{
+    uint64_t low = x & (ASC_ONES * 127);
+    return (ASC_ONES * (127 + n) - low) & ~x
+        & (low + ASC_ONES * (127 - m)) & ASC_HIGH;
+}
+
+
+// Value of 8 decimal digits, the first one in the lowest byte.
+static uint32_t ascSwar8(uint64_t v)
+{
+    v -= ASC_ONES * '0';
+    v = v * 10 + (v >> 8);
+    v = ((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))
+         + ((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+    return (uint32_t) v;
+}
+#endif
+
+
+// Parses up to max decimal digits at *pp into value, returns how many.
+static int ascDigits(const char **pp, const char *limit, int max,
+                     uint64_t *value)
+{
+    static const uint64_t pow10[9] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+    };
+    const char *p = *pp;
+    uint64_t v = 0;
+    int n = 0;
+
+#if ASC_SWAR
+    while (n < max && limit - p >= 8) {
+        uint64_t w = ascLoad(p);
+        uint64_t digits = ascBetween(w, '0' - 1, '9' + 1);
+        int k = digits == ASC_HIGH ? 8 : __builtin_ctzll(~digits & ASC_HIGH) / 8;
+        if (k > max - n)
+            k = max - n;
+        if (k == 0)
+            break;
+        // The k digits to the top, zeros in front of them.
+        if (k < 8)
+            w = (w << (8 * (8 - k))) | (ASC_ONES * '0' >> (8 * k));
+        v = v * pow10[k] + ascSwar8(w);
+        n += k;
+        p += k;
+        if (k < 8)
+            break;
+    }
+#endif
+    while (n < max && p < limit && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+        n++;
+    }
+    *pp = p;
+    *value = v;
+    return n;
+}
+
+
+// Time stamp in seconds with up to 9 decimals, as ns.
+static int ascTime(const char **pp, const char *end, const char *limit,
+                   uint64_t *ns)
+{
+    static const uint32_t scale[10] = {
+        1000000000, 100000000, 10000000, 1000000, 100000,
+        10000, 1000, 100, 10, 1
+    };
+    const char *p = ascSkipSpace(*pp, end);
+    uint64_t sec, frac = 0;
+    int n;
+
+    if (!ascDigits(&p, end < limit ? limit : end, 12, &sec))
+        return 0;
+    if (p < end && *p == '.') {
+        p++;
+        n = ascDigits(&p, limit, 9, &frac);
+        frac *= scale[n];
+        while (p < end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    if (p < end && !ascSpace(*p))
+        return 0;
+    *ns = sec * 1000000000 + frac;
+    *pp = p;
+    return 1;
+}
+
+
+// CAN ID, an x after it marks an extended one.
+static int ascId(const char **pp, const char *end, int hex, uint32_t *id)
+{
+    const char *p = *pp;
+    uint32_t v = 0;
+    int n = 0;
+
+    for (; p < end && n < 10; p++, n++) {
+        int d = hex ? ascHex[(unsigned char) *p] - 1
+            : (*p >= '0' && *p <= '9' ? *p - '0' : -1);
+        if (d < 0)
+            break;
+        v = v * (hex ? 16 : 10) + d;
+    }
+    if (!n)
+        return 0;
+    if (p < end && (*p == 'x' || *p == 'X')) {
+        v |= 0x80000000; // as in BLF and DBC
+        p++;
+    }
+    if (p < end && !ascSpace(*p))
+        return 0;
+    *id = v;
+    *pp = p;
+    return 1;
+}
+
+
+// n data bytes, two hex digits each and one space between them.
+static int ascHexBytes(const char *p, const char *end, const char *limit,
+                       int n, uint8_t *out)
+{
+    int i = 0;
+
+#if ASC_SWAR
+    // Three bytes in "HH HH HH" per word.
+    const uint64_t digitLanes = 0x8080008080008080ULL;
+    while (n - i >= 3 && limit - p >= 8) {
+        uint64_t w = ascLoad(p);
+        uint64_t hex = ascBetween(w, '0' - 1, '9' + 1)
+            | ascBetween(w | ASC_ONES * 0x20, 'a' - 1, 'f' + 1);
+        if ((hex & digitLanes) != digitLanes
+            || ((w >> 16) & 0xFF) != ' ' || ((w >> 40) & 0xFF) != ' ')
+            break;
+        w = (w & ASC_ONES * 0x0F) + 9 * ((w >> 6) & ASC_ONES);
+        w = (w << 4) | (w >> 8);
+        out[i] = (uint8_t) w;
+        out[i + 1] = (uint8_t) (w >> 24);
+        out[i + 2] = (uint8_t) (w >> 48);
+        i += 3;
+        p = ascSkipSpace(p + 8, end);
+    }
+#endif
+    for (; i < n; i++) {
+        int hi, lo;
+        if (end - p < 2)
+            return 0;
+        hi = ascHex[(unsigned char) p[0]] - 1;
+        lo = ascHex[(unsigned char) p[1]] - 1;
+        if (hi < 0 || lo < 0)
+            return 0;
+        out[i] = (uint8_t) (hi << 4 | lo);
+        p = ascSkipSpace(p + 2, end);
+    }
+    return 1;
+}
+
+
+static int ascDecBytes(const char *p, const char *end, int n, uint8_t *out)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        uint64_t v;
+        if (!ascDigits(&p, end, 3, &v) || v > 255)
+            return 0;
+        out[i] = (uint8_t) v;
+        p = ascSkipSpace(p, end);
+    }
+    return 1;
+}
+
+
+/*
+ * Parses the line from p to end. Returns 0 for a line without a time
+ * stamp, 1 for an event without a frame and 2 for a frame.
+ */
+static int ascLine(AscChunk *c, const char *p, const char *end,
+                   canMessage_t *m, uint64_t *ns)
+{
+    const AscFormat *f = c->format;
+    uint64_t channel, dlc = 0, len;
+    int fd = 0;
+
+    if (!ascTime(&p, end, c->limit, ns))
+        return 0;
+    p = ascSkipSpace(p, end);
+    if (end - p > 5 && memcmp(p, "CANFD", 5) == 0 && ascSpace(p[5])) {
+        fd = 1;
+        p = ascSkipSpace(p + 5, end);
+    }
+    if (!ascDigits(&p, end, 3, &channel) || p == end || !ascSpace(*p))
+        return 1;
+    p = ascSkipSpace(p, end);
+
+    if (fd) {
+        // CANFD <ch> <dir> <id> [<name>] <brs> <esi> <dlc> <len> <bytes>
+        p = ascSkipToken(p, end);
+        if (!ascId(&p, end, f->hex, &m->id))
+            return 1;
+        p = ascSkipSpace(p, end);
+        if (end - p > 1 && !((*p == '0' || *p == '1') && ascSpace(p[1])))
+            p = ascSkipToken(p, end);
+        p = ascSkipToken(ascSkipToken(p, end), end);
+        if (!ascDigits(&p, end, 2, &dlc)) {
+            if (p == end || ascHex[(unsigned char) *p] == 0)
+                return 1;
+            p++; // DLC above 9
+        }
+        p = ascSkipSpace(p, end);
+        if (!ascDigits(&p, end, 2, &len))
+            return 1;
+        p = ascSkipSpace(p, end);
+        if (len > 8) {
+            c->bigDlc++;
+            return 1;
+        }
+        dlc = len;
+    } else {
+        // <ch> <id> <dir> d <dlc> <bytes>, r for remote frames
+        if (!ascId(&p, end, f->hex, &m->id))
+            return 1;
+        p = ascSkipToken(ascSkipSpace(p, end), end);
+        if (end - p < 2 || p[0] != 'd' || !ascSpace(p[1]))
+            return 1;
+        p = ascSkipSpace(p + 1, end);
+        if (p == end || ascHex[(unsigned char) *p] == 0)
+            return 1;
+        dlc = ascHex[(unsigned char) *p] - 1;
+        p = ascSkipSpace(p + 1, end);
+        if (dlc > 8) {
+            c->bigDlc++;
+            return 1;
+        }
+    }
+    if (!(f->hex ? ascHexBytes(p, end, c->limit, (int) dlc, m->byte_arr)
+          : ascDecBytes(p, end, (int) dlc, m->byte_arr)))
+        return 1;
+    m->bus = (uint8_t) channel;
+    m->dlc = (uint8_t) dlc;
+    return 2;
+}
+
+
+static void ascParseChunk(AscChunk *c)
+{
+    const char *p = c->begin;
+
+    while (p < c->end) {
+        const char *eol = memchr(p, '\n', c->end - p);
+        const char *next = eol ? eol + 1 : c->end;
+        canMessage_t m;
+        uint64_t ns;
+        int kind;
+
+        if (!eol)
+            eol = c->end;
+        kind = ascLine(c, p, eol, &m, &ns);
+        p = next;
+        if (!kind)
+            continue;
+        if (c->format->relative) {
+            c->span += ns;
+            ns = c->span;
+        }
+        if (kind == 1)
+            continue;
+
+        if (c->n == c->cap) {
+            size_t cap = c->cap ? 2 * c->cap : 4096;
+            canMessage_t *frames = realloc(c->frames, cap * sizeof(*frames));
+            uint64_t *times = frames
+                ? realloc(c->times, cap * sizeof(*times)) : NULL;
+            if (frames)
+                c->frames = frames;
+            if (!frames || !times) {
+                c->failed = 1;
+                return;
+            }
+            c->times = times;
+            c->cap = cap;
+        }
+        c->frames[c->n] = m;
+        c->times[c->n] = ns;
+        c->n++;
+    }
+}
+
+
+static void *ascWorker(void *arg)
+{
+    AscWave *wave = (AscWave *) arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&wave->next, 1, __ATOMIC_RELAXED)) < wave->n)
+        ascParseChunk(&wave->chunks[i]);
+    return NULL;
+}
+
+
+// Reads the header up to the first line with a time stamp.
+static const char *ascHeader(const char *p, const char *end, AscFormat *f)
+{
+    f->hex = 1;
+    f->relative = 0;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        const char *q = ascSkipSpace(p, eol ? eol : end);
+        size_t n = (eol ? eol : end) - p;
+
+        if (q < end && *q >= '0' && *q <= '9')
+            return p;
+        if (memmem(p, n, "base dec", 8))
+            f->hex = 0;
+        if (memmem(p, n, "timestamps relative", 19))
+            f->relative = 1;
+        p = eol ? eol + 1 : end;
+    }
+    return p;
+}
+
+
+// The whole of fp, mapped or read. *mapped is set for munmap.
+static char *ascInput(FILE *fp, size_t *size, int *mapped)
+{
+    char *text = NULL;
+    size_t cap = 0, n = 0, got;
+#ifndef _WIN32
+    struct stat st;
+    int fd = fileno(fp);
+#endif
+
+    *mapped = 0;
+#ifndef _WIN32
+    if (fd >= 0 && ftell(fp) == 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size > 0) {
+        text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text != MAP_FAILED) {
+            madvise(text, st.st_size, MADV_SEQUENTIAL);
+            *mapped = 1;
+            *size = st.st_size;
+            return text;
+        }
+        text = NULL;
+    }
+#endif
+    do {
+        if (n == cap) {
+            char *grown = realloc(text, cap ? 2 * cap : ASC_CHUNK);
+            if (!grown) {
+                free(text);
+                return NULL;
+            }
+            text = grown;
+            cap = cap ? 2 * cap : ASC_CHUNK;
+        }
+        got = fread(text + n, 1, cap - n, fp);
+        n += got;
+    } while (got);
+    *size = n;
+    return text;
+}
+
+
+void ascReader_processFile(FILE *fp, msgRxCb_t msgRxCb, void *cbData)
+{
+    AscFormat format;
+    AscChunk *chunks;
+    AscWave wave;
+    pthread_t *threads;
+    size_t size;
+    int mapped, jobs, i;
+    unsigned long bigDlc = 0;
+    uint64_t offset = 0;
+
+    char *text = ascInput(fp, &size, &mapped);
+    if (!text) {
+        fprintf(stderr, "ascReader_processFile: out of memory\n");
+        return;
+    }
+    const char *end = text + size;
+    const char *p = ascHeader(text, end, &format);
+
+    jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1)
+        jobs = 1;
+    chunks = calloc(jobs, sizeof(AscChunk));
+    threads = calloc(jobs, sizeof(pthread_t));
+    if (!chunks || !threads) {
+        fprintf(stderr, "ascReader_processFile: out of memory\n");
+        goto exit;
+    }
+
+    // Waves of one chunk per thread, passed on in order.
+    while (p < end) {
+        int started = 0;
+        wave.chunks = chunks;
+        wave.n = 0;
+        wave.next = 0;
+        while (wave.n < jobs && p < end) {
+            AscChunk *c = &chunks[wave.n++];
+            const char *stop = end - p > ASC_CHUNK ? p + ASC_CHUNK : end;
+            const char *eol = stop < end ? memchr(stop, '\n', end - stop) : NULL;
+            c->format = &format;
+            c->begin = p;
+            c->end = eol ? eol + 1 : end;
+            c->limit = end;
+            c->n = 0;
+            c->span = 0;
+            p = c->end;
+        }
+        for (i = 1; i < wave.n; i++) {
+            if (pthread_create(&threads[i], NULL, ascWorker, &wave) != 0)
+                break;
+            started = i;
+        }
+        ascWorker(&wave);
+        for (i = 1; i <= started; i++)
+            pthread_join(threads[i], NULL);
+
+        for (i = 0; i < wave.n; i++) {
+            AscChunk *c = &chunks[i];
+            size_t k;
+            if (c->failed) {
+                fprintf(stderr, "ascReader_processFile: out of memory\n");
+                goto exit;
+            }
+            for (k = 0; k < c->n; k++) {
+                uint64_t ns = c->times[k] + offset;
+                c->frames[k].t.tv_sec = ns / 1000000000;
+                c->frames[k].t.tv_nsec = ns % 1000000000;
+                msgRxCb(&c->frames[k], cbData);
+            }
+            offset += c->span;
+            bigDlc += c->bigDlc;
+            c->bigDlc = 0;
+        }
+    }
+    if (bigDlc)
+        fprintf(stderr, "WARNING: DLC > 8 not yet implemented. "
+                "Skipped %lu msgs.\n", bigDlc);
+
+exit:
+    if (chunks) {
+        for (i = 0; i < jobs; i++) {
+            free(chunks[i].frames);
+            free(chunks[i].times);
+        }
+    }
+    free(chunks);
+    free(threads);
+#ifndef _WIN32
+    if (mapped) {
+        munmap(text, size);
+        return;
+    }
+#endif
+    free(text);
+}
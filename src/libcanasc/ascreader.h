@@ -0,0 +1,26 @@
+#ifndef INCLUDE_ASCREADER_H
+#define INCLUDE_ASCREADER_H
+
+#include <stdio.h>
+
+#include "measurement.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parser for Vector ASC text logs.
+ *
+ * The file is mapped and cut into chunks of whole lines, which are
+ * parsed on one thread per CPU. Frames are passed to msgRxCb in file
+ * order, on the calling thread. Input that cannot be mapped, like a
+ * pipe, is read into memory first.
+ */
+void ascReader_processFile(FILE *fp, msgRxCb_t msgRxCb, void *cbData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INCLUDE_ASCREADER_H
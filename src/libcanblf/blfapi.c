@@ -288,3 +288,22 @@ blfFreeObject(BLFHANDLE h, VBLObjectHeaderBase* pBase)
 {
     return 1; // No dynamically sized objects implemented?
 }
+
+
+/* time stamp of an object in ns */
+success_t
+blfObjectTime(const VBLObjectHeaderBase* pBase, uint64_t *ns)
+{
+    const VBLObjectHeader *h = (const VBLObjectHeader *)pBase;
+
+    if (pBase->mObjectSize < sizeof(VBLObjectHeader)
+        || pBase->mHeaderSize < sizeof(VBLObjectHeader))
+        return 0;
+    if (h->mObjectFlags & BL_OBJ_FLAG_TIME_TEN_MICS)
+        *ns = h->mObjectTimeStamp * 10000;
+    else if (h->mObjectFlags & BL_OBJ_FLAG_TIME_ONE_NANS)
+        *ns = h->mObjectTimeStamp;
+    else
+        return 0;
+    return 1;
+}
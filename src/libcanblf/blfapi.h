@@ -30,6 +30,8 @@ extern "C" {
 #define BL_OBJ_TYPE_CAN_DRIVER_ERROR      31
 #define BL_OBJ_TYPE_CAN_ERROR_EXT         73
 #define BL_OBJ_TYPE_CAN_MESSAGE2          86
+#define BL_OBJ_TYPE_CAN_FD_MESSAGE       100
+#define BL_OBJ_TYPE_CAN_FD_MESSAGE_64    101
 
 #define BL_OBJ_FLAG_TIME_TEN_MICS 1
 #define BL_OBJ_FLAG_TIME_ONE_NANS 2
@@ -148,6 +150,9 @@ success_t blfSkipObject(BLFHANDLE h, VBLObjectHeaderBase* pBase);
 success_t blfReadObjectSecure(BLFHANDLE h, VBLObjectHeaderBase* pBase,
                               size_t expectedSize);
 
+/* time stamp in ns of an object with a full header, 0 if it has none */
+success_t blfObjectTime(const VBLObjectHeaderBase* pBase, uint64_t *ns);
+
 #ifdef __cplusplus
 }
 #endif
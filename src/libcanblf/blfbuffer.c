@@ -6,41 +6,77 @@
 
 #include "blfapi.h"
 #include "blfbuffer.h"
+#include "stats.h"
 
-static int fpeek(FILE* fp, void *dest, size_t bytes)
+/*
+ * The source is read forward only, in large pieces, into the input
+ * buffer. Container headers are parsed from there and containers are
+ * inflated straight out of it, so pipes and stdin work like files.
+ */
+#define BLF_READ_AHEAD (1 << 20)
+
+
+// Make at least n bytes of input available, fewer only at end of file.
+static int blfBufferInput(BlfBuffer *buf, size_t n)
 {
-    long before = ftell(fp);
-    if (before == -1)
-        return 0;
+    if (buf->input_size >= n)
+        return 1;
 
-    size_t ret = fread(dest, 1, bytes, fp);
+    // Shift down to start
+    if (buf->input_position) {
+        memmove(buf->input, buf->input + buf->input_position, buf->input_size);
+        buf->input_position = 0;
+    }
 
-    if (fseek(fp, before, SEEK_SET) != 0)
-        return 0;
+    size_t want = n > BLF_READ_AHEAD ? n : BLF_READ_AHEAD;
+    if (want > buf->input_capacity) {
+        unsigned char *grown = realloc(buf->input, want);
+        if (!grown) {
+            fprintf(stderr, "Allocating input buffer failed.\n");
+            return 0;
+        }
+        buf->input = grown;
+        buf->input_capacity = want;
+    }
+
+    while (buf->input_size < n) {
+        size_t got = blfSourceRead(buf->reader, buf->input + buf->input_size,
+                                   buf->input_capacity - buf->input_size);
+        if (got == 0)
+            break;
+        buf->input_size += got;
+    }
+    return buf->input_size >= n;
+}
 
-    return ret == bytes;
+
+static void blfBufferConsume(BlfBuffer *buf, size_t n)
+{
+    buf->input_position += n;
+    buf->input_size -= n;
 }
 
 
-static int isLobjNext(FILE *fp)
+static int isLobjNext(BlfBuffer *buf)
 {
-    char tmp[4];
-    fpeek(fp, &tmp, 4);
-    return tmp[0] == 'L' || tmp[1] == 'O' || tmp[2] == 'B' || tmp[3] == 'J';
+    return blfBufferInput(buf, 4)
+        && memcmp(buf->input + buf->input_position, "LOBJ", 4) == 0;
 }
 
 
-// Moves source past a log container header.
-static int readLogHead(FILE *source, VBLObjectHeaderBaseLOGG *logp)
+// Moves input past a log container header.
+static int readLogHead(BlfBuffer *buf, VBLObjectHeaderBaseLOGG *logp)
 {
-    if (!fpeek(source, logp, sizeof(*logp))) {
+    if (!blfBufferInput(buf, sizeof(*logp))) {
         return 0;
     }
+    memcpy(logp, buf->input + buf->input_position, sizeof(*logp));
     if (logp->base.mObjectType != BL_OBJ_TYPE_LOG_CONTAINER) {
         fprintf(stderr, "Next item is not a container. Cannot add more data.\n");
         return 0;
     }
-    return fseek(source, sizeof(*logp), SEEK_CUR) == 0;
+    blfBufferConsume(buf, sizeof(*logp));
+    return 1;
 }
 
 
@@ -54,10 +90,7 @@ static int blfBufferRealloc(BlfBuffer *buf, size_t n_incoming)
 
     // Shift down to start
     if (buf->position) {
-        size_t i;
-        for (i = 0; i < buf->size; ++i) {
-            buf->buffer[i] = buf->buffer[buf->position + i];
-        }
+        memmove(buf->buffer, buf->buffer + buf->position, buf->size);
         buf->position = 0;
     }
 
@@ -114,45 +147,44 @@ static int blfBufferRefill(BlfBuffer *buf)
 {
     // Check whats coming and make sure there is room for it
     VBLObjectHeaderBaseLOGG log;
-    if (!readLogHead(buf->source, &log)) {
+    if (!readLogHead(buf, &log)) {
         //fprintf(stderr, "readLogHead failed.\n");
         return 0;
     }
     size_t raw_size = log.base.mObjectSize - sizeof(VBLObjectHeaderBaseLOGG);
-    size_t new_size = log.deflatebuffersize;
+    size_t new_size = log.compressedflag == 2 ? log.deflatebuffersize : raw_size;
     if (!blfBufferRealloc(buf, new_size)) {
         fprintf(stderr, "Buffer realloc failed.\n");
         return 0;
     }
 
-
-    unsigned char *data;
-    if (log.compressedflag == 2) {
-        data = malloc(raw_size);
-        if (!data) {
-            fprintf(stderr, "Allocating zipdata failed.\n");
-            return 0;
-        }
-    } else {
-        data = buf->buffer + (buf->position + buf->size);
-    }
-
-    size_t read = fread(data, 1, raw_size, buf->source);
-    if (read < raw_size) {
+    // The padding after the last container may be missing.
+    size_t padding = raw_size % 4;
+    if (!blfBufferInput(buf, raw_size + padding)
+        && buf->input_size < raw_size) {
         fprintf(stderr, "Reading from file failed.\n");
         return 0;
     }
+    unsigned char *data = buf->input + buf->input_position;
 
+    STATS_ADD(stat_containers, 1);
+    STATS_ADD(stat_compressed_bytes, raw_size);
     if (log.compressedflag == 2) {
+        STATS_START(t);
         size_t added = blfBufferUnzip(buf, data, raw_size);
-        free(data);
+        STATS_STOP(stat_inflate, t);
         assert(added == new_size); // Just checking...
+        STATS_ADD(stat_uncompressed_bytes, added);
     } else {
+        memcpy(buf->buffer + (buf->position + buf->size), data, raw_size);
         buf->size += raw_size;
+        STATS_ADD(stat_uncompressed_bytes, raw_size);
     }
 
     // Cleanup
-    return fseek(buf->source, raw_size % 4, SEEK_CUR) == 0;
+    blfBufferConsume(buf, buf->input_size < raw_size + padding
+                     ? buf->input_size : raw_size + padding);
+    return 1;
 }
 
 
@@ -197,14 +229,29 @@ int blfBufferCreate(BlfBuffer *buf, FILE *file)
         fprintf(stderr, "Cannot buffer NULL\n");
         return 0;
     }
-    // TODO: If we dont start at an object, seek until we get one?
-    if (!isLobjNext(file))
+    buf->source = file;
+    buf->reader = blfSourceOpen(file);
+    if (!buf->reader) {
+        fprintf(stderr, "Opening BLF source failed.\n");
         return 0;
+    }
+    buf->input = NULL;
+    buf->input_capacity = 0;
+    buf->input_position = 0;
+    buf->input_size = 0;
+
+    // TODO: If we dont start at an object, skip until we get one?
+    if (!isLobjNext(buf)) {
+        blfSourceClose(buf->reader);
+        free(buf->input);
+        return 0;
+    }
 
-    buf->source = file;
     buf->buffer = malloc(1024);
     if (!buf->buffer) {
         fprintf(stderr, "Allocating BlfBuffer failed.\n");
+        blfSourceClose(buf->reader);
+        free(buf->input);
         return 0;
     }
     buf->capacity = 1024;
@@ -216,7 +263,9 @@ int blfBufferCreate(BlfBuffer *buf, FILE *file)
 
 void blfBufferDestroy(BlfBuffer *buf)
 {
+    blfSourceClose(buf->reader);
     free(buf->buffer);
+    free(buf->input);
     return;
 }
 
@@ -2,17 +2,23 @@
 #define INCLUDE_BLFBUFFER_H
 
 #include <stdio.h>
+#include "blfsource.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct {
-    FILE *source;
-    unsigned char *buffer;
+    FILE *source;           // read forward only, may be a pipe
+    BlfSource *reader;      // of source, maybe reading ahead
+    unsigned char *buffer;  // objects of inflated containers
     size_t capacity;
     size_t position;
     size_t size;
+    unsigned char *input;   // read ahead of source, not inflated yet
+    size_t input_capacity;
+    size_t input_position;
+    size_t input_size;
 } BlfBuffer;
 
 
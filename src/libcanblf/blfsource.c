@@ -0,0 +1,476 @@
+#define _GNU_SOURCE // O_DIRECT
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "blfsource.h"
+#include "stats.h"
+
+// O_DIRECT wants buffers, offsets and sizes in multiples of this.
+#define BLF_ALIGN 4096
+
+BlfSourceOpts blfSourceOpts = {
+    4 << 20,    // readAhead
+    4,          // depth
+    0,          // direct
+    0,          // uring
+    8,          // uringDepth
+};
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    long long offset;   // io_uring: of data in the file
+    int ready;          // io_uring: read completed
+} BlfPiece;
+
+struct BlfSource {
+    FILE *fp;
+    int fd;             // read with pread, -1 for fread
+    long long offset;   // of the next pread
+    int threaded;
+
+    BlfPiece *pieces;   // ring of depth pieces
+    int depth;
+    size_t pieceSize;
+    int head;           // first filled piece
+    int count;          // filled pieces
+    size_t consumed;    // of the head piece
+    int eof;            // the last piece is queued
+    int stop;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+#ifdef HAVE_LIBURING
+    int uring;          // reads in flight on ring, no thread
+    struct io_uring ring;
+    long long fileSize;
+    int inflight;
+#endif
+};
+
+
+int blfSourceHasUring(void)
+{
+#ifdef HAVE_LIBURING
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+
+static void *blfAlignedAlloc(size_t size)
+{
+#ifdef _WIN32
+    return malloc(size);
+#else
+    void *data = NULL;
+    return posix_memalign(&data, BLF_ALIGN, size) == 0 ? data : NULL;
+#endif
+}
+
+
+#ifndef _WIN32
+// Stop using O_DIRECT after the file system refused it, 0 if not in use.
+static int blfSourceDropDirect(int fd)
+{
+#ifdef O_DIRECT
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && (flags & O_DIRECT)
+        && fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+#else
+    return 0;
+#endif
+}
+#endif
+
+
+// Fill data with the next piece of the file, short only at its end.
+static size_t blfSourceFill(BlfSource *src, unsigned char *data)
+{
+    size_t got = 0;
+
+#ifndef _WIN32
+    if (src->fd >= 0) {
+        while (got < src->pieceSize) {
+            ssize_t r = pread(src->fd, data + got, src->pieceSize - got,
+                              src->offset);
+            if (r < 0 && errno == EINTR)
+                continue;
+            // File system without O_DIRECT, go through the page cache.
+            if (r < 0 && errno == EINVAL && blfSourceDropDirect(src->fd))
+                continue;
+            if (r < 0)
+                fprintf(stderr, "Reading from file failed: %s\n",
+                        strerror(errno));
+            if (r <= 0)
+                break;
+            got += r;
+            src->offset += r;
+        }
+        return got;
+    }
+#endif
+    while (got < src->pieceSize) {
+        size_t r = fread(data + got, 1, src->pieceSize - got, src->fp);
+        if (r == 0)
+            break;
+        got += r;
+    }
+    return got;
+}
+
+
+static void *blfSourceWorker(void *arg)
+{
+    BlfSource *src = (BlfSource *) arg;
+
+    pthread_mutex_lock(&src->lock);
+    while (!src->stop && !src->eof) {
+        if (src->count == src->depth) {
+            pthread_cond_wait(&src->cond, &src->lock);
+            continue;
+        }
+        BlfPiece *piece = &src->pieces[(src->head + src->count) % src->depth];
+        pthread_mutex_unlock(&src->lock);
+
+        // Only this thread touches pieces that are not filled.
+        piece->size = blfSourceFill(src, piece->data);
+
+        pthread_mutex_lock(&src->lock);
+        src->count++;
+        src->eof = piece->size < src->pieceSize;
+        pthread_cond_broadcast(&src->cond);
+    }
+    pthread_mutex_unlock(&src->lock);
+    return NULL;
+}
+
+
+#ifdef HAVE_LIBURING
+/*
+ * With io_uring every piece of the ring has a read in flight, they
+ * complete in any order and are consumed in file order. A piece is
+ * read again from where a short read stopped.
+ */
+
+// Bytes of the file that belong in piece.
+static size_t blfUringExpected(BlfSource *src, BlfPiece *piece)
+{
+    long long left = src->fileSize - piece->offset;
+    return left < (long long) src->pieceSize ? (size_t) left : src->pieceSize;
+}
+
+
+// Queue the read of the rest of piece, aligned pieces ask for all of it.
+static int blfUringSubmit(BlfSource *src, BlfPiece *piece)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&src->ring);
+    if (!sqe)
+        return 0;
+    io_uring_prep_read(sqe, src->fd, piece->data + piece->size,
+                       src->pieceSize - piece->size,
+                       piece->offset + piece->size);
+    io_uring_sqe_set_data(sqe, piece);
+    if (io_uring_submit(&src->ring) < 0)
+        return 0;
+    src->inflight++;
+    return 1;
+}
+
+
+// Start reading the next piece of the file into piece, 0 past its end.
+static int blfUringStart(BlfSource *src, BlfPiece *piece)
+{
+    if (src->offset >= src->fileSize)
+        return 0;
+    piece->offset = src->offset;
+    piece->size = 0;
+    piece->ready = 0;
+    src->offset += src->pieceSize;
+    if (!blfUringSubmit(src, piece)) {
+        fprintf(stderr, "Queueing read failed.\n");
+        piece->ready = 1; // short, ends the file
+    }
+    return 1;
+}
+
+
+// Handle one completion, waiting for it. Returns 0 on a broken ring.
+static int blfUringComplete(BlfSource *src)
+{
+    struct io_uring_cqe *cqe;
+    int err;
+
+    do {
+        STATS_START(t);
+        err = io_uring_wait_cqe(&src->ring, &cqe);
+        STATS_STOP(stat_wait, t);
+    } while (err == -EINTR);
+    if (err < 0) {
+        fprintf(stderr, "Waiting for reads failed: %s\n", strerror(-err));
+        return 0;
+    }
+
+    BlfPiece *piece = io_uring_cqe_get_data(cqe);
+    int res = cqe->res;
+    io_uring_cqe_seen(&src->ring, cqe);
+    src->inflight--;
+
+    if (res == -EINTR || res == -EAGAIN
+        || (res == -EINVAL && blfSourceDropDirect(src->fd))) {
+        if (blfUringSubmit(src, piece))
+            return 1;
+        res = -EIO;
+    }
+    if (res < 0) {
+        fprintf(stderr, "Reading from file failed: %s\n", strerror(-res));
+        piece->ready = 1;
+        return 1;
+    }
+    piece->size += res;
+    if (res == 0 || piece->size >= blfUringExpected(src, piece)
+        || !blfUringSubmit(src, piece))
+        piece->ready = 1;
+    return 1;
+}
+
+
+static size_t blfUringRead(BlfSource *src, void *dest, size_t n)
+{
+    size_t done = 0;
+
+    while (done < n && src->count > 0) {
+        BlfPiece *piece = &src->pieces[src->head];
+        while (!piece->ready) {
+            if (!blfUringComplete(src)) {
+                src->count = 0;
+                return done;
+            }
+        }
+
+        size_t avail = piece->size > src->consumed
+            ? piece->size - src->consumed : 0;
+        size_t m = avail < n - done ? avail : n - done;
+        memcpy((unsigned char *) dest + done, piece->data + src->consumed, m);
+        done += m;
+        src->consumed += m;
+        if (src->consumed < piece->size)
+            continue;
+
+        // A short piece ends the file, otherwise read on into its place.
+        src->eof |= piece->size < blfUringExpected(src, piece);
+        src->head = (src->head + 1) % src->depth;
+        src->count--;
+        src->consumed = 0;
+        if (!src->eof) {
+            BlfPiece *tail = &src->pieces[(src->head + src->count) % src->depth];
+            src->count += blfUringStart(src, tail);
+        }
+    }
+    return done;
+}
+
+
+// Set up a ring with all pieces in flight, 0 to fall back to a thread.
+static int blfUringOpen(BlfSource *src)
+{
+    struct stat st;
+    int i;
+
+    if (fstat(src->fd, &st) != 0)
+        return 0;
+    int err = io_uring_queue_init(src->depth, &src->ring, 0);
+    if (err < 0) {
+        fprintf(stderr, "io_uring unavailable (%s), reading on a thread.\n",
+                strerror(-err));
+        return 0;
+    }
+    src->uring = 1;
+    src->fileSize = st.st_size;
+    for (i = 0; i < src->depth; i++)
+        src->count += blfUringStart(src, &src->pieces[i]);
+    return 1;
+}
+
+
+static void blfUringClose(BlfSource *src)
+{
+    // The kernel may still write into the pieces until reads complete.
+    while (src->inflight > 0 && blfUringComplete(src))
+        ;
+    io_uring_queue_exit(&src->ring);
+}
+#endif
+
+
+// Switch to pread on the file descriptor of a regular file.
+static void blfSourceUsePread(BlfSource *src)
+{
+#ifndef _WIN32
+    struct stat st;
+    int fd = fileno(src->fp);
+    long pos = ftell(src->fp);
+    if (fd < 0 || pos < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+
+    // Start at an aligned offset, the bytes before pos are skipped.
+    src->fd = fd;
+    src->offset = pos - pos % BLF_ALIGN;
+    src->consumed = pos % BLF_ALIGN;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#ifdef O_DIRECT
+    if (blfSourceOpts.direct) {
+        int flags = fcntl(fd, F_GETFL);
+        if (flags != -1)
+            fcntl(fd, F_SETFL, flags | O_DIRECT);
+    }
+#endif
+#endif
+}
+
+
+BlfSource *blfSourceOpen(FILE *fp)
+{
+    BlfSource *src = calloc(1, sizeof(BlfSource));
+    if (!src)
+        return NULL;
+    src->fp = fp;
+    src->fd = -1;
+    if (blfSourceOpts.readAhead == 0)
+        return src;
+
+    const int threadDepth = blfSourceOpts.depth > 1 ? blfSourceOpts.depth : 2;
+    src->depth = threadDepth;
+#ifdef HAVE_LIBURING
+    if (blfSourceOpts.uring && blfSourceOpts.uringDepth > src->depth)
+        src->depth = blfSourceOpts.uringDepth;
+#endif
+    src->pieceSize = (blfSourceOpts.readAhead + BLF_ALIGN - 1)
+        / BLF_ALIGN * BLF_ALIGN;
+    src->pieces = calloc(src->depth, sizeof(BlfPiece));
+    if (!src->pieces)
+        goto fail;
+    {
+        int i;
+        for (i = 0; i < src->depth; i++) {
+            src->pieces[i].data = blfAlignedAlloc(src->pieceSize);
+            if (!src->pieces[i].data)
+                goto fail;
+        }
+    }
+
+    blfSourceUsePread(src);
+#ifdef HAVE_LIBURING
+    if (blfSourceOpts.uring && src->fd >= 0 && blfUringOpen(src))
+        return src;
+#endif
+    // Without io_uring, keep only the pieces the thread queues ahead.
+    while (src->depth > threadDepth)
+        free(src->pieces[--src->depth].data);
+    pthread_mutex_init(&src->lock, NULL);
+    pthread_cond_init(&src->cond, NULL);
+    if (pthread_create(&src->thread, NULL, blfSourceWorker, src) != 0) {
+        pthread_mutex_destroy(&src->lock);
+        pthread_cond_destroy(&src->cond);
+        goto fail;
+    }
+    src->threaded = 1;
+    return src;
+
+fail:
+    if (src->pieces) {
+        int i;
+        for (i = 0; i < src->depth; i++)
+            free(src->pieces[i].data);
+    }
+    free(src->pieces);
+    free(src);
+    return NULL;
+}
+
+
+size_t blfSourceRead(BlfSource *src, void *dest, size_t n)
+{
+    size_t done = 0;
+
+#ifdef HAVE_LIBURING
+    if (src->uring)
+        return blfUringRead(src, dest, n);
+#endif
+    if (!src->threaded)
+        return fread(dest, 1, n, src->fp);
+
+    pthread_mutex_lock(&src->lock);
+    while (done < n) {
+        if (src->count == 0 && !src->eof) {
+            STATS_START(t);
+            pthread_cond_wait(&src->cond, &src->lock);
+            STATS_STOP(stat_wait, t);
+            continue;
+        }
+        if (src->count == 0)
+            break;
+
+        // Only this thread touches filled pieces.
+        BlfPiece *piece = &src->pieces[src->head];
+        size_t avail = piece->size > src->consumed
+            ? piece->size - src->consumed : 0;
+        size_t m = avail < n - done ? avail : n - done;
+        pthread_mutex_unlock(&src->lock);
+        memcpy((unsigned char *) dest + done, piece->data + src->consumed, m);
+        pthread_mutex_lock(&src->lock);
+
+        done += m;
+        src->consumed += m;
+        if (src->consumed >= piece->size) {
+            src->head = (src->head + 1) % src->depth;
+            src->count--;
+            src->consumed = 0;
+            pthread_cond_broadcast(&src->cond);
+        }
+    }
+    pthread_mutex_unlock(&src->lock);
+    return done;
+}
+
+
+void blfSourceClose(BlfSource *src)
+{
+    if (!src)
+        return;
+#ifdef HAVE_LIBURING
+    if (src->uring)
+        blfUringClose(src);
+#endif
+    if (src->threaded) {
+        pthread_mutex_lock(&src->lock);
+        src->stop = 1;
+        pthread_cond_broadcast(&src->cond);
+        pthread_mutex_unlock(&src->lock);
+        pthread_join(src->thread, NULL);
+        pthread_mutex_destroy(&src->lock);
+        pthread_cond_destroy(&src->cond);
+    }
+    if (src->pieces) {
+        int i;
+        for (i = 0; i < src->depth; i++)
+            free(src->pieces[i].data);
+    }
+    free(src->pieces);
+    free(src);
+}
@@ -0,0 +1,48 @@
+#ifndef INCLUDE_BLFSOURCE_H
+#define INCLUDE_BLFSOURCE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sequential reader of a BLF file for BlfBuffer.
+ *
+ * With read ahead a thread of its own reads the file in large pieces
+ * into a queue, so storage latency overlaps with inflating and
+ * decoding. Regular files are read with pread at aligned offsets,
+ * pipes with fread. With io_uring, regular files instead have uringDepth
+ * reads in flight at once and no thread is needed.
+ */
+typedef struct {
+    size_t readAhead;   // bytes per read, 0 reads on the calling thread
+    int depth;          // pieces queued ahead by the thread
+    int direct;         // O_DIRECT, bypassing the page cache
+    int uring;          // io_uring where built with liburing
+    int uringDepth;     // io_uring reads in flight
+} BlfSourceOpts;
+
+extern BlfSourceOpts blfSourceOpts;
+
+typedef struct BlfSource BlfSource;
+
+// 1 if built with liburing, blfSourceOpts.uring is ignored otherwise.
+int blfSourceHasUring(void);
+
+// Reads fp from where it stands, NULL on failure.
+BlfSource *blfSourceOpen(FILE *fp);
+
+// Like fread, fewer than n bytes only at the end of the file.
+size_t blfSourceRead(BlfSource *src, void *dest, size_t n);
+
+// Stops reading ahead, fp is left open.
+void blfSourceClose(BlfSource *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INCLUDE_BLFSOURCE_H
@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "blfwriter.h"
+
+BlfWriterOpts blfWriterOpts = {
+    128 << 10,              // containerSize
+    Z_DEFAULT_COMPRESSION,  // level
+    0,                      // jobs
+};
+
+typedef struct {
+    unsigned char *data;    // objects, uncompressed
+    size_t size;
+    unsigned char *zip;
+    size_t zipCap;
+    uLongf zipSize;
+    int failed;
+} BlfChunk;
+
+struct BlfWriter {
+    FILE *fp;
+    long start;             // of the file header, -1 if fp cannot seek
+    LOGG_t logg;
+
+    BlfChunk *chunks;       // containers deflated at once
+    int nChunks;
+    int filled;             // full chunks, the next one is being filled
+    int next;               // next chunk to deflate, taken atomically
+    int jobs;
+
+    uint64_t written;       // bytes of the file
+    uint64_t uncompressed;  // bytes of the file if nothing was deflated
+    uint32_t objects;
+    uint64_t lastNs;
+    int failed;
+};
+
+static const unsigned char blfZeros[4] = {0, 0, 0, 0};
+
+
+static void blfChunkDeflate(BlfChunk *c)
+{
+    uLong bound = compressBound(c->size);
+    if (bound > c->zipCap) {
+        free(c->zip);
+        c->zip = malloc(bound);
+        c->zipCap = c->zip ? bound : 0;
+        if (!c->zip) {
+            c->failed = 1;
+            return;
+        }
+    }
+    c->zipSize = c->zipCap;
+    c->failed = compress2(c->zip, &c->zipSize, c->data, c->size,
+                          blfWriterOpts.level) != Z_OK;
+}
+
+
+static void *blfWriterWorker(void *arg)
+{
+    BlfWriter *w = (BlfWriter *) arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED)) < w->filled)
+        blfChunkDeflate(&w->chunks[i]);
+    return NULL;
+}
+
+
+static int blfWriterPut(BlfWriter *w, const void *data, size_t n)
+{
+    if (n && fwrite(data, 1, n, w->fp) != n) {
+        fprintf(stderr, "Writing BLF failed.\n");
+        w->failed = 1;
+        return 0;
+    }
+    w->written += n;
+    return 1;
+}
+
+
+// Writes a log container header and its data, padded.
+static int blfWriterPutContainer(BlfWriter *w,
+                                 const VBLObjectHeaderBaseLOGG *log,
+                                 const void *data)
+{
+    size_t size = log->base.mObjectSize - sizeof(*log);
+    return blfWriterPut(w, log, sizeof(*log))
+        && blfWriterPut(w, data, size)
+        && blfWriterPut(w, blfZeros, size % 4);
+}
+
+
+// Deflates and writes the full chunks, and the one being filled if all.
+static int blfWriterFlush(BlfWriter *w, int all)
+{
+    pthread_t *threads;
+    int started = 0, i;
+
+    if (all && w->chunks[w->filled].size)
+        w->filled++;
+    if (!w->filled)
+        return !w->failed;
+
+    threads = calloc(w->jobs, sizeof(pthread_t));
+    w->next = 0;
+    for (i = 1; threads && i < w->jobs && i < w->filled; i++) {
+        if (pthread_create(&threads[i], NULL, blfWriterWorker, w) != 0)
+            break;
+        started = i;
+    }
+    blfWriterWorker(w);
+    for (i = 1; i <= started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    for (i = 0; i < w->filled && !w->failed; i++) {
+        BlfChunk *c = &w->chunks[i];
+        VBLObjectHeaderBaseLOGG log;
+        if (c->failed) {
+            fprintf(stderr, "Deflating container failed.\n");
+            w->failed = 1;
+            break;
+        }
+        memcpy(&log.base.mSignature, "LOBJ", 4);
+        log.base.mHeaderSize = sizeof(VBLObjectHeaderBase);
+        log.base.mHeaderVersion = 1;
+        log.base.mObjectSize = sizeof(log) + c->zipSize;
+        log.base.mObjectType = BL_OBJ_TYPE_LOG_CONTAINER;
+        log.compressedflag = 2;
+        log.reserved1 = 0;
+        log.deflatebuffersize = c->size;
+        log.reserved2 = 0;
+        blfWriterPutContainer(w, &log, c->zip);
+        w->uncompressed += sizeof(log) + c->size;
+    }
+
+    // Only called with all chunks full or all, none is left to fill.
+    for (i = 0; i < w->nChunks; i++)
+        w->chunks[i].size = 0;
+    w->filled = 0;
+    return !w->failed;
+}
+
+
+// Appends n bytes of objects, filling containers.
+static int blfWriterAppend(BlfWriter *w, const unsigned char *data, size_t n)
+{
+    while (n) {
+        BlfChunk *c = &w->chunks[w->filled];
+        size_t m = blfWriterOpts.containerSize - c->size;
+        if (m > n)
+            m = n;
+        memcpy(c->data + c->size, data, m);
+        c->size += m;
+        data += m;
+        n -= m;
+        if (c->size == blfWriterOpts.containerSize
+            && ++w->filled == w->nChunks && !blfWriterFlush(w, 0))
+            return 0;
+    }
+    return 1;
+}
+
+
+BlfWriter *blfWriterOpen(FILE *fp, const LOGG_t *logg)
+{
+    BlfWriter *w = calloc(1, sizeof(BlfWriter));
+    int i;
+
+    if (!w)
+        return NULL;
+    w->fp = fp;
+    w->start = ftell(fp);
+    if (logg)
+        w->logg = *logg;
+    memcpy(&w->logg.mSignature, "LOGG", 4);
+    w->logg.mHeaderSize = sizeof(LOGG_t);
+    w->logg.fileSize = 0;
+    w->logg.uncompressedFileSize = 0;
+    w->logg.objectCount = 0;
+
+    w->jobs = blfWriterOpts.jobs > 0 ? blfWriterOpts.jobs
+        : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (w->jobs < 1)
+        w->jobs = 1;
+    w->nChunks = 4 * w->jobs;
+    w->chunks = calloc(w->nChunks, sizeof(BlfChunk));
+    if (!w->chunks)
+        goto fail;
+    for (i = 0; i < w->nChunks; i++) {
+        w->chunks[i].data = malloc(blfWriterOpts.containerSize);
+        if (!w->chunks[i].data)
+            goto fail;
+    }
+
+    if (!blfWriterPut(w, &w->logg, sizeof(LOGG_t)))
+        goto fail;
+    return w;
+
+fail:
+    if (w->chunks) {
+        for (i = 0; i < w->nChunks; i++)
+            free(w->chunks[i].data);
+    }
+    free(w->chunks);
+    free(w);
+    fprintf(stderr, "blfWriterOpen() failed\n");
+    return NULL;
+}
+
+
+success_t blfWriterObject(BlfWriter *w, const VBLObjectHeaderBase *pBase)
+{
+    uint64_t ns;
+
+    if (w->failed)
+        return 0;
+    if (!blfWriterAppend(w, (const unsigned char *) pBase, pBase->mObjectSize)
+        || !blfWriterAppend(w, blfZeros, pBase->mObjectSize % 4))
+        return 0;
+    w->objects++;
+    if (blfObjectTime(pBase, &ns) && ns > w->lastNs)
+        w->lastNs = ns;
+    return 1;
+}
+
+
+success_t blfWriterContainer(BlfWriter *w, const VBLObjectHeaderBaseLOGG *log,
+                             const void *data, uint32_t n_objects,
+                             uint64_t lastNs)
+{
+    // Objects before it must not continue into it.
+    if (!blfWriterFlush(w, 1) || !blfWriterPutContainer(w, log, data))
+        return 0;
+    w->uncompressed += sizeof(*log) + (log->compressedflag == 2
+                                       ? log->deflatebuffersize
+                                       : log->base.mObjectSize - sizeof(*log));
+    w->objects += n_objects;
+    if (lastNs > w->lastNs)
+        w->lastNs = lastNs;
+    return 1;
+}
+
+
+uint64_t blfWriterSize(const BlfWriter *w)
+{
+    return w->written;
+}
+
+
+// The calendar time ns after start, zero if start is.
+static void blfSystemTimeAdd(SYSTEMTIME *end, const SYSTEMTIME *start,
+                             uint64_t ns)
+{
+    struct tm tm;
+    time_t t;
+    uint64_t ms;
+
+    *end = *start;
+    if (start->wYear == 0)
+        return;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = start->wYear - 1900;
+    tm.tm_mon = start->wMonth - 1;
+    tm.tm_mday = start->wDay;
+    tm.tm_hour = start->wHour;
+    tm.tm_min = start->wMinute;
+    tm.tm_sec = start->wSecond;
+    ms = start->wMilliseconds + ns / 1000000;
+    t = timegm(&tm) + (time_t) (ms / 1000);
+    if (!gmtime_r(&t, &tm))
+        return;
+    end->wYear = tm.tm_year + 1900;
+    end->wMonth = tm.tm_mon + 1;
+    end->wDayOfWeek = tm.tm_wday;
+    end->wDay = tm.tm_mday;
+    end->wHour = tm.tm_hour;
+    end->wMinute = tm.tm_min;
+    end->wSecond = tm.tm_sec;
+    end->wMilliseconds = ms % 1000;
+}
+
+
+success_t blfWriterClose(BlfWriter *w)
+{
+    success_t success;
+    int i;
+
+    if (!w)
+        return 0;
+    blfWriterFlush(w, 1);
+
+    // Complete the file header, it is left empty on pipes.
+    w->logg.fileSize = w->written;
+    w->logg.uncompressedFileSize = sizeof(LOGG_t) + w->uncompressed;
+    w->logg.objectCount = w->objects;
+    blfSystemTimeAdd(&w->logg.mMeasurementEndTime,
+                     &w->logg.mMeasurementStartTime, w->lastNs);
+    if (w->start >= 0 && !w->failed
+        && fseek(w->fp, w->start, SEEK_SET) == 0) {
+        if (fwrite(&w->logg, 1, sizeof(LOGG_t), w->fp) != sizeof(LOGG_t))
+            w->failed = 1;
+        fseek(w->fp, 0, SEEK_END);
+    }
+    if (fflush(w->fp) != 0)
+        w->failed = 1;
+
+    success = !w->failed;
+    for (i = 0; i < w->nChunks; i++) {
+        free(w->chunks[i].data);
+        free(w->chunks[i].zip);
+    }
+    free(w->chunks);
+    free(w);
+    return success;
+}
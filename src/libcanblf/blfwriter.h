@@ -0,0 +1,56 @@
+#ifndef INCLUDE_BLFWRITER_H
+#define INCLUDE_BLFWRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "blfapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Writer of BLF files.
+ *
+ * Objects are packed into log containers of containerSize bytes, an
+ * object may continue in the next container like in files of Vector
+ * tools. Full containers are deflated in batches, one container per
+ * thread at a time, and written in order. Containers of another file
+ * can be copied as they are, without inflating them.
+ */
+typedef struct {
+    size_t containerSize;   // uncompressed bytes per container
+    int level;              // zlib compression level
+    int jobs;               // containers deflated at once, 0 one per CPU
+} BlfWriterOpts;
+
+extern BlfWriterOpts blfWriterOpts;
+
+typedef struct BlfWriter BlfWriter;
+
+// Writes to fp from where it stands. The file header is taken from
+// logg, NULL for an empty one, and completed on close. NULL on failure.
+BlfWriter *blfWriterOpen(FILE *fp, const LOGG_t *logg);
+
+// Appends the object at pBase, pBase->mObjectSize bytes.
+success_t blfWriterObject(BlfWriter *w, const VBLObjectHeaderBase *pBase);
+
+// Appends a log container of another file as it is: the header at log,
+// followed by its data. It must hold n_objects whole objects, the last
+// of them at lastNs.
+success_t blfWriterContainer(BlfWriter *w, const VBLObjectHeaderBaseLOGG *log,
+                             const void *data, uint32_t n_objects,
+                             uint64_t lastNs);
+
+// Bytes written so far, objects still waiting to be deflated excluded.
+uint64_t blfWriterSize(const BlfWriter *w);
+
+// Writes what is left and completes the file header where fp can seek.
+// fp is left open.
+success_t blfWriterClose(BlfWriter *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INCLUDE_BLFWRITER_H
@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "candumpreader.h"
+
+#define CANDUMP_BUFFER (256 << 10)  // bytes read at once, longest line
+
+// SocketCAN can_id flags, see linux/can.h
+#define CANDUMP_EFF_FLAG 0x80000000U
+#define CANDUMP_RTR_FLAG 0x40000000U
+#define CANDUMP_ERR_FLAG 0x20000000U
+#define CANDUMP_SFF_MASK 0x000007FFU
+#define CANDUMP_EFF_MASK 0x1FFFFFFFU
+
+#define CANDUMP_FRAME 16            // sizeof(struct can_frame)
+
+typedef struct {
+    msgRxCb_t msgRxCb;
+    void *cbData;
+    uint64_t now;       // ns, when the input was read
+    int skipLine;       // rest of a line too long for the buffer
+    int warned;         // about frames of more than 8 bytes
+} CandumpState;
+
+static const signed char candumpHex[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+}; // digit value + 1, 0 for no digit
+
+
+static int candumpSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+static const char *candumpSkipSpace(const char *p, const char *end)
+{
+    while (p < end && candumpSpace(*p))
+        p++;
+    return p;
+}
+
+
+static void candumpWarn(CandumpState *s)
+{
+    if (!s->warned) {
+        fprintf(stderr, "WARNING: DLC > 8 not yet implemented. Skipping msgs.\n");
+        s->warned = 1;
+    }
+}
+
+
+static void candumpDeliver(CandumpState *s, canMessage_t *m, uint64_t ns)
+{
+    m->t.tv_sec = ns / 1000000000;
+    m->t.tv_nsec = ns % 1000000000;
+    s->msgRxCb(m, s->cbData);
+}
+
+
+// "(<sec>.<frac>)" as ns, up to 9 decimals.
+static int candumpTime(const char **pp, const char *end, uint64_t *ns)
+{
+    const char *p = *pp;
+    uint64_t sec = 0, frac = 0, scale = 1000000000;
+
+    if (p == end || *p++ != '(')
+        return 0;
+    if (p == end || *p < '0' || *p > '9')
+        return 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        sec = sec * 10 + (*p++ - '0');
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (scale > 1) {
+                scale /= 10;
+                frac += (*p - '0') * scale;
+            }
+        }
+    }
+    if (p == end || *p++ != ')')
+        return 0;
+    *ns = sec * 1000000000 + frac;
+    *pp = p;
+    return 1;
+}
+
+
+// Interface name, canN is bus N + 1.
+static const char *candumpIface(const char *p, const char *end, uint8_t *bus)
+{
+    const char *name = p, *digits;
+    unsigned n = 0;
+
+    while (p < end && !candumpSpace(*p))
+        p++;
+    for (digits = p; digits > name && digits[-1] >= '0' && digits[-1] <= '9';)
+        digits--;
+    for (; digits < p; digits++)
+        n = n * 10 + (*digits - '0');
+    *bus = (uint8_t) (n + 1);
+    return p;
+}
+
+
+/*
+ * CAN ID of 3 (standard) or 8 (extended) hex digits. Returns 0 if
+ * there is none, or for error frames.
+ */
+static int candumpId(const char **pp, const char *end, uint32_t *id)
+{
+    const char *p = *pp;
+    uint32_t v = 0;
+    int n = 0, d;
+
+    while (p < end && n < 9 && (d = candumpHex[(unsigned char) *p]) != 0) {
+        v = v << 4 | (d - 1);
+        p++;
+        n++;
+    }
+    if (n == 3)
+        *id = v & CANDUMP_SFF_MASK;
+    else if (n == 8 && !(v & CANDUMP_ERR_FLAG))
+        *id = (v & CANDUMP_EFF_MASK) | CANDUMP_EFF_FLAG; // as in BLF and DBC
+    else
+        return 0;
+    *pp = p;
+    return 1;
+}
+
+
+/*
+ * Log format of candump -l, after the interface:
+ * <id>#<data>, <id>#R for remote frames and <id>##<flags><data> for
+ * CAN FD. Data bytes may be separated by dots.
+ */
+static int candumpLogFrame(CandumpState *s, const char *p, const char *end,
+                           canMessage_t *m)
+{
+    int n = 0;
+
+    if (!candumpId(&p, end, &m->id) || p == end || *p++ != '#')
+        return 0;
+    if (p < end && *p == 'R')
+        return 0;
+    if (p < end && *p == '#') {
+        if (end - p < 2 || !candumpHex[(unsigned char) p[1]])
+            return 0;
+        p += 2; // CAN FD flags
+    }
+    while (p < end && !candumpSpace(*p) && *p != '_') {
+        int hi, lo;
+        if (*p == '.') {
+            p++;
+            continue;
+        }
+        if (end - p < 2)
+            return 0;
+        hi = candumpHex[(unsigned char) p[0]] - 1;
+        lo = candumpHex[(unsigned char) p[1]] - 1;
+        if (hi < 0 || lo < 0)
+            return 0;
+        if (n == 8) {
+            candumpWarn(s);
+            return 0;
+        }
+        m->byte_arr[n++] = (uint8_t) (hi << 4 | lo);
+        p += 2;
+    }
+    m->dlc = (uint8_t) n;
+    return 1;
+}
+
+
+/*
+ * Default output of candump, after the interface:
+ * <id>  [<len>]  <bytes>, possibly with flags of -x before the ID.
+ */
+static int candumpPrintedFrame(CandumpState *s, const char *p, const char *end,
+                               canMessage_t *m)
+{
+    const char *bracket = memchr(p, '[', end - p);
+    const char *id = bracket;
+    unsigned len = 0;
+    unsigned n;
+
+    if (!bracket)
+        return 0;
+    // The ID is the token in front of the length.
+    while (id > p && candumpSpace(id[-1]))
+        id--;
+    while (id > p && !candumpSpace(id[-1]))
+        id--;
+    if (!candumpId(&id, end, &m->id))
+        return 0;
+    for (p = bracket + 1; p < end && *p >= '0' && *p <= '9'; p++)
+        len = len * 10 + (*p - '0');
+    if (p == end || *p++ != ']')
+        return 0;
+    if (len > 8) {
+        candumpWarn(s);
+        return 0;
+    }
+    for (n = 0; n < len; n++) {
+        int hi, lo;
+        p = candumpSkipSpace(p, end);
+        if (end - p < 2)
+            return 0;
+        hi = candumpHex[(unsigned char) p[0]] - 1;
+        lo = candumpHex[(unsigned char) p[1]] - 1;
+        if (hi < 0 || lo < 0)
+            return 0; // remote request
+        m->byte_arr[n] = (uint8_t) (hi << 4 | lo);
+        p += 2;
+    }
+    m->dlc = (uint8_t) len;
+    return 1;
+}
+
+
+static void candumpLine(CandumpState *s, const char *p, const char *end)
+{
+    canMessage_t m;
+    uint64_t ns = s->now;
+    const char *q;
+
+    p = candumpSkipSpace(p, end);
+    if (p < end && *p == '(') {
+        if (!candumpTime(&p, end, &ns))
+            return;
+        p = candumpSkipSpace(p, end);
+    }
+    if (p == end)
+        return;
+    p = candumpSkipSpace(candumpIface(p, end, &m.bus), end);
+    for (q = p; q < end && !candumpSpace(*q) && *q != '#'; q++)
+        ;
+    if (q < end && *q == '#') {
+        if (!candumpLogFrame(s, p, end, &m))
+            return;
+    } else if (!candumpPrintedFrame(s, p, end, &m)) {
+        return;
+    }
+    candumpDeliver(s, &m, ns);
+}
+
+
+// Parses the whole lines of buf, the rest too at eof. Returns bytes used.
+static size_t candumpText(CandumpState *s, const char *buf, size_t n, int eof)
+{
+    const char *p = buf, *end = buf + n;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol && !eof)
+            break;
+        if (!eol)
+            eol = end;
+        if (!s->skipLine)
+            candumpLine(s, p, eol);
+        s->skipLine = 0;
+        p = eol < end ? eol + 1 : end;
+    }
+    if (p == buf && n == CANDUMP_BUFFER) {
+        s->skipLine = 1; // no end of line in sight, drop it
+        return n;
+    }
+    return p - buf;
+}
+
+
+// Parses whole struct can_frame of buf. Returns bytes used.
+static size_t candumpBinary(CandumpState *s, const unsigned char *buf, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + CANDUMP_FRAME <= n; i += CANDUMP_FRAME) {
+        const unsigned char *f = buf + i;
+        canMessage_t m;
+        uint32_t id;
+
+        memcpy(&id, f, sizeof(id));
+        if (id & (CANDUMP_RTR_FLAG | CANDUMP_ERR_FLAG))
+            continue;
+        if (f[4] > 8) {
+            candumpWarn(s);
+            continue;
+        }
+        m.id = id & CANDUMP_EFF_FLAG ? id & (CANDUMP_EFF_MASK | CANDUMP_EFF_FLAG)
+            : id & CANDUMP_SFF_MASK;
+        m.bus = 1;
+        m.dlc = f[4];
+        memcpy(m.byte_arr, f + 8, 8);
+        candumpDeliver(s, &m, s->now);
+    }
+    return i;
+}
+
+
+static uint64_t candumpNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+void candumpReader_processFile(FILE *fp, msgRxCb_t msgRxCb, void *cbData)
+{
+    CandumpState s;
+    char *buf = malloc(CANDUMP_BUFFER);
+    size_t have = 0;
+    int binary = -1;
+    int fd = fileno(fp);
+
+    if (!buf) {
+        fprintf(stderr, "candumpReader_processFile: out of memory\n");
+        return;
+    }
+    memset(&s, 0, sizeof(s));
+    s.msgRxCb = msgRxCb;
+    s.cbData = cbData;
+
+    // read(), not fread(), to pass on what a pipe has as it arrives.
+    for (;;) {
+        ssize_t got = read(fd, buf + have, CANDUMP_BUFFER - have);
+        size_t used;
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0) {
+            fprintf(stderr, "candumpReader_processFile: %s\n", strerror(errno));
+            break;
+        }
+        have += got;
+        s.now = candumpNow();
+
+        // Padding of struct can_frame is zero, text has no zeros.
+        if (binary < 0) {
+            if (have < 8 && got)
+                continue;
+            binary = have >= 8 && buf[5] == 0 && buf[6] == 0;
+        }
+        used = binary ? candumpBinary(&s, (unsigned char *) buf, have)
+            : candumpText(&s, buf, have, !got);
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        if (!got)
+            break;
+    }
+    if (binary == 1 && have)
+        fprintf(stderr, "candumpReader_processFile: "
+                "%u bytes of a truncated frame at the end\n", (unsigned) have);
+    free(buf);
+}
@@ -0,0 +1,37 @@
+#ifndef INCLUDE_CANDUMPREADER_H
+#define INCLUDE_CANDUMPREADER_H
+
+#include <stdio.h>
+
+#include "measurement.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parser for SocketCAN logs of candump.
+ *
+ * Understands the log format of candump -l and -L,
+ *
+ *    (1436509052.249713) can0 123#11223344
+ *
+ * the default output of candump, with or without -t a,
+ *
+ *    (1436509052.249713)  can0  123   [4]  11 22 33 44
+ *
+ * and a stream of binary struct can_frame as read from a raw CAN
+ * socket, which is told from text by its first frame. Interface canN
+ * is bus N + 1, frames of a binary stream are on bus 1. Frames without
+ * a time stamp get the time they were read at.
+ *
+ * Input is read as it arrives, so live candump output on a pipe is
+ * passed on frame by frame.
+ */
+void candumpReader_processFile(FILE *fp, msgRxCb_t msgRxCb, void *cbData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INCLUDE_CANDUMPREADER_H
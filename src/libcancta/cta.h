@@ -0,0 +1,123 @@
+#ifndef CTA_H
+#define CTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CTA, the cantools archive format.
+ *
+ * One file per measurement, laid out for mmap:
+ *
+ *   header | blocks ... | series[] | columns[] | blocks[] | strings | trailer
+ *
+ * Every message (series) has a time column followed by one column per
+ * signal, or by a single frame column holding the raw payloads. A
+ * column is cut into blocks of consecutive rows, each block compressed
+ * on its own and indexed with its row range, value range and time
+ * range. Block i of every column in a series covers the same rows, so
+ * a time range query decodes only the blocks it overlaps.
+ *
+ * The index behind the blocks is a set of fixed size little endian
+ * tables, usable in place once the file is mapped. The trailer at the
+ * very end tells where it starts. All offsets are 8 byte aligned.
+ */
+
+#define CTA_MAGIC "CANTOOLS"
+#define CTA_TRAILER_MAGIC "CTAINDEX"
+#define CTA_VERSION 1
+
+// Column value types
+#define CTA_TIME_NS 0   // seconds, stored as deltas of int64 nanoseconds
+#define CTA_F64 1
+#define CTA_F32 2
+#define CTA_FRAME 3     // raw CAN payloads of width bytes, at most 8
+
+// Block codecs, values are byte shuffled before compression
+#define CTA_RAW 0
+#define CTA_DEFLATE 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} cta_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t bus;
+    uint32_t name;          // string offset
+    uint32_t dbc;           // string offset
+    uint32_t first_column;  // the time column
+    uint32_t n_columns;
+    uint64_t n_rows;
+} cta_series_t;
+
+typedef struct {
+    uint32_t name;          // string offset
+    uint32_t unit;          // string offset, 0 for none
+    uint32_t series;
+    uint32_t type;
+    uint32_t first_block;
+    uint32_t n_blocks;
+    uint32_t width;         // bytes per value
+    uint32_t reserved;
+} cta_column_t;
+
+typedef struct {
+    uint64_t offset;        // of the encoded data in the file
+    uint64_t first_row;
+    uint32_t size;          // encoded bytes
+    uint32_t n_rows;
+    uint32_t codec;
+    uint32_t reserved;
+    double min;             // of the values, NaN if all are NaN
+    double max;
+    double t0;              // time range of the rows
+    double t1;
+} cta_block_t;
+
+typedef struct {
+    uint64_t index_offset;  // series table, the other tables follow
+    uint32_t n_series;
+    uint32_t n_columns;
+    uint32_t n_blocks;
+    uint32_t strings_size;
+    char magic[8];
+} cta_trailer_t;
+
+/* Bytes needed for encoding or decoding a block of n rows. */
+size_t cta_block_bound(size_t n_rows);
+
+/*
+ * Encode n values of a column into out, at most cta_block_bound(n)
+ * bytes. scratch must hold cta_block_bound(n) bytes too. Compression
+ * level 0 stores the block raw. Returns the encoded size, 0 on failure.
+ */
+size_t cta_block_encode(uint32_t type, int level,
+                        const double *values, size_t n,
+                        unsigned char *scratch,
+                        unsigned char *out, uint32_t *codec);
+
+/*
+ * Decode block data into block->n_rows values.
+ * scratch must hold cta_block_bound(block->n_rows) bytes.
+ * Returns 0 on success.
+ */
+int cta_block_decode(uint32_t type, const cta_block_t *block,
+                     const unsigned char *data,
+                     unsigned char *scratch, double *values);
+
+/*
+ * Same for a frame column, n payloads of width bytes each.
+ * Payload bytes are stored column wise, byte 0 of every frame first.
+ */
+size_t cta_frames_encode(int level, const unsigned char *data,
+                         size_t n, size_t width,
+                         unsigned char *scratch,
+                         unsigned char *out, uint32_t *codec);
+int cta_frames_decode(const cta_block_t *block, size_t width,
+                      const unsigned char *data,
+                      unsigned char *scratch, unsigned char *frames);
+
+#endif /* CTA_H */
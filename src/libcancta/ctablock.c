@@ -0,0 +1,194 @@
+#include <math.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "cta.h"
+
+// Block encoding shared by the writer and the reader.
+//
+// Values are converted to the column type and then, for compression,
+// byte shuffled: all first bytes, then all second bytes and so on, as
+// the HDF5 shuffle filter does. Time is stored as nanosecond deltas,
+// which shuffle into long runs of zeros for periodic messages.
+// Raw blocks are kept unshuffled.
+
+
+static size_t type_width(uint32_t type)
+{
+    return type == CTA_F32 ? sizeof(float) : sizeof(uint64_t);
+}
+
+
+/*
+ * Nanoseconds of t. Whole seconds are split off first, as measurement.c
+ * does, t * 1e9 of an epoch time is already off by hundreds of ns.
+ */
+static int64_t to_ns(double t)
+{
+    double sec = floor(t);
+    return (int64_t) sec * 1000000000 + llround((t - sec) * 1e9);
+}
+
+
+/* Bits of value i, time as the delta to the previous one. */
+static uint64_t value_bits(uint32_t type, const double *values, size_t i)
+{
+    uint64_t bits;
+    if (type == CTA_TIME_NS) {
+        bits = to_ns(values[i]) - (i ? to_ns(values[i - 1]) : 0);
+    } else if (type == CTA_F32) {
+        float f = values[i];
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        bits = u;
+    } else {
+        memcpy(&bits, &values[i], sizeof(bits));
+    }
+    return bits;
+}
+
+
+/* Value from its bits, ns carries the running time sum. */
+static double bits_value(uint32_t type, uint64_t bits, int64_t *ns)
+{
+    if (type == CTA_TIME_NS) {
+        *ns += (int64_t) bits;
+        // As measurement.c computes it, for the same rounding.
+        return (double) (*ns / 1000000000) + (*ns % 1000000000) * 1e-9;
+    } else if (type == CTA_F32) {
+        uint32_t u = bits;
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+    } else {
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+}
+
+
+size_t cta_block_bound(size_t n_rows)
+{
+    return compressBound(n_rows * sizeof(double));
+}
+
+
+size_t cta_block_encode(uint32_t type, int level,
+                        const double *values, size_t n,
+                        unsigned char *scratch,
+                        unsigned char *out, uint32_t *codec)
+{
+    const size_t width = type_width(type);
+    const size_t raw_size = n * width;
+
+    if (level > 0) {
+        for (size_t i = 0; i < n; i++) {
+            uint64_t bits = value_bits(type, values, i);
+            for (size_t k = 0; k < width; k++)
+                scratch[k * n + i] = bits >> (8 * k);
+        }
+
+        uLongf size = cta_block_bound(n);
+        if (compress2(out, &size, scratch, raw_size, level) == Z_OK
+            && size < raw_size) {
+            *codec = CTA_DEFLATE;
+            return size;
+        }
+    }
+
+    // Incompressible or not compressed, little endian host assumed.
+    for (size_t i = 0; i < n; i++) {
+        uint64_t bits = value_bits(type, values, i);
+        memcpy(out + i * width, &bits, width);
+    }
+    *codec = CTA_RAW;
+    return raw_size;
+}
+
+
+int cta_block_decode(uint32_t type, const cta_block_t *block,
+                     const unsigned char *data,
+                     unsigned char *scratch, double *values)
+{
+    const size_t n = block->n_rows;
+    const size_t width = type_width(type);
+    const size_t raw_size = n * width;
+    int64_t ns = 0;
+
+    if (block->codec == CTA_DEFLATE) {
+        uLongf size = raw_size;
+        if (uncompress(scratch, &size, data, block->size) != Z_OK
+            || size != raw_size)
+            return 1;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t bits = 0;
+            for (size_t k = 0; k < width; k++)
+                bits |= (uint64_t) scratch[k * n + i] << (8 * k);
+            values[i] = bits_value(type, bits, &ns);
+        }
+    } else if (block->codec == CTA_RAW && block->size == raw_size) {
+        for (size_t i = 0; i < n; i++) {
+            uint64_t bits = 0;
+            memcpy(&bits, data + i * width, width);
+            values[i] = bits_value(type, bits, &ns);
+        }
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+
+size_t cta_frames_encode(int level, const unsigned char *data,
+                         size_t n, size_t width,
+                         unsigned char *scratch,
+                         unsigned char *out, uint32_t *codec)
+{
+    const size_t raw_size = n * width;
+
+    if (level > 0) {
+        for (size_t i = 0; i < n; i++) {
+            for (size_t k = 0; k < width; k++)
+                scratch[k * n + i] = data[i * width + k];
+        }
+
+        uLongf size = cta_block_bound(n);
+        if (compress2(out, &size, scratch, raw_size, level) == Z_OK
+            && size < raw_size) {
+            *codec = CTA_DEFLATE;
+            return size;
+        }
+    }
+
+    if (raw_size)
+        memcpy(out, data, raw_size);
+    *codec = CTA_RAW;
+    return raw_size;
+}
+
+
+int cta_frames_decode(const cta_block_t *block, size_t width,
+                      const unsigned char *data,
+                      unsigned char *scratch, unsigned char *frames)
+{
+    const size_t n = block->n_rows;
+    const size_t raw_size = n * width;
+
+    if (block->codec == CTA_DEFLATE) {
+        uLongf size = raw_size;
+        if (uncompress(scratch, &size, data, block->size) != Z_OK
+            || size != raw_size)
+            return 1;
+        for (size_t i = 0; i < n; i++) {
+            for (size_t k = 0; k < width; k++)
+                frames[i * width + k] = scratch[k * n + i];
+        }
+    } else if (block->codec == CTA_RAW && block->size == raw_size) {
+        if (raw_size)
+            memcpy(frames, data, raw_size);
+    } else {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "ctareader.h"
+
+
+/* Map the whole file read only, read it into memory where mmap is missing. */
+static const unsigned char *map_file(const char *filename, size_t *size)
+{
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        *size = st.st_size;
+        base = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return base == MAP_FAILED ? NULL : base;
+#else
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        return NULL;
+
+    unsigned char *base = NULL;
+    if (fseek(fp, 0, SEEK_END) == 0 && (*size = ftell(fp)) > 0
+        && fseek(fp, 0, SEEK_SET) == 0 && (base = malloc(*size))
+        && fread(base, 1, *size, fp) != *size) {
+        free(base);
+        base = NULL;
+    }
+    fclose(fp);
+    return base;
+#endif
+}
+
+
+static void unmap_file(const unsigned char *base, size_t size)
+{
+#ifndef _WIN32
+    munmap((void *) base, size);
+#else
+    free((void *) base);
+#endif
+}
+
+
+/* Check that the index is consistent, so that readers can trust it. */
+static int check_index(const cta_t *cta, uint64_t index_offset)
+{
+    if (cta->strings_size == 0 || cta->strings[cta->strings_size - 1] != '\0')
+        return 1;
+
+    for (uint32_t i = 0; i < cta->n_series; i++) {
+        const cta_series_t *s = &cta->series[i];
+        if (s->name >= cta->strings_size || s->dbc >= cta->strings_size
+            || s->n_columns == 0 || s->n_columns > cta->n_columns
+            || s->first_column > cta->n_columns - s->n_columns)
+            return 1;
+    }
+    for (uint32_t i = 0; i < cta->n_columns; i++) {
+        const cta_column_t *c = &cta->columns[i];
+        if (c->name >= cta->strings_size || c->unit >= cta->strings_size
+            || c->series >= cta->n_series || c->type > CTA_FRAME
+            || (c->type == CTA_FRAME ? c->width > 8
+                : c->width != (c->type == CTA_F32 ? 4u : 8u))
+            || c->n_blocks > cta->n_blocks
+            || c->first_block > cta->n_blocks - c->n_blocks)
+            return 1;
+    }
+    for (uint32_t i = 0; i < cta->n_blocks; i++) {
+        const cta_block_t *b = &cta->blocks[i];
+        if (b->offset > index_offset || b->size > index_offset - b->offset)
+            return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * cta_open - map an archive and locate its index
+ */
+cta_t *cta_open(const char *filename)
+{
+    cta_t *cta = calloc(1, sizeof(cta_t));
+    if (!cta)
+        return NULL;
+
+    cta->base = map_file(filename, &cta->size);
+    if (!cta->base) {
+        fprintf(stderr, "error: could not open %s\n", filename);
+        free(cta);
+        return NULL;
+    }
+
+    if (cta->size < sizeof(cta_header_t) + sizeof(cta_trailer_t)) {
+        fprintf(stderr, "error: %s is not a cantools archive\n", filename);
+        goto fail;
+    }
+    const cta_header_t *header = (const cta_header_t *) cta->base;
+    const cta_trailer_t *trailer = (const cta_trailer_t *)
+        (cta->base + cta->size - sizeof(cta_trailer_t));
+    if (memcmp(header->magic, CTA_MAGIC, 8) != 0
+        || memcmp(trailer->magic, CTA_TRAILER_MAGIC, 8) != 0) {
+        fprintf(stderr, "error: %s is not a cantools archive\n", filename);
+        goto fail;
+    }
+    if (header->version != CTA_VERSION) {
+        fprintf(stderr, "error: %s has unsupported version %u\n",
+                filename, header->version);
+        goto fail;
+    }
+
+    uint64_t index_offset = trailer->index_offset;
+    uint64_t index_size = (uint64_t) trailer->n_series * sizeof(cta_series_t)
+        + (uint64_t) trailer->n_columns * sizeof(cta_column_t)
+        + (uint64_t) trailer->n_blocks * sizeof(cta_block_t)
+        + trailer->strings_size;
+    if (index_offset % 8 != 0
+        || index_offset > cta->size - sizeof(cta_trailer_t)
+        || index_size > cta->size - sizeof(cta_trailer_t) - index_offset) {
+        fprintf(stderr, "error: %s has a broken index\n", filename);
+        goto fail;
+    }
+
+    const unsigned char *p = cta->base + index_offset;
+    cta->series = (const cta_series_t *) p;
+    cta->n_series = trailer->n_series;
+    p += cta->n_series * sizeof(cta_series_t);
+    cta->columns = (const cta_column_t *) p;
+    cta->n_columns = trailer->n_columns;
+    p += cta->n_columns * sizeof(cta_column_t);
+    cta->blocks = (const cta_block_t *) p;
+    cta->n_blocks = trailer->n_blocks;
+    p += cta->n_blocks * sizeof(cta_block_t);
+    cta->strings = (const char *) p;
+    cta->strings_size = trailer->strings_size;
+
+    if (check_index(cta, index_offset)) {
+        fprintf(stderr, "error: %s has a broken index\n", filename);
+        goto fail;
+    }
+    return cta;
+
+fail:
+    cta_close(cta);
+    return NULL;
+}
+
+
+void cta_close(cta_t *cta)
+{
+    if (!cta)
+        return;
+    unmap_file(cta->base, cta->size);
+    free(cta);
+}
+
+
+const char *cta_string(const cta_t *cta, uint32_t offset)
+{
+    return offset < cta->strings_size ? cta->strings + offset : "";
+}
+
+
+int cta_find_column(const cta_t *cta, const char *message, const char *signal)
+{
+    for (uint32_t i = 0; i < cta->n_series; i++) {
+        const cta_series_t *s = &cta->series[i];
+        if (message && strcmp(message, cta_string(cta, s->name)) != 0)
+            continue;
+        for (uint32_t c = s->first_column; c < s->first_column + s->n_columns; c++) {
+            if (0 == strcmp(signal, cta_string(cta, cta->columns[c].name)))
+                return c;
+        }
+    }
+    return -1;
+}
+
+
+static int overlaps(const cta_block_t *b, double t0, double t1)
+{
+    return !(b->t1 < t0 || b->t0 > t1);
+}
+
+
+/*
+ * cta_read_range - rows of a column in the time range [t0, t1]
+ */
+long cta_read_range(const cta_t *cta, uint32_t column, double t0, double t1,
+                    double **time, double **values, size_t *blocks_read)
+{
+    if (column >= cta->n_columns)
+        return -1;
+    const cta_column_t *col = &cta->columns[column];
+    const cta_series_t *series = &cta->series[col->series];
+    const cta_column_t *time_col = &cta->columns[series->first_column];
+    const cta_block_t *time_blocks = cta->blocks + time_col->first_block;
+    const cta_block_t *blocks = cta->blocks + col->first_block;
+    if (time_col->n_blocks != col->n_blocks || col->type == CTA_FRAME)
+        return -1;
+
+    // Size buffers for the blocks that will be read.
+    size_t max_rows = 0, max_block = 0;
+    for (uint32_t i = 0; i < col->n_blocks; i++) {
+        if (!overlaps(&blocks[i], t0, t1))
+            continue;
+        max_rows += blocks[i].n_rows;
+        if (blocks[i].n_rows > max_block)
+            max_block = blocks[i].n_rows;
+    }
+
+    long n = -1;
+    size_t n_read = 0;
+    *time = malloc((max_rows + 1) * sizeof(double));
+    *values = malloc((max_rows + 1) * sizeof(double));
+    double *block_time = malloc((max_block + 1) * sizeof(double));
+    double *block_values = malloc((max_block + 1) * sizeof(double));
+    unsigned char *scratch = malloc(cta_block_bound(max_block) + 1);
+    if (!*time || !*values || !block_time || !block_values || !scratch)
+        goto exit;
+
+    n = 0;
+    for (uint32_t i = 0; i < col->n_blocks; i++) {
+        const cta_block_t *tb = &time_blocks[i];
+        const cta_block_t *vb = &blocks[i];
+        if (!overlaps(vb, t0, t1))
+            continue;
+
+        if (tb->n_rows != vb->n_rows
+            || cta_block_decode(time_col->type, tb, cta->base + tb->offset,
+                                scratch, block_time)
+            || cta_block_decode(col->type, vb, cta->base + vb->offset,
+                                scratch, block_values)) {
+            n = -1;
+            goto exit;
+        }
+        n_read++;
+
+        for (uint32_t j = 0; j < vb->n_rows; j++) {
+            if (block_time[j] < t0 || block_time[j] > t1)
+                continue;
+            (*time)[n] = block_time[j];
+            (*values)[n] = block_values[j];
+            n++;
+        }
+    }
+
+exit:
+    if (n < 0) {
+        free(*time);
+        free(*values);
+        *time = *values = NULL;
+    }
+    if (blocks_read)
+        *blocks_read = n_read;
+    free(block_time);
+    free(block_values);
+    free(scratch);
+    return n;
+}
+
+
+/*
+ * cta_read_column - decode all blocks of a column
+ */
+int cta_read_column(const cta_t *cta, uint32_t column, void *out)
+{
+    if (column >= cta->n_columns)
+        return 1;
+    const cta_column_t *col = &cta->columns[column];
+    const cta_series_t *series = &cta->series[col->series];
+    const cta_block_t *blocks = cta->blocks + col->first_block;
+
+    // Blocks must cover the rows one after the other.
+    size_t max_block = 0;
+    uint64_t rows = 0;
+    for (uint32_t i = 0; i < col->n_blocks; i++) {
+        if (blocks[i].first_row != rows)
+            return 1;
+        rows += blocks[i].n_rows;
+        if (blocks[i].n_rows > max_block)
+            max_block = blocks[i].n_rows;
+    }
+    if (rows != series->n_rows)
+        return 1;
+
+    unsigned char *scratch = malloc(cta_block_bound(max_block) + 1);
+    if (!scratch)
+        return 1;
+
+    int err = 0;
+    for (uint32_t i = 0; i < col->n_blocks && !err; i++) {
+        const cta_block_t *b = &blocks[i];
+        const unsigned char *data = cta->base + b->offset;
+        if (col->type == CTA_FRAME)
+            err = cta_frames_decode(b, col->width, data, scratch,
+                                    (unsigned char *) out
+                                    + b->first_row * col->width);
+        else
+            err = cta_block_decode(col->type, b, data, scratch,
+                                   (double *) out + b->first_row);
+    }
+    free(scratch);
+    return err;
+}
@@ -0,0 +1,45 @@
+#ifndef CTAREADER_H
+#define CTAREADER_H
+
+#include "cta.h"
+
+// An opened archive. The tables point into the mapped file.
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+    const cta_series_t *series;
+    uint32_t n_series;
+    const cta_column_t *columns;
+    uint32_t n_columns;
+    const cta_block_t *blocks;
+    uint32_t n_blocks;
+    const char *strings;
+    uint32_t strings_size;
+} cta_t;
+
+cta_t *cta_open(const char *filename);
+void cta_close(cta_t *cta);
+
+const char *cta_string(const cta_t *cta, uint32_t offset);
+
+/*
+ * Index of a signal column, -1 if not found. The message name may be
+ * NULL, the first series with the signal is then used.
+ */
+int cta_find_column(const cta_t *cta, const char *message, const char *signal);
+
+/*
+ * Read the rows of a column with time in [t0, t1], decoding only the
+ * blocks that overlap. Arrays are malloced, free them when done.
+ * Returns the number of rows, -1 on failure. blocks_read is optional.
+ */
+long cta_read_range(const cta_t *cta, uint32_t column, double t0, double t1,
+                    double **time, double **values, size_t *blocks_read);
+
+/*
+ * Decode a whole column into out, which holds the n_rows of its series:
+ * doubles, or width bytes per row for frame columns. Returns 0 on success.
+ */
+int cta_read_column(const cta_t *cta, uint32_t column, void *out);
+
+#endif /* CTAREADER_H */
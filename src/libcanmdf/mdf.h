@@ -0,0 +1,175 @@
+#ifndef MDF_H
+#define MDF_H
+
+#include <stdint.h>
+
+/*
+ * MDF 4, the ASAM measurement data format.
+ *
+ * A file is a tree of blocks, linked by absolute file offsets, 0 for
+ * none. Every block starts with a header, its links and then its data:
+ *
+ *   "##XX" | reserved | length | link_count | links[] | data
+ *
+ * The header block (HD) starts the list of data groups (DG). A data
+ * group holds the records of its channel groups (CG), each with its
+ * list of channels (CN) telling where a value sits in a record and how
+ * to convert it (CC). The records are in a DT block, a DZ block holding
+ * a deflated DT, or a list of either (DL, under an HL when zipped).
+ * Variable length values live in SD blocks, or in records of a channel
+ * group of their own (VLSD).
+ *
+ * Blocks are 8 byte aligned and little endian, the data sections below
+ * are usable in place once the file is mapped.
+ */
+
+#define MDF_ID_FILE "MDF     "
+#define MDF_ID_UNFINISHED "UnFinMF "
+#define MDF_HD_OFFSET 64
+
+typedef struct {
+    char file_id[8];        // MDF_ID_FILE
+    char version[8];        // "4.10    "
+    char program[8];
+    uint32_t reserved1;
+    uint16_t version_number; // 410
+    uint8_t reserved2[30];
+    uint16_t unfin_flags;
+    uint16_t custom_unfin_flags;
+} mdf_id_t;
+
+typedef struct {
+    char id[4];             // "##" and the block type
+    uint32_t reserved;
+    uint64_t length;        // of the whole block
+    uint64_t link_count;
+} mdf_header_t;
+
+// Links, in this order
+enum { MDF_HD_DG, MDF_HD_FH, MDF_HD_CH, MDF_HD_AT, MDF_HD_EV, MDF_HD_MD };
+enum { MDF_DG_NEXT, MDF_DG_CG, MDF_DG_DATA, MDF_DG_MD };
+enum { MDF_CG_NEXT, MDF_CG_CN, MDF_CG_ACQ_NAME, MDF_CG_ACQ_SOURCE,
+       MDF_CG_SR, MDF_CG_MD };
+enum { MDF_CN_NEXT, MDF_CN_COMPOSITION, MDF_CN_NAME, MDF_CN_SOURCE,
+       MDF_CN_CONVERSION, MDF_CN_DATA, MDF_CN_UNIT, MDF_CN_MD };
+enum { MDF_CC_NAME, MDF_CC_UNIT, MDF_CC_MD, MDF_CC_INVERSE };
+enum { MDF_DL_NEXT, MDF_DL_DATA };
+enum { MDF_HL_DL };
+
+typedef struct {
+    uint64_t start_time_ns; // since 1970, UTC
+    int16_t tz_offset_min;
+    int16_t dst_offset_min;
+    uint8_t time_flags;
+    uint8_t time_class;
+    uint8_t flags;
+    uint8_t reserved;
+    double start_angle_rad;
+    double start_distance_m;
+} mdf_hd_t;
+
+typedef struct {
+    uint8_t rec_id_size;    // 0 for sorted data groups, else 1, 2, 4 or 8
+    uint8_t reserved[7];
+} mdf_dg_t;
+
+#define MDF_CG_VLSD 0x0001   // records of variable length values
+#define MDF_CG_BUS_EVENT 0x0002
+
+typedef struct {
+    uint64_t record_id;
+    uint64_t cycle_count;   // records
+    uint16_t flags;
+    uint16_t path_separator;
+    uint32_t reserved;
+    uint32_t data_bytes;    // per record, after the record ID
+    uint32_t inval_bytes;   // per record, after the data bytes
+} mdf_cg_t;
+
+// Channel types
+#define MDF_CN_FIXED 0
+#define MDF_CN_VLSD 1
+#define MDF_CN_MASTER 2
+#define MDF_CN_VIRTUAL_MASTER 3
+#define MDF_CN_SYNC 4
+#define MDF_CN_MLSD 5
+#define MDF_CN_VIRTUAL 6
+
+// Sync types
+#define MDF_SYNC_TIME 1
+
+// Data types
+#define MDF_UINT_LE 0
+#define MDF_UINT_BE 1
+#define MDF_INT_LE 2
+#define MDF_INT_BE 3
+#define MDF_FLOAT_LE 4
+#define MDF_FLOAT_BE 5
+#define MDF_BYTES 10
+
+// Channel flags
+#define MDF_CN_ALL_INVALID 0x0001
+#define MDF_CN_INVAL_BIT 0x0002
+
+typedef struct {
+    uint8_t type;
+    uint8_t sync_type;
+    uint8_t data_type;
+    uint8_t bit_offset;     // 0-7, in the first byte
+    uint32_t byte_offset;   // after the record ID
+    uint32_t bit_count;
+    uint32_t flags;
+    uint32_t inval_bit_pos; // in the invalidation bytes
+    uint8_t precision;
+    uint8_t reserved;
+    uint16_t attachment_count;
+    double val_range_min;
+    double val_range_max;
+    double limit_min;
+    double limit_max;
+    double limit_ext_min;
+    double limit_ext_max;
+} mdf_cn_t;
+
+// Conversion types
+#define MDF_CC_IDENTITY 0
+#define MDF_CC_LINEAR 1         // val[1] * x + val[0]
+#define MDF_CC_RATIONAL 2       // (val[0] x^2 + val[1] x + val[2]) /
+                                // (val[3] x^2 + val[4] x + val[5])
+#define MDF_CC_TAB_INT 4        // val[] pairs of x, y, interpolated
+#define MDF_CC_TAB 5            // val[] pairs of x, y, nearest x
+#define MDF_CC_RANGE 6          // val[] triples of min, max, y, default
+
+typedef struct {
+    uint8_t type;
+    uint8_t precision;
+    uint16_t flags;
+    uint16_t ref_count;
+    uint16_t val_count;
+    double phy_range_min;
+    double phy_range_max;
+    double val[];
+} mdf_cc_t;
+
+// Zip types
+#define MDF_ZIP_DEFLATE 0
+#define MDF_ZIP_TRANSPOSE_DEFLATE 1
+
+typedef struct {
+    char org_block_type[2]; // "DT", "SD" or "RD"
+    uint8_t zip_type;
+    uint8_t reserved;
+    uint32_t zip_parameter; // columns, for transposition
+    uint64_t org_data_length;
+    uint64_t data_length;
+} mdf_dz_t;
+
+#define MDF_DL_EQUAL_LENGTH 0x01
+
+typedef struct {
+    uint8_t flags;
+    uint8_t reserved[3];
+    uint32_t count;
+} mdf_dl_t;
+
+#endif /* MDF_H */
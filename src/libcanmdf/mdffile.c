@@ -0,0 +1,930 @@
+#define _GNU_SOURCE // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mdffile.h"
+
+#define MDF_MAX_DEPTH 16    // of nested lists and compositions
+#define MDF_MAX_INFLATE 1032 // deflate ratio, bounds the lengths of DZ blocks
+
+// A growing copy of data, or a view of data in the mapped file.
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    unsigned char *owned;   // malloced, data points into it
+    size_t cap;
+} mdf_buf_t;
+
+
+/* Map fp read only, read it into memory where it cannot be mapped. */
+static const unsigned char *map_file(FILE *fp, size_t *size, int *mapped)
+{
+    unsigned char *base = NULL;
+    size_t cap = 0, n = 0, got;
+
+    *mapped = 0;
+#ifndef _WIN32
+    struct stat st;
+    int fd = fileno(fp);
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            *mapped = 1;
+            *size = st.st_size;
+            return map;
+        }
+    }
+#endif
+    do {
+        if (n == cap) {
+            unsigned char *grown = realloc(base, cap ? 2 * cap : 1 << 20);
+            if (!grown) {
+                free(base);
+                return NULL;
+            }
+            base = grown;
+            cap = cap ? 2 * cap : 1 << 20;
+        }
+        got = fread(base + n, 1, cap - n, fp);
+        n += got;
+    } while (got);
+    *size = n;
+    return base;
+}
+
+
+/* The block at offset, of type if not NULL. NULL if it is broken. */
+static const mdf_header_t *get_block(const mdf_t *mdf, uint64_t offset,
+                                     const char *type)
+{
+    if (offset == 0 || offset % 8 || offset > mdf->size
+        || mdf->size - offset < sizeof(mdf_header_t))
+        return NULL;
+
+    const mdf_header_t *h = (const mdf_header_t *) (mdf->base + offset);
+    if (h->id[0] != '#' || h->id[1] != '#'
+        || (type && (h->id[2] != type[0] || h->id[3] != type[1]))
+        || h->link_count > (mdf->size - offset) / 8
+        || h->length < sizeof(mdf_header_t) + 8 * h->link_count
+        || h->length > mdf->size - offset)
+        return NULL;
+    return h;
+}
+
+
+static int is_block(const mdf_header_t *h, const char *type)
+{
+    return h->id[2] == type[0] && h->id[3] == type[1];
+}
+
+
+static uint64_t get_link(const mdf_header_t *h, uint64_t i)
+{
+    const uint64_t *links = (const uint64_t *) (h + 1);
+    return i < h->link_count ? links[i] : 0;
+}
+
+
+static const void *get_data(const mdf_header_t *h)
+{
+    return (const uint64_t *) (h + 1) + h->link_count;
+}
+
+
+static uint64_t data_size(const mdf_header_t *h)
+{
+    return h->length - sizeof(mdf_header_t) - 8 * h->link_count;
+}
+
+
+/* Text of a TX block, NULL for none. */
+static const char *get_text(const mdf_t *mdf, uint64_t offset)
+{
+    const mdf_header_t *h = get_block(mdf, offset, "TX");
+    if (!h || !memchr(get_data(h), '\0', data_size(h)))
+        return NULL;
+    return get_data(h);
+}
+
+
+/* Malloced text of a TX block, or of the TX element of an MD block. */
+static char *get_unit(const mdf_t *mdf, uint64_t offset)
+{
+    const mdf_header_t *h = get_block(mdf, offset, NULL);
+    if (!h)
+        return NULL;
+    if (is_block(h, "TX")) {
+        const char *text = get_text(mdf, offset);
+        return text && *text ? strdup(text) : NULL;
+    }
+
+    if (!is_block(h, "MD"))
+        return NULL;
+    const char *xml = get_data(h);
+    size_t n = strnlen(xml, data_size(h));
+    const char *tx = memmem(xml, n, "<TX>", 4);
+    const char *tx_end = tx ? memmem(tx, xml + n - tx, "</TX>", 5) : NULL;
+    if (!tx_end || tx_end == tx + 4)
+        return NULL;
+    return strndup(tx + 4, tx_end - tx - 4);
+}
+
+
+static int add_channels(mdf_t *mdf, uint32_t group, uint64_t cn, int parent,
+                        int depth)
+{
+    size_t seen = 0;
+
+    for (; cn; cn = get_link(get_block(mdf, cn, "CN"), MDF_CN_NEXT)) {
+        const mdf_header_t *h = get_block(mdf, cn, "CN");
+        if (!h || data_size(h) < sizeof(mdf_cn_t) || ++seen > mdf->size / 8) {
+            fprintf(stderr, "Broken channel block at 0x%llx.\n",
+                    (unsigned long long) cn);
+            return 1;
+        }
+        if (mdf->n_channels % 64 == 0) {
+            mdf_channel_t *channels = realloc(mdf->channels,
+                (mdf->n_channels + 64) * sizeof(mdf_channel_t));
+            if (!channels)
+                return 1;
+            mdf->channels = channels;
+        }
+
+        mdf_channel_t *c = &mdf->channels[mdf->n_channels];
+        memset(c, 0, sizeof(*c));
+        c->cn = get_data(h);
+        c->name = get_text(mdf, get_link(h, MDF_CN_NAME));
+        if (!c->name)
+            c->name = "";
+        c->unit = get_unit(mdf, get_link(h, MDF_CN_UNIT));
+        c->data = get_link(h, MDF_CN_DATA);
+        c->group = group;
+        c->parent = parent;
+
+        // The unit of the conversion takes precedence.
+        const mdf_header_t *cc = get_block(mdf, get_link(h, MDF_CN_CONVERSION),
+                                           "CC");
+        if (cc && data_size(cc) >= sizeof(mdf_cc_t)) {
+            const mdf_cc_t *conv = get_data(cc);
+            if (data_size(cc) >= sizeof(mdf_cc_t) + 8 * conv->val_count)
+                c->cc = conv;
+            char *unit = get_unit(mdf, get_link(cc, MDF_CC_UNIT));
+            if (unit) {
+                free(c->unit);
+                c->unit = unit;
+            }
+        }
+        int index = mdf->n_channels++;
+
+        // Members of a structure, arrays are not supported.
+        uint64_t composition = get_link(h, MDF_CN_COMPOSITION);
+        const mdf_header_t *member = get_block(mdf, composition, NULL);
+        if (member && is_block(member, "CN")) {
+            if (depth >= MDF_MAX_DEPTH
+                || add_channels(mdf, group, composition, index, depth + 1))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int add_group(mdf_t *mdf, const mdf_header_t *dg, uint32_t dg_index,
+                     uint64_t cg_offset)
+{
+    const mdf_header_t *h = get_block(mdf, cg_offset, "CG");
+    if (!h || data_size(h) < sizeof(mdf_cg_t)) {
+        fprintf(stderr, "Broken channel group block at 0x%llx.\n",
+                (unsigned long long) cg_offset);
+        return 1;
+    }
+    if (mdf->n_groups % 16 == 0) {
+        mdf_group_t *groups = realloc(mdf->groups,
+            (mdf->n_groups + 16) * sizeof(mdf_group_t));
+        if (!groups)
+            return 1;
+        mdf->groups = groups;
+    }
+
+    mdf_group_t *g = &mdf->groups[mdf->n_groups];
+    memset(g, 0, sizeof(*g));
+    g->name = get_text(mdf, get_link(h, MDF_CG_ACQ_NAME));
+    g->cg = get_data(h);
+    g->cg_offset = cg_offset;
+    g->dg = dg_index;
+    g->data = get_link(dg, MDF_DG_DATA);
+    g->rec_id_size = ((const mdf_dg_t *) get_data(dg))->rec_id_size;
+    g->record_size = g->cg->flags & MDF_CG_VLSD
+        ? 0 : g->cg->data_bytes + g->cg->inval_bytes;
+    g->first_channel = mdf->n_channels;
+    g->master = -1;
+    if (add_channels(mdf, mdf->n_groups, get_link(h, MDF_CG_CN), -1, 0))
+        return 1;
+    g->n_channels = mdf->n_channels - g->first_channel;
+
+    // The time master, else any master.
+    for (uint32_t i = g->first_channel; i < mdf->n_channels; i++) {
+        const mdf_cn_t *cn = mdf->channels[i].cn;
+        if (mdf->channels[i].parent >= 0
+            || (cn->type != MDF_CN_MASTER && cn->type != MDF_CN_VIRTUAL_MASTER))
+            continue;
+        if (g->master < 0 || cn->sync_type == MDF_SYNC_TIME)
+            g->master = i;
+    }
+    mdf->n_groups++;
+    return 0;
+}
+
+
+mdf_t *mdf_open_file(FILE *fp, const char *filename)
+{
+    mdf_t *mdf = calloc(1, sizeof(mdf_t));
+    if (!mdf)
+        return NULL;
+    if (!filename)
+        filename = "MDF input";
+
+    mdf->base = map_file(fp, &mdf->size, &mdf->mapped);
+    if (!mdf->base) {
+        fprintf(stderr, "Reading %s failed.\n", filename);
+        free(mdf);
+        return NULL;
+    }
+
+    const mdf_id_t *id = (const mdf_id_t *) mdf->base;
+    if (mdf->size < sizeof(mdf_id_t)
+        || (memcmp(id->file_id, MDF_ID_FILE, 8)
+            && memcmp(id->file_id, MDF_ID_UNFINISHED, 8))) {
+        fprintf(stderr, "%s is not an MDF file.\n", filename);
+        goto fail;
+    }
+    mdf->version = id->version_number;
+    if (mdf->version < 400 || mdf->version >= 500) {
+        fprintf(stderr, "%s is MDF %u.%02u, only MDF 4 is supported.\n",
+                filename, mdf->version / 100, mdf->version % 100);
+        goto fail;
+    }
+    if (!memcmp(id->file_id, MDF_ID_UNFINISHED, 8)) {
+        fprintf(stderr, "%s is not finalized.\n", filename);
+        goto fail;
+    }
+
+    const mdf_header_t *hd = get_block(mdf, MDF_HD_OFFSET, "HD");
+    if (!hd || data_size(hd) < sizeof(mdf_hd_t)) {
+        fprintf(stderr, "%s has no header block.\n", filename);
+        goto fail;
+    }
+    mdf->hd = get_data(hd);
+
+    uint32_t dg_index = 0;
+    uint64_t dg = get_link(hd, MDF_HD_DG);
+    for (; dg; dg = get_link(get_block(mdf, dg, "DG"), MDF_DG_NEXT)) {
+        const mdf_header_t *h = get_block(mdf, dg, "DG");
+        if (!h || data_size(h) < sizeof(mdf_dg_t) || dg_index > mdf->size / 8) {
+            fprintf(stderr, "%s has a broken data group.\n", filename);
+            goto fail;
+        }
+        uint64_t cg = get_link(h, MDF_DG_CG);
+        for (size_t seen = 0; cg; cg = get_link(get_block(mdf, cg, "CG"),
+                                                MDF_CG_NEXT)) {
+            if (++seen > mdf->size / 8 || add_group(mdf, h, dg_index, cg))
+                goto fail;
+        }
+        dg_index++;
+    }
+    return mdf;
+
+fail:
+    mdf_close(mdf);
+    return NULL;
+}
+
+
+mdf_t *mdf_open(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Opening %s failed.\n", filename);
+        return NULL;
+    }
+    mdf_t *mdf = mdf_open_file(fp, filename);
+    fclose(fp);
+    return mdf;
+}
+
+
+void mdf_close(mdf_t *mdf)
+{
+    if (!mdf)
+        return;
+    for (uint32_t i = 0; i < mdf->n_channels; i++)
+        free(mdf->channels[i].unit);
+    free(mdf->channels);
+    free(mdf->groups);
+#ifndef _WIN32
+    if (mdf->mapped)
+        munmap((void *) mdf->base, mdf->size);
+    else
+#endif
+        free((void *) mdf->base);
+    free(mdf);
+}
+
+
+static int buf_reserve(mdf_buf_t *b, size_t n)
+{
+    if (n > ((size_t) -1) / 4 - b->size)
+        return 1;
+    if (b->data && !b->owned) {
+        // A view so far, copy it.
+        unsigned char *copy = malloc(b->size + n);
+        if (!copy)
+            return 1;
+        memcpy(copy, b->data, b->size);
+        b->owned = copy;
+        b->data = copy;
+        b->cap = b->size + n;
+    }
+    if (b->size + n <= b->cap)
+        return 0;
+
+    size_t cap = b->cap ? b->cap : 1 << 16;
+    while (cap < b->size + n)
+        cap *= 2;
+    unsigned char *grown = realloc(b->owned, cap);
+    if (!grown)
+        return 1;
+    b->owned = grown;
+    b->data = grown;
+    b->cap = cap;
+    return 0;
+}
+
+
+static int buf_append(mdf_buf_t *b, const void *data, size_t n)
+{
+    if (!b->data) {
+        b->data = data; // the first block is used in place
+        b->size = n;
+        return 0;
+    }
+    if (buf_reserve(b, n))
+        return 1;
+    memcpy(b->owned + b->size, data, n);
+    b->size += n;
+    return 0;
+}
+
+
+/* Inflate a DZ block, undoing the transposition of its columns. */
+static int buf_inflate(mdf_buf_t *b, const mdf_header_t *h)
+{
+    const mdf_dz_t *dz = get_data(h);
+    const unsigned char *zip = (const unsigned char *) (dz + 1);
+    uLongf n = dz->org_data_length;
+
+    if (data_size(h) < sizeof(*dz)
+        || dz->data_length > data_size(h) - sizeof(*dz)
+        || dz->org_data_length / MDF_MAX_INFLATE > dz->data_length
+        || (dz->zip_type != MDF_ZIP_DEFLATE
+            && dz->zip_type != MDF_ZIP_TRANSPOSE_DEFLATE)
+        || buf_reserve(b, n + 1))
+        return 1;
+
+    unsigned char *out = b->owned + b->size;
+    if (dz->zip_type == MDF_ZIP_DEFLATE || dz->zip_parameter <= 1) {
+        if (uncompress(out, &n, zip, dz->data_length) != Z_OK
+            || n != dz->org_data_length)
+            return 1;
+        b->size += n;
+        return 0;
+    }
+
+    unsigned char *t = malloc(n);
+    if (!t || uncompress(t, &n, zip, dz->data_length) != Z_OK
+        || n != dz->org_data_length) {
+        free(t);
+        return 1;
+    }
+    // Column c of the rows x cols matrix starts at c * rows, the
+    // bytes after the last whole row are not transposed.
+    size_t cols = dz->zip_parameter;
+    size_t rows = n / cols;
+    for (size_t c = 0; c < cols; c++) {
+        const unsigned char *col = t + c * rows;
+        for (size_t r = 0; r < rows; r++)
+            out[r * cols + c] = col[r];
+    }
+    memcpy(out + rows * cols, t + rows * cols, n - rows * cols);
+    free(t);
+    b->size += n;
+    return 0;
+}
+
+
+/* Appends the data of a data block, or of the blocks of a list. */
+static int buf_collect(const mdf_t *mdf, mdf_buf_t *b, uint64_t link,
+                       int depth)
+{
+    const mdf_header_t *h = get_block(mdf, link, NULL);
+
+    if (!link)
+        return 0; // no data
+    if (!h || depth > MDF_MAX_DEPTH)
+        return 1;
+    if (is_block(h, "DT") || is_block(h, "SD") || is_block(h, "RD"))
+        return buf_append(b, get_data(h), data_size(h));
+    if (is_block(h, "DZ"))
+        return buf_inflate(b, h);
+    if (is_block(h, "HL"))
+        return buf_collect(mdf, b, get_link(h, MDF_HL_DL), depth + 1);
+    if (!is_block(h, "DL"))
+        return 1;
+
+    for (size_t seen = 0; ; seen++) {
+        const mdf_dl_t *dl = get_data(h);
+        if (seen > mdf->size / 8 || data_size(h) < sizeof(*dl)
+            || h->link_count < 1 || dl->count > h->link_count - 1)
+            return 1;
+        for (uint32_t i = 0; i < dl->count; i++) {
+            if (buf_collect(mdf, b, get_link(h, MDF_DL_DATA + i), depth + 1))
+                return 1;
+        }
+        uint64_t next = get_link(h, MDF_DL_NEXT);
+        if (!next)
+            return 0;
+        if (!(h = get_block(mdf, next, "DL")))
+            return 1;
+    }
+}
+
+
+/* The data of a link, in place if it is a single block. */
+static int read_data(const mdf_t *mdf, uint64_t link, mdf_buf_t *b)
+{
+    memset(b, 0, sizeof(*b));
+    if (buf_collect(mdf, b, link, 0) == 0)
+        return 0;
+    free(b->owned);
+    memset(b, 0, sizeof(*b));
+    return 1;
+}
+
+
+static uint64_t load_le(const unsigned char *p, size_t n)
+{
+    uint64_t v = 0;
+    while (n--)
+        v = v << 8 | p[n];
+    return v;
+}
+
+
+/*
+ * Splits the records of an unsorted data group, keeping the records of
+ * group without their record IDs. VLSD records keep their length.
+ */
+static long split_records(const mdf_t *mdf, const mdf_group_t *group,
+                          const mdf_buf_t *in, mdf_buf_t *out)
+{
+    const mdf_group_t *groups = mdf->groups;
+    const unsigned char *p = in->data, *end = in->data + in->size;
+    size_t id_size = group->rec_id_size;
+    long n = 0;
+
+    if (id_size != 1 && id_size != 2 && id_size != 4 && id_size != 8)
+        return -1;
+    memset(out, 0, sizeof(*out));
+    while ((size_t) (end - p) >= id_size) {
+        uint64_t id = load_le(p, id_size);
+        const mdf_group_t *g = NULL;
+        for (uint32_t i = 0; i < mdf->n_groups && !g; i++) {
+            if (groups[i].dg == group->dg && groups[i].cg->record_id == id)
+                g = &groups[i];
+        }
+        p += id_size;
+
+        size_t size = g ? g->record_size : 0;
+        if (g && g->cg->flags & MDF_CG_VLSD) {
+            if (end - p < 4)
+                break;
+            size = 4 + load_le(p, 4);
+        }
+        if (!g || (size_t) (end - p) < size) {
+            if (!g)
+                fprintf(stderr, "Unknown record ID %llu.\n",
+                        (unsigned long long) id);
+            break;
+        }
+        if (g == group) {
+            if (buf_reserve(out, size))
+                break;
+            memcpy(out->owned + out->size, p, size);
+            out->size += size;
+            n++;
+        }
+        p += size;
+    }
+    if (p != end) {
+        free(out->owned);
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
+    return n;
+}
+
+
+/* All records of a group, or the stream of lengths and values of a VLSD one. */
+static long read_group(const mdf_t *mdf, const mdf_group_t *g, mdf_buf_t *out)
+{
+    mdf_buf_t in;
+    long n;
+
+    if (read_data(mdf, g->data, &in))
+        return -1;
+    if (g->rec_id_size == 0) {
+        *out = in;
+        if (g->cg->flags & MDF_CG_VLSD)
+            return g->cg->cycle_count;
+        n = g->record_size ? in.size / g->record_size : 0;
+        return n < (long) g->cg->cycle_count ? n : (long) g->cg->cycle_count;
+    }
+    n = split_records(mdf, g, &in, out);
+    free(in.owned);
+    return n;
+}
+
+
+long mdf_read_records(const mdf_t *mdf, uint32_t group,
+                      const unsigned char **records, unsigned char **owned)
+{
+    mdf_buf_t b;
+    long n;
+
+    if (group >= mdf->n_groups)
+        return -1;
+    n = read_group(mdf, &mdf->groups[group], &b);
+    if (n < 0) {
+        fprintf(stderr, "Reading records of channel group %u failed.\n",
+                group);
+        return -1;
+    }
+    *records = b.data;
+    *owned = b.owned;
+    return n;
+}
+
+
+int mdf_channel_numeric(const mdf_channel_t *channel)
+{
+    const mdf_cn_t *cn = channel->cn;
+
+    if (cn->type == MDF_CN_VIRTUAL_MASTER || cn->type == MDF_CN_VIRTUAL)
+        return 1;
+    if (cn->type == MDF_CN_VLSD || cn->type == MDF_CN_MLSD)
+        return 0;
+    switch (cn->data_type) {
+    case MDF_UINT_LE:
+    case MDF_UINT_BE:
+    case MDF_INT_LE:
+    case MDF_INT_BE:
+        return cn->bit_count >= 1 && cn->bit_count <= 64
+            && cn->bit_offset + cn->bit_count <= 64;
+    case MDF_FLOAT_LE:
+    case MDF_FLOAT_BE:
+        return cn->bit_offset == 0
+            && (cn->bit_count == 32 || cn->bit_count == 64);
+    default:
+        return 0;
+    }
+}
+
+
+/* Strided copy of a byte aligned little endian value per record. */
+#define EXTRACT(type) \
+    for (size_t i = 0; i < n; i++) { \
+        type v; \
+        memcpy(&v, p + i * stride, sizeof(v)); \
+        out[i] = (double) v; \
+    }
+
+/* Same for the raw bits of a value of up to 64 bits. */
+#define EXTRACT_BITS(load) \
+    for (size_t i = 0; i < n; i++) { \
+        uint64_t v = load(p + i * stride, bytes) >> shift; \
+        if (mask) \
+            v &= mask; \
+        out[i] = v; \
+    }
+
+
+static uint64_t load_be(const unsigned char *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++)
+        v = v << 8 | p[i];
+    return v;
+}
+
+
+static int check_extent(const mdf_t *mdf, const mdf_channel_t *c,
+                        size_t bytes)
+{
+    const mdf_group_t *g = &mdf->groups[c->group];
+    return c->cn->byte_offset > g->record_size
+        || bytes > g->record_size - c->cn->byte_offset;
+}
+
+
+int mdf_read_raw(const mdf_t *mdf, uint32_t channel,
+                 const unsigned char *records, size_t n, uint64_t *out)
+{
+    const mdf_channel_t *c = &mdf->channels[channel];
+    const mdf_cn_t *cn = c->cn;
+    size_t stride = mdf->groups[c->group].record_size;
+    size_t bytes = (cn->bit_offset + cn->bit_count + 7) / 8;
+    unsigned shift = cn->bit_offset;
+    uint64_t mask = cn->bit_count < 64 ? (1ULL << cn->bit_count) - 1 : 0;
+    const unsigned char *p = records + cn->byte_offset;
+
+    if (cn->type == MDF_CN_VIRTUAL_MASTER || cn->type == MDF_CN_VIRTUAL) {
+        for (size_t i = 0; i < n; i++)
+            out[i] = i;
+        return 0;
+    }
+    if (cn->data_type > MDF_INT_BE && cn->data_type != MDF_BYTES)
+        return 1;
+    if (cn->bit_count == 0 || cn->bit_offset + cn->bit_count > 64
+        || check_extent(mdf, c, bytes))
+        return 1;
+    if (cn->data_type == MDF_UINT_BE || cn->data_type == MDF_INT_BE) {
+        EXTRACT_BITS(load_be);
+    } else {
+        EXTRACT_BITS(load_le);
+    }
+    return 0;
+}
+
+
+/* x through a table of pairs of x and y, sorted by x. */
+static double table_lookup(const double *val, size_t pairs, double x,
+                           int interpolate)
+{
+    size_t lo = 0, hi = pairs;
+
+    if (x <= val[0])
+        return val[1];
+    if (x >= val[2 * (pairs - 1)])
+        return val[2 * (pairs - 1) + 1];
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (val[2 * mid] <= x)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    double x0 = val[2 * lo], y0 = val[2 * lo + 1];
+    double x1 = val[2 * hi], y1 = val[2 * hi + 1];
+    if (interpolate)
+        return y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+    return x - x0 <= x1 - x ? y0 : y1;
+}
+
+
+static void convert(const mdf_cc_t *cc, double *out, size_t n)
+{
+    const double *v = cc ? cc->val : NULL;
+
+    if (!cc)
+        return;
+    switch (cc->type) {
+    case MDF_CC_LINEAR:
+        if (cc->val_count < 2)
+            return;
+        for (size_t i = 0; i < n; i++)
+            out[i] = v[1] * out[i] + v[0];
+        break;
+    case MDF_CC_RATIONAL:
+        if (cc->val_count < 6)
+            return;
+        for (size_t i = 0; i < n; i++) {
+            double x = out[i];
+            out[i] = (v[0] * x * x + v[1] * x + v[2])
+                / (v[3] * x * x + v[4] * x + v[5]);
+        }
+        break;
+    case MDF_CC_TAB_INT:
+    case MDF_CC_TAB:
+        if (cc->val_count < 2)
+            return;
+        for (size_t i = 0; i < n; i++)
+            out[i] = table_lookup(v, cc->val_count / 2, out[i],
+                                  cc->type == MDF_CC_TAB_INT);
+        break;
+    case MDF_CC_RANGE: {
+        size_t ranges = cc->val_count / 3;
+        if (cc->val_count < 1)
+            return;
+        for (size_t i = 0; i < n; i++) {
+            double y = v[cc->val_count - 1]; // default
+            for (size_t r = 0; r < ranges; r++) {
+                if (out[i] >= v[3 * r] && out[i] <= v[3 * r + 1]) {
+                    y = v[3 * r + 2];
+                    break;
+                }
+            }
+            out[i] = y;
+        }
+        break;
+    }
+    default:
+        break; // identity, or to text: the raw values
+    }
+}
+
+
+int mdf_read_values(const mdf_t *mdf, uint32_t channel,
+                    const unsigned char *records, size_t n, double *out)
+{
+    const mdf_channel_t *c = &mdf->channels[channel];
+    const mdf_group_t *g = &mdf->groups[c->group];
+    const mdf_cn_t *cn = c->cn;
+    size_t stride = g->record_size;
+    const unsigned char *p = records + cn->byte_offset;
+
+    if (!mdf_channel_numeric(c))
+        return 1;
+    if (cn->type == MDF_CN_VIRTUAL_MASTER || cn->type == MDF_CN_VIRTUAL) {
+        for (size_t i = 0; i < n; i++)
+            out[i] = i;
+        convert(c->cc, out, n);
+        return 0;
+    }
+    if (check_extent(mdf, c, (cn->bit_offset + cn->bit_count + 7) / 8))
+        return 1;
+
+    // Byte aligned little endian values are copied as they are, the
+    // others are shifted and masked out of up to 8 bytes.
+    int aligned = cn->bit_offset == 0 && cn->bit_count % 8 == 0
+        && (cn->bit_count & (cn->bit_count - 1)) == 0;
+    switch (aligned ? cn->data_type : -1) {
+    case MDF_UINT_LE:
+        switch (cn->bit_count) {
+        case 8:  EXTRACT(uint8_t);  break;
+        case 16: EXTRACT(uint16_t); break;
+        case 32: EXTRACT(uint32_t); break;
+        case 64: EXTRACT(uint64_t); break;
+        }
+        break;
+    case MDF_INT_LE:
+        switch (cn->bit_count) {
+        case 8:  EXTRACT(int8_t);  break;
+        case 16: EXTRACT(int16_t); break;
+        case 32: EXTRACT(int32_t); break;
+        case 64: EXTRACT(int64_t); break;
+        }
+        break;
+    case MDF_FLOAT_LE:
+        if (cn->bit_count == 32) {
+            EXTRACT(float);
+        } else {
+            EXTRACT(double);
+        }
+        break;
+    case MDF_FLOAT_BE:
+        for (size_t i = 0; i < n; i++) {
+            uint64_t bits = load_be(p + i * stride, cn->bit_count / 8);
+            if (cn->bit_count == 32) {
+                uint32_t b32 = (uint32_t) bits;
+                float f;
+                memcpy(&f, &b32, sizeof(f));
+                out[i] = f;
+            } else {
+                memcpy(&out[i], &bits, sizeof(double));
+            }
+        }
+        break;
+    default: {
+        int is_signed = cn->data_type == MDF_INT_LE
+            || cn->data_type == MDF_INT_BE;
+        unsigned sign = 64 - cn->bit_count;
+        // Raw values of the same size, converted in place.
+        if (mdf_read_raw(mdf, channel, records, n, (uint64_t *) out))
+            return 1;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t raw;
+            memcpy(&raw, &out[i], sizeof(raw));
+            if (is_signed)
+                out[i] = (double) ((int64_t) (raw << sign) >> sign);
+            else
+                out[i] = (double) raw;
+        }
+        break;
+    }
+    }
+    convert(c->cc, out, n);
+
+    // Invalid values are NaN.
+    if (cn->flags & MDF_CN_ALL_INVALID) {
+        for (size_t i = 0; i < n; i++)
+            out[i] = NAN;
+    } else if (cn->flags & MDF_CN_INVAL_BIT
+               && cn->inval_bit_pos / 8 < g->cg->inval_bytes) {
+        const unsigned char *inval = records + g->cg->data_bytes
+            + cn->inval_bit_pos / 8;
+        unsigned char bit = 1 << (cn->inval_bit_pos % 8);
+        for (size_t i = 0; i < n; i++) {
+            if (inval[i * stride] & bit)
+                out[i] = NAN;
+        }
+    }
+    return 0;
+}
+
+
+/* The stream of lengths and values a VLSD channel points into. */
+static int read_signal_data(const mdf_t *mdf, const mdf_channel_t *c,
+                            mdf_buf_t *b)
+{
+    const mdf_header_t *h = get_block(mdf, c->data, NULL);
+
+    if (h && is_block(h, "CG")) {
+        for (uint32_t i = 0; i < mdf->n_groups; i++) {
+            if (mdf->groups[i].cg_offset == c->data)
+                return read_group(mdf, &mdf->groups[i], b) < 0;
+        }
+        return 1;
+    }
+    return read_data(mdf, c->data, b);
+}
+
+
+int mdf_read_bytes(const mdf_t *mdf, uint32_t channel,
+                   const unsigned char *records, size_t n,
+                   unsigned char *out, size_t width, uint32_t *len)
+{
+    const mdf_channel_t *c = &mdf->channels[channel];
+    const mdf_cn_t *cn = c->cn;
+    size_t stride = mdf->groups[c->group].record_size;
+
+    if (cn->type != MDF_CN_VLSD) {
+        size_t bytes = cn->bit_count / 8;
+        size_t copy = bytes < width ? bytes : width;
+        const unsigned char *p = records + cn->byte_offset;
+        if (cn->bit_offset || check_extent(mdf, c, bytes))
+            return 1;
+        for (size_t i = 0; i < n; i++) {
+            memcpy(out + i * width, p + i * stride, copy);
+            len[i] = bytes;
+        }
+        return 0;
+    }
+
+    // Offsets into a stream of 32 bit lengths, each followed by its bytes.
+    mdf_buf_t sd = {NULL, 0, NULL, 0};
+    uint64_t *offsets = malloc(n * sizeof(uint64_t) + 1);
+    int failed = !offsets || read_signal_data(mdf, c, &sd)
+        || mdf_read_raw(mdf, channel, records, n, offsets);
+    for (size_t i = 0; i < n && !failed; i++) {
+        uint64_t at = offsets[i];
+        if (at > sd.size || sd.size - at < 4
+            || load_le(sd.data + at, 4) > sd.size - at - 4) {
+            failed = 1;
+            break;
+        }
+        len[i] = load_le(sd.data + at, 4);
+        memcpy(out + i * width, sd.data + at + 4,
+               len[i] < width ? len[i] : width);
+    }
+    free(sd.owned);
+    free(offsets);
+    return failed;
+}
+
+
+int mdf_find_channel(const mdf_t *mdf, uint32_t group, const char *name)
+{
+    const mdf_group_t *g = &mdf->groups[group];
+    const char *dot = strrchr(name, '.');
+
+    for (uint32_t i = g->first_channel; i < g->first_channel + g->n_channels; i++) {
+        const mdf_channel_t *c = &mdf->channels[i];
+        if (0 == strcmp(c->name, name))
+            return i;
+        // Members may be named without their parent.
+        if (dot && c->parent >= 0 && 0 == strcmp(c->name, dot + 1)
+            && 0 == strncmp(mdf->channels[c->parent].name, name, dot - name)
+            && mdf->channels[c->parent].name[dot - name] == '\0')
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,96 @@
+#ifndef MDFFILE_H
+#define MDFFILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "mdf.h"
+
+// A channel, the blocks it points into the mapped file.
+typedef struct {
+    const char *name;
+    char *unit;             // malloced, NULL for none
+    const mdf_cn_t *cn;
+    const mdf_cc_t *cc;     // NULL for none
+    uint64_t data;          // link to variable length values, SD or VLSD
+    uint32_t group;
+    int parent;             // of a composition member, -1 for none
+} mdf_channel_t;
+
+// A channel group with the records of its data group.
+typedef struct {
+    const char *name;       // acquisition name, NULL for none
+    const mdf_cg_t *cg;
+    uint64_t cg_offset;
+    uint32_t dg;            // index of the data group, in file order
+    uint64_t data;          // link to the records of the data group
+    uint8_t rec_id_size;
+    uint32_t record_size;   // data and invalidation bytes, no record ID
+    uint32_t first_channel;
+    uint32_t n_channels;    // composition members included
+    int master;             // channel index, -1 for none
+} mdf_group_t;
+
+// An opened file. The blocks are used in place in the mapped file.
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+    int mapped;
+    uint16_t version;       // 410 for 4.10
+    const mdf_hd_t *hd;
+    mdf_group_t *groups;
+    uint32_t n_groups;
+    mdf_channel_t *channels;
+    uint32_t n_channels;
+} mdf_t;
+
+/*
+ * Opens an MDF 4 file, mapping it, or reading it into memory where fp
+ * cannot be mapped, like a pipe. fp may be closed afterwards. Prints
+ * why and returns NULL on failure.
+ */
+mdf_t *mdf_open_file(FILE *fp, const char *filename);
+mdf_t *mdf_open(const char *filename);
+void mdf_close(mdf_t *mdf);
+
+/*
+ * The records of a group, record_size bytes each and without record
+ * IDs. Records of zipped, listed or unsorted data groups are gathered
+ * into a malloced copy, *owned, to be freed by the caller; otherwise
+ * they are used in place and *owned is NULL. Returns the number of
+ * records, -1 on failure.
+ */
+long mdf_read_records(const mdf_t *mdf, uint32_t group,
+                      const unsigned char **records, unsigned char **owned);
+
+/*
+ * Extracts a numeric channel of n records into out, converted to its
+ * physical values. Invalid values are NaN. Virtual channels are the
+ * converted record index. Returns 0 on success.
+ */
+int mdf_read_values(const mdf_t *mdf, uint32_t channel,
+                    const unsigned char *records, size_t n, double *out);
+
+/*
+ * Extracts the raw, unconverted values of an integer channel, also the
+ * offsets of variable length values. Returns 0 on success.
+ */
+int mdf_read_raw(const mdf_t *mdf, uint32_t channel,
+                 const unsigned char *records, size_t n, uint64_t *out);
+
+/*
+ * Copies at most width bytes of a byte array channel per record into
+ * out, width bytes apart, and their lengths into len. Variable length
+ * channels are looked up in their signal data. Returns 0 on success.
+ */
+int mdf_read_bytes(const mdf_t *mdf, uint32_t channel,
+                   const unsigned char *records, size_t n,
+                   unsigned char *out, size_t width, uint32_t *len);
+
+// Channel of group by name, -1 if not found. Members are Parent.Member.
+int mdf_find_channel(const mdf_t *mdf, uint32_t group, const char *name);
+
+// Numeric channels can be read with mdf_read_values.
+int mdf_channel_numeric(const mdf_channel_t *channel);
+
+#endif /* MDFFILE_H */
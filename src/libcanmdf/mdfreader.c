@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mdffile.h"
+#include "mdfreader.h"
+
+// Frames of one channel group, read as whole columns.
+typedef struct {
+    size_t n, next;
+    double *time;
+    uint64_t *id;
+    uint64_t *ide;          // NULL if the group has none
+    uint64_t *bus;          // NULL if the group has none
+    uint64_t *length;
+    unsigned char *bytes;   // 8 per frame
+    uint32_t *n_bytes;
+} MdfFrames;
+
+
+static void mdfFramesFree(MdfFrames *f)
+{
+    free(f->time);
+    free(f->id);
+    free(f->ide);
+    free(f->bus);
+    free(f->length);
+    free(f->bytes);
+    free(f->n_bytes);
+}
+
+
+// An integer column of the group, NULL with *failed unchanged if missing.
+static uint64_t *mdfColumn(const mdf_t *mdf, uint32_t group, const char *name,
+                           const unsigned char *records, size_t n, int *failed)
+{
+    int channel = mdf_find_channel(mdf, group, name);
+    uint64_t *column;
+
+    if (channel < 0)
+        return NULL;
+    column = malloc(n * sizeof(uint64_t) + 1);
+    if (!column || mdf_read_raw(mdf, channel, records, n, column)) {
+        free(column);
+        *failed = 1;
+        return NULL;
+    }
+    return column;
+}
+
+
+// Reads the frames of a group, 0 if it has none.
+static int mdfReadFrames(const mdf_t *mdf, uint32_t group, MdfFrames *f)
+{
+    const mdf_group_t *g = &mdf->groups[group];
+    const unsigned char *records;
+    unsigned char *owned;
+    int id = mdf_find_channel(mdf, group, "CAN_DataFrame.ID");
+    int data = mdf_find_channel(mdf, group, "CAN_DataFrame.DataBytes");
+    int failed = 0;
+    long n;
+
+    memset(f, 0, sizeof(*f));
+    if (id < 0 || data < 0 || g->master < 0)
+        return 0;
+    n = mdf_read_records(mdf, group, &records, &owned);
+    if (n < 0)
+        return -1;
+
+    f->n = n;
+    f->time = malloc(n * sizeof(double) + 1);
+    f->bytes = calloc(n + 1, 8);
+    f->n_bytes = malloc(n * sizeof(uint32_t) + 1);
+    f->id = mdfColumn(mdf, group, "CAN_DataFrame.ID", records, n, &failed);
+    f->ide = mdfColumn(mdf, group, "CAN_DataFrame.IDE", records, n, &failed);
+    f->bus = mdfColumn(mdf, group, "CAN_DataFrame.BusChannel", records, n,
+                       &failed);
+    f->length = mdfColumn(mdf, group, "CAN_DataFrame.DataLength", records, n,
+                          &failed);
+    if (!f->length)
+        f->length = mdfColumn(mdf, group, "CAN_DataFrame.DLC", records, n,
+                              &failed);
+    if (failed || !f->time || !f->bytes || !f->n_bytes || !f->id
+        || mdf_read_values(mdf, g->master, records, n, f->time)
+        || mdf_read_bytes(mdf, data, records, n, f->bytes, 8, f->n_bytes))
+        failed = 1;
+    free(owned);
+    if (failed) {
+        fprintf(stderr, "Reading CAN frames of channel group %u failed.\n",
+                group);
+        mdfFramesFree(f);
+        return -1;
+    }
+    return 1;
+}
+
+
+void mdfReader_processFile(FILE *fp, msgRxCb_t msgRxCb, void *cbData)
+{
+    mdf_t *mdf = mdf_open_file(fp, NULL);
+    MdfFrames *groups;
+    uint32_t n_groups = 0, i;
+    int warned = 0;
+
+    if (!mdf)
+        return;
+    groups = calloc(mdf->n_groups + 1, sizeof(MdfFrames));
+    if (!groups) {
+        fprintf(stderr, "mdfReader_processFile: out of memory\n");
+        mdf_close(mdf);
+        return;
+    }
+    for (i = 0; i < mdf->n_groups; i++) {
+        int got = mdfReadFrames(mdf, i, &groups[n_groups]);
+        if (got < 0)
+            goto exit;
+        n_groups += got;
+    }
+    if (!n_groups)
+        fprintf(stderr, "No CAN_DataFrame channel groups found.\n");
+
+    // Merge the groups by time, there are few of them.
+    for (;;) {
+        MdfFrames *f = NULL;
+        for (i = 0; i < n_groups; i++) {
+            MdfFrames *g = &groups[i];
+            if (g->next < g->n && (!f || g->time[g->next] < f->time[f->next]))
+                f = g;
+        }
+        if (!f)
+            break;
+
+        size_t k = f->next++;
+        uint64_t length = f->length ? f->length[k] : f->n_bytes[k];
+        if (length > 8 || f->n_bytes[k] < length) {
+            if (!warned)
+                fprintf(stderr, "WARNING: DLC > 8 not yet implemented. "
+                        "Skipping msgs.\n");
+            warned = 1;
+            continue;
+        }
+
+        canMessage_t m;
+        uint64_t ns = (uint64_t) llround(f->time[k] * 1e9);
+        m.t.tv_sec = ns / 1000000000;
+        m.t.tv_nsec = ns % 1000000000;
+        m.bus = f->bus ? (uint8_t) f->bus[k] : 1;
+        m.id = f->id[k] & 0x1FFFFFFF;
+        // Extended IDs have bit 31 set, as in BLF and DBC.
+        if ((f->ide && f->ide[k]) || f->id[k] & 0x80000000)
+            m.id |= 0x80000000;
+        m.dlc = (uint8_t) length;
+        memcpy(m.byte_arr, f->bytes + 8 * k, 8);
+        msgRxCb(&m, cbData);
+    }
+
+exit:
+    for (i = 0; i < n_groups; i++)
+        mdfFramesFree(&groups[i]);
+    free(groups);
+    mdf_close(mdf);
+}
@@ -0,0 +1,25 @@
+#ifndef INCLUDE_MDFREADER_H
+#define INCLUDE_MDFREADER_H
+
+#include <stdio.h>
+
+#include "measurement.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parser for CAN frames of MDF 4 bus logging files.
+ *
+ * Channel groups with CAN_DataFrame.ID and CAN_DataFrame.DataBytes
+ * are read, with BusChannel, IDE and DataLength or DLC where given.
+ * Frames of all groups are passed to msgRxCb in time order.
+ */
+void mdfReader_processFile(FILE *fp, msgRxCb_t msgRxCb, void *cbData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INCLUDE_MDFREADER_H
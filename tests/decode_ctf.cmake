@@ -0,0 +1,23 @@
+# Decoding a candump log directly and via a frame archive (.ctf) made
+# from it must give the same archive.
+#
+# cmake -DCANTOMAT=<exe> -DDATA=<dir> -DOUT=<dir> -P decode_ctf.cmake
+
+function(cantomat)
+  execute_process(COMMAND ${CANTOMAT} ${ARGN} RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "cantomat ${ARGN} failed: ${result}")
+  endif()
+endfunction()
+
+file(REMOVE ${OUT}/in.ctf ${OUT}/direct.cta ${OUT}/via_ctf.cta)
+cantomat(-i ${DATA}/in.log -o ${OUT}/in.ctf)
+cantomat(-b 1 -d ${DATA}/test.dbc -i ${DATA}/in.log -o ${OUT}/direct.cta)
+cantomat(-b 1 -d ${DATA}/test.dbc -i ${OUT}/in.ctf -o ${OUT}/via_ctf.cta)
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+                ${OUT}/direct.cta ${OUT}/via_ctf.cta
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "decoding via in.ctf differs from decoding in.log")
+endif()
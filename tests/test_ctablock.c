@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cta.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                             \
+    do {                                                        \
+        if (!(cond)) {                                          \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                         \
+        }                                                       \
+    } while (0)
+
+
+/* Encode and decode a time column, the times must come back exactly. */
+static void round_trip_time(const double *time, size_t n, int level)
+{
+    const size_t bound = cta_block_bound(n);
+    unsigned char *scratch = malloc(bound);
+    unsigned char *data = malloc(bound);
+    double *decoded = malloc(n * sizeof(double));
+    cta_block_t block = {0};
+
+    block.n_rows = n;
+    block.size = cta_block_encode(CTA_TIME_NS, level, time, n,
+                                  scratch, data, &block.codec);
+    CHECK(block.size > 0);
+    CHECK(cta_block_decode(CTA_TIME_NS, &block, data, scratch, decoded) == 0);
+
+    size_t mismatch = 0;
+    for (size_t i = 0; i < n; i++)
+        mismatch += decoded[i] != time[i];
+    if (mismatch)
+        fprintf(stderr, "level %d: %zu of %zu times differ\n", level, mismatch, n);
+    CHECK(mismatch == 0);
+
+    free(scratch);
+    free(data);
+    free(decoded);
+}
+
+
+int main(void)
+{
+    // Times as measurement.c builds them from sec and nsec. For epoch
+    // times the 1e9 scale alone would round most of these.
+    const int64_t starts[] = {1700000000, 0};
+    const size_t n = 10000;
+    double *time = malloc(n * sizeof(double));
+    for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++) {
+        int64_t sec = starts[s], nsec = 123456789;
+        for (size_t i = 0; i < n; i++) {
+            time[i] = sec + nsec * 1e-9;
+            nsec += 1000003 + (int64_t) (i % 7) * 131;
+            sec += nsec / 1000000000;
+            nsec %= 1000000000;
+        }
+        round_trip_time(time, n, 0);
+        round_trip_time(time, n, 6);
+    }
+    free(time);
+    return failures != 0;
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "selection.h"
+
+int verbose_flag = 0;
+
+static int failures = 0;
+
+#define CHECK(cond)                                             \
+    do {                                                        \
+        if (!(cond)) {                                          \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                         \
+        }                                                       \
+    } while (0)
+
+
+/* Whether signal of message passes a selection of one keep pattern. */
+static int keeps(const char *pattern, const char *message, const char *signal)
+{
+    selection_t *selection = selection_create();
+    message_t spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.name = (char *) message;
+
+    int kept = selection_add(selection, select_signal, 0, pattern) == 0
+        && selection_signal(selection, &spec, signal);
+    selection_free(selection);
+    return kept;
+}
+
+
+int main(void)
+{
+    // Globs, a dot makes them Message.Signal.
+    CHECK(keeps("Speed", "EEC1", "Speed"));
+    CHECK(keeps("Sp*", "EEC1", "Speed"));
+    CHECK(!keeps("Sp*", "EEC1", "Torque"));
+    CHECK(keeps("EEC1.Speed", "EEC1", "Speed"));
+    CHECK(keeps("EEC*.Sp*", "EEC1", "Speed"));
+    CHECK(!keeps("EEC1.Speed", "EEC2", "Speed"));
+    CHECK(!keeps("EEC1.Speed", "EEC1", "Torque"));
+
+#ifndef _WIN32
+    // Regular expressions, a dot is a wildcard, both forms are tried.
+    CHECK(keeps("re:Sp.*", "EEC1", "Speed"));
+    CHECK(!keeps("re:Sp.*", "EEC1", "Torque"));
+    CHECK(keeps("re:EEC1\\.Speed", "EEC1", "Speed"));
+    CHECK(keeps("re:EEC.\\.S.*", "EEC1", "Speed"));
+    CHECK(!keeps("re:EEC1\\.Speed", "EEC2", "Speed"));
+    CHECK(keeps("re:(Speed|Torque)", "EEC1", "Torque"));
+#endif
+
+    return failures != 0;
+}